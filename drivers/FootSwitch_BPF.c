@@ -12,6 +12,8 @@
 #include "hid_report_helpers.h"
 #include <bpf/bpf_tracing.h>
 
+#include "footpedal_bpf.h"
+
 /* My device is sold as iKKEGOL "USB Foot Pedal Switch"
  * but the VID is apparently QinHeng so it's just a rebranded
  * devices.
@@ -176,11 +178,272 @@ HID_BPF_CONFIG(
  * don't need to fix that one. We simply change the report to the one we want.
  */
 
+/*
+ * Optionally, every press and release also goes into a ring buffer as a
+ * struct pedal_edge, timestamped here, so a consumer can mmap it and get
+ * kernel timestamped edges without opening hidraw or parsing reports
+ * (see pedal_ringbuf.c). It's off until something sets export_edges in
+ * pedal_opts, so nobody pays for it otherwise. pedal_opts is mmapable so
+ * consumers can count themselves in and out of export_edges atomically.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_RINGBUF);
+	__uint(max_entries, PEDAL_EDGES_SIZE);
+} pedal_edges SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(max_entries, 1);
+	__uint(map_flags, BPF_F_MMAPABLE);
+	__type(key, __u32);
+	__type(value, struct pedal_opts);
+} pedal_opts SEC(".maps");
+
+/* last state we exported for each device, so only edges go out */
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, 64);
+	__type(key, __u32);
+	__type(value, __u32);
+} pedal_state SEC(".maps");
+
+/*
+ * What a press sends, per device with a fallback for all of them (see
+ * struct pedal_binding), so bindings change while the program stays
+ * attached: pedal_keymap.c writes a whole binding per update and the next
+ * report picks it up. It's a hash map rather than an array because hash
+ * updates swap in a new element instead of copying over the one a report
+ * may be reading, and BPF_F_NO_PREALLOC keeps the old one around until
+ * such readers are done. With no binding at all a press is Ctrl+C.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, PEDAL_KEYMAP_MAX);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, __u32);
+	__type(value, struct pedal_binding);
+} pedal_keymap SEC(".maps");
+
+/*
+ * Gestures: with a pedal_gestures entry for a pedal (or for all of them),
+ * a press no longer goes straight out. A per-device state machine tells a
+ * tap, a double tap and a long press apart with a bpf_timer, and sends
+ * the matching binding without userspace in the loop:
+ *
+ *   IDLE   --press-->             DOWN, timer = long_press_ms
+ *   DOWN   --release-->           WAIT, timer = double_tap_ms
+ *   DOWN   --timer-->             LONG, send long press (held), timer = repeat_ms
+ *   WAIT   --press-->             DOUBLE, this report becomes the double tap
+ *   WAIT   --timer-->             IDLE, send tap (press and release)
+ *   LONG   --timer-->             send long press again, timer = repeat_ms
+ *   LONG, DOUBLE --release-->     IDLE, the release goes out as is
+ *
+ * Without a double tap binding WAIT ends right away. Reports that the
+ * timer decides on are injected with hid_bpf_input_report(), which has to
+ * sleep, so the timer hands them to a bpf_wq. Both callbacks race with
+ * the next report, so every transition is a compare-and-swap on state.
+ */
+enum {
+	GESTURE_IDLE,
+	GESTURE_DOWN,
+	GESTURE_WAIT,
+	GESTURE_DOUBLE,
+	GESTURE_LONG,
+};
+
+/* what gesture_emit injects */
+enum {
+	EMIT_TAP,	/* tap press and release */
+	EMIT_LONG,	/* long press, held */
+	EMIT_REPEAT,	/* release and long press again */
+};
+
+struct pedal_gesture {
+	struct bpf_timer timer;
+	struct bpf_wq wq;
+	__u32 hid;
+	__u32 state;
+	__u32 emit;
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, PEDAL_KEYMAP_MAX);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, __u32);
+	__type(value, struct pedal_gestures);
+} pedal_gestures SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, PEDAL_KEYMAP_MAX);
+	__type(key, __u32);
+	__type(value, struct pedal_gesture);
+} gesture_state SEC(".maps");
+
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC 1
+#endif
+#define MS(ms) ((__u64)(ms) * 1000000)
+
+static __always_inline struct pedal_gestures *find_gestures(__u32 hid)
+{
+	__u32 any = PEDAL_KEYMAP_ANY;
+	struct pedal_gestures *g = bpf_map_lookup_elem(&pedal_gestures, &hid);
+
+	return g ? g : bpf_map_lookup_elem(&pedal_gestures, &any);
+}
+
+static __always_inline void binding_report(__u8 *report, const struct pedal_binding *b)
+{
+	report[0] = KEYBOARD_REPORT_ID;
+	report[1] = b->modifiers;
+	report[2] = 0;
+	__builtin_memcpy(&report[3], b->keys, sizeof(b->keys));
+}
+
+static __always_inline bool binding_empty(const struct pedal_binding *b)
+{
+	return !b->modifiers && !b->keys[0];
+}
+
+/* bpf_wq callback, may sleep */
+static int gesture_emit(void *map, int *key, void *value)
+{
+	struct pedal_gesture *st = value;
+	struct pedal_gestures *cfg = find_gestures(st->hid);
+	__u32 emit = st->emit;
+
+	if (!cfg)
+		return 0;
+	/* the pedal may have come up since the timer fired, don't leave a key down */
+	if (emit != EMIT_TAP && st->state != GESTURE_LONG)
+		return 0;
+
+	struct hid_bpf_ctx *ctx = hid_bpf_allocate_context(st->hid);
+	if (!ctx)
+		return 0;
+
+	__u8 press[9], release[9] = {KEYBOARD_REPORT_ID, 0, 0, 0, 0, 0, 0, 0, 0};
+	binding_report(press, &cfg->binding[emit == EMIT_TAP ? PEDAL_TAP : PEDAL_LONG_PRESS]);
+
+	if (emit == EMIT_REPEAT)
+		hid_bpf_input_report(ctx, HID_INPUT_REPORT, release, sizeof(release));
+	hid_bpf_input_report(ctx, HID_INPUT_REPORT, press, sizeof(press));
+	if (emit == EMIT_TAP)
+		hid_bpf_input_report(ctx, HID_INPUT_REPORT, release, sizeof(release));
+
+	hid_bpf_release_context(ctx);
+	return 0;
+}
+
+/* bpf_timer callback, runs in softirq */
+static int gesture_timeout(void *map, __u32 *key, struct pedal_gesture *st)
+{
+	struct pedal_gestures *cfg = find_gestures(st->hid);
+
+	if (!cfg)
+		return 0;
+
+	if (__sync_val_compare_and_swap(&st->state, GESTURE_WAIT, GESTURE_IDLE) == GESTURE_WAIT) {
+		st->emit = EMIT_TAP;
+	} else if (__sync_val_compare_and_swap(&st->state, GESTURE_DOWN, GESTURE_LONG) == GESTURE_DOWN) {
+		st->emit = EMIT_LONG;
+		if (cfg->repeat_ms)
+			bpf_timer_start(&st->timer, MS(cfg->repeat_ms), 0);
+	} else if (st->state == GESTURE_LONG && cfg->repeat_ms) {
+		st->emit = EMIT_REPEAT;
+		bpf_timer_start(&st->timer, MS(cfg->repeat_ms), 0);
+	} else {
+		return 0;
+	}
+	bpf_wq_start(&st->wq, 0);
+	return 0;
+}
+
+static __always_inline struct pedal_gesture *gesture_get(__u32 hid)
+{
+	struct pedal_gesture *st = bpf_map_lookup_elem(&gesture_state, &hid);
+	if (st)
+		return st;
+
+	struct pedal_gesture fresh = { .hid = hid };
+	bpf_map_update_elem(&gesture_state, &hid, &fresh, BPF_NOEXIST);
+	st = bpf_map_lookup_elem(&gesture_state, &hid);
+	if (!st)
+		return NULL;
+	bpf_timer_init(&st->timer, &gesture_state, CLOCK_MONOTONIC);
+	bpf_timer_set_callback(&st->timer, gesture_timeout);
+	bpf_wq_init(&st->wq, &gesture_state, 0);
+	bpf_wq_set_callback(&st->wq, gesture_emit, 0);
+	return st;
+}
+
+/* returns what footpedal_2_fix_events should: the report's new size, 0 to
+ * leave it alone or negative to drop it */
+static __always_inline int gesture_event(__u8 *data, __u32 hid, struct pedal_gestures *cfg, bool pressed)
+{
+	struct pedal_gesture *st = gesture_get(hid);
+	if (!st)
+		return 0;
+
+	if (pressed) {
+		if (__sync_val_compare_and_swap(&st->state, GESTURE_WAIT, GESTURE_DOUBLE) == GESTURE_WAIT)
+			bpf_timer_cancel(&st->timer);
+		else if (__sync_val_compare_and_swap(&st->state, GESTURE_IDLE, GESTURE_DOWN) == GESTURE_IDLE)
+			bpf_timer_start(&st->timer, MS(cfg->long_press_ms), 0);
+
+		if (st->state != GESTURE_DOUBLE)
+			return -1; /* held, nothing to send yet */
+		binding_report(data, &cfg->binding[PEDAL_DOUBLE_TAP]);
+		return 9;
+	}
+
+	if (__sync_val_compare_and_swap(&st->state, GESTURE_DOWN, GESTURE_WAIT) == GESTURE_DOWN) {
+		bool wait = !binding_empty(&cfg->binding[PEDAL_DOUBLE_TAP]);
+		bpf_timer_start(&st->timer, wait ? MS(cfg->double_tap_ms) : 0, 0);
+		return -1;
+	}
+	if (__sync_val_compare_and_swap(&st->state, GESTURE_LONG, GESTURE_IDLE) == GESTURE_LONG ||
+	    __sync_val_compare_and_swap(&st->state, GESTURE_DOUBLE, GESTURE_IDLE) == GESTURE_DOUBLE) {
+		bpf_timer_cancel(&st->timer);
+		return 0;
+	}
+	return -1;
+}
+
+static __always_inline void export_edge(struct hid_bpf_ctx *hctx, __u64 time_ns, __u32 pressed)
+{
+	__u32 zero = 0;
+	struct pedal_opts *opts = bpf_map_lookup_elem(&pedal_opts, &zero);
+	if (!opts || !opts->export_edges)
+		return;
+
+	__u32 hid = hctx->hid->id;
+	__u32 *last = bpf_map_lookup_elem(&pedal_state, &hid);
+	if (last && *last == pressed)
+		return;
+	bpf_map_update_elem(&pedal_state, &hid, &pressed, BPF_ANY);
+
+	struct pedal_edge *e = bpf_ringbuf_reserve(&pedal_edges, sizeof(*e), 0);
+	if (!e)
+		return;
+	e->time_ns = time_ns;
+	e->hid = hid;
+	e->pressed = pressed;
+	bpf_ringbuf_submit(e, 0);
+}
+
 SEC(HID_BPF_DEVICE_EVENT)
-int BPF_PROG(footpedal_2_fix_events, struct hid_bpf_ctx *hctx)
+int BPF_PROG(footpedal_2_fix_events, struct hid_bpf_ctx *hctx, enum hid_report_type type, __u64 source)
 {
+	__u64 now = bpf_ktime_get_ns();
 	__u8 *data = hid_bpf_get_data(hctx, 0 /* offset */, 10 /* size */);
 
+	/* reports gesture_emit injected are already what we want */
+	if (source)
+		return 0;
+
 	/* We only check for the report ID which means this BPF will take
 	 * effect regardless what the current configured keyboard shortcut ist.
 	 * If you managed to configure the device on Windows to send some pointer
@@ -192,14 +455,26 @@ int BPF_PROG(footpedal_2_fix_events, struct hid_bpf_ctx *hctx)
 		return 0; /* EPERM check */
 
 	__u8 release[9] =  {KEYBOARD_REPORT_ID, 0, 0, 0, 0, 0, 0, 0, 0};
-	if (__builtin_memcmp(data, release, sizeof(release)) == 0)
+	bool pressed = __builtin_memcmp(data, release, sizeof(release)) != 0;
+	export_edge(hctx, now, pressed);
+
+	__u32 hid = hctx->hid->id, any = PEDAL_KEYMAP_ANY;
+	struct pedal_gestures *cfg = find_gestures(hid);
+	if (cfg)
+		return gesture_event(data, hid, cfg, pressed);
+	if (!pressed)
 		return 0;
 
-	/* Change this to what you want it to do, here it's Ctrl+C */
-	const __u8 modifiers = 0x1;
-	const __u8 keycode = 6;  /* From Usage Page Keyboard */
+	struct pedal_binding *b = bpf_map_lookup_elem(&pedal_keymap, &hid);
+	if (!b)
+		b = bpf_map_lookup_elem(&pedal_keymap, &any);
 
-	__u8 report[9] =  {KEYBOARD_REPORT_ID, modifiers, 0, keycode, 0, 0, 0, 0, 0};
+	/* Ctrl+C unless pedal_keymap says otherwise, keycodes from Usage Page Keyboard */
+	__u8 report[9] =  {KEYBOARD_REPORT_ID, 0x1, 0, 6, 0, 0, 0, 0, 0};
+	if (b) {
+		report[1] = b->modifiers;
+		__builtin_memcpy(&report[3], b->keys, sizeof(b->keys));
+	}
 	__builtin_memcpy(data, report, sizeof(report));
 	return sizeof(report);
 }
@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/uhid.h>
+
+#include "bpf_util.h"
+// the BPF program's probe only takes devices with this 212 byte descriptor
+#include "../footpedal_userspace/footswitch_rdesc.h"
+
+uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+long sys_bpf(int cmd, union bpf_attr *attr){
+    return syscall(SYS_bpf, cmd, attr, sizeof(*attr));
+}
+
+// every map with this name, oldest first: there's one set per loaded copy
+// of the program, i.e. one per pedal, and nothing pins them
+int find_maps(const char *name, int *fds, struct bpf_map_info *info, int max){
+    union bpf_attr attr;
+    __u32 id = 0;
+    int n = 0;
+
+    while(n < max){
+        memset(&attr, 0, sizeof(attr));
+        attr.start_id = id;
+        if(sys_bpf(BPF_MAP_GET_NEXT_ID, &attr) < 0)
+            break;
+        id = attr.next_id;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.map_id = id;
+        int fd = sys_bpf(BPF_MAP_GET_FD_BY_ID, &attr);
+        if(fd < 0)
+            continue;
+
+        struct bpf_map_info mi;
+        memset(&mi, 0, sizeof(mi));
+        memset(&attr, 0, sizeof(attr));
+        attr.info.bpf_fd = fd;
+        attr.info.info_len = sizeof(mi);
+        attr.info.info = (uintptr_t)&mi;
+        if(sys_bpf(BPF_OBJ_GET_INFO_BY_FD, &attr) == 0 && strcmp(mi.name, name) == 0){
+            fds[n] = fd;
+            if(info != NULL)
+                info[n] = mi;
+            n++;
+        }else{
+            close(fd);
+        }
+    }
+    return n;
+}
+
+void close_maps(int *fds, int n){
+    for(int i = 0; i < n; i++)
+        close(fds[i]);
+}
+
+int map_update(int fd, const void *key, const void *value){
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = fd;
+    attr.key = (uintptr_t)key;
+    attr.value = (uintptr_t)value;
+    attr.flags = BPF_ANY;
+    return sys_bpf(BPF_MAP_UPDATE_ELEM, &attr);
+}
+
+int map_lookup(int fd, const void *key, void *value){
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = fd;
+    attr.key = (uintptr_t)key;
+    attr.value = (uintptr_t)value;
+    return sys_bpf(BPF_MAP_LOOKUP_ELEM, &attr);
+}
+
+int map_delete(int fd, const void *key){
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = fd;
+    attr.key = (uintptr_t)key;
+    return sys_bpf(BPF_MAP_DELETE_ELEM, &attr);
+}
+
+int map_next_key(int fd, const void *key, void *next){
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = fd;
+    attr.key = (uintptr_t)key;
+    attr.next_key = (uintptr_t)next;
+    return sys_bpf(BPF_MAP_GET_NEXT_KEY, &attr);
+}
+
+int uhid_create(const char *uniq){
+    int fd = open("/dev/uhid", O_RDWR | O_CLOEXEC);
+    if(fd < 0)
+        return -1;
+
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    snprintf((char *)ev.u.create2.name, sizeof(ev.u.create2.name), "QinHeng FootSwitch");
+    snprintf((char *)ev.u.create2.uniq, sizeof(ev.u.create2.uniq), "%s", uniq);
+    ev.u.create2.rd_size = sizeof(footswitch_rdesc);
+    ev.u.create2.bus = BUS_USB;
+    ev.u.create2.vendor = 0x1a86;
+    ev.u.create2.product = 0xe026;
+    memcpy(ev.u.create2.rd_data, footswitch_rdesc, sizeof(footswitch_rdesc));
+
+    if(write(fd, &ev, sizeof(ev)) != sizeof(ev)){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void uhid_send(int fd, bool pressed){
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_INPUT2;
+    ev.u.input2.size = 9;
+    ev.u.input2.data[0] = 1;
+    ev.u.input2.data[3] = pressed ? 5 : 0;
+    write(fd, &ev, offsetof(struct uhid_event, u.input2.data) + ev.u.input2.size);
+}
+
+// the hidraw node of the HID device with this uniq, and that device's id
+int open_hidraw(const char *uniq, __u32 *hid){
+    DIR *dir = opendir("/sys/class/hidraw");
+    struct dirent *d;
+    int fd = -1;
+
+    while(dir != NULL && fd < 0 && (d = readdir(dir)) != NULL){
+        char path[300], line[256], link[300];
+        bool match = false;
+
+        snprintf(path, sizeof(path), "/sys/class/hidraw/%s/device/uevent", d->d_name);
+        FILE *f = fopen(path, "r");
+        if(f == NULL)
+            continue;
+        while(fgets(line, sizeof(line), f) != NULL){
+            line[strcspn(line, "\n")] = '\0';
+            if(strncmp(line, "HID_UNIQ=", 9) == 0 && strcmp(line + 9, uniq) == 0)
+                match = true;
+        }
+        fclose(f);
+        if(!match)
+            continue;
+
+        // the device link ends in 0003:1A86:E026.<id in hex>
+        snprintf(path, sizeof(path), "/sys/class/hidraw/%s/device", d->d_name);
+        ssize_t len = readlink(path, link, sizeof(link) - 1);
+        char *dot = len > 0 ? (link[len] = '\0', strrchr(link, '.')) : NULL;
+        if(dot == NULL)
+            continue;
+        *hid = strtoul(dot + 1, NULL, 16);
+
+        snprintf(path, sizeof(path), "/dev/%s", d->d_name);
+        fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    }
+    if(dir != NULL)
+        closedir(dir);
+    return fd;
+}
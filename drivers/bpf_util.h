@@ -0,0 +1,37 @@
+/*
+ * What the userspace tools for FootSwitch_BPF share: finding the
+ * program's maps with raw bpf() calls (no libbpf needed), and a uhid
+ * pedal that looks like the real one so they can be tested without one.
+ */
+
+#ifndef BPF_UTIL_H
+#define BPF_UTIL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <linux/types.h>
+#include <linux/bpf.h>
+
+uint64_t now_ns();
+
+long sys_bpf(int cmd, union bpf_attr *attr);
+// more pedals than anyone plugs in at once
+#define MAX_MAPS 16
+
+// fds (and info, unless NULL) of up to max maps with this name, returns
+// how many. Every loaded copy of the program, one per pedal, has its own
+int find_maps(const char *name, int *fds, struct bpf_map_info *info, int max);
+void close_maps(int *fds, int n);
+int map_update(int fd, const void *key, const void *value);
+int map_lookup(int fd, const void *key, void *value);
+int map_delete(int fd, const void *key);
+// key NULL gives the first key
+int map_next_key(int fd, const void *key, void *next);
+
+// a uhid QinHeng pedal with this uniq, returns the uhid fd
+int uhid_create(const char *uniq);
+void uhid_send(int fd, bool pressed);
+// open the hidraw node of the HID device with this uniq and tell its hid id
+int open_hidraw(const char *uniq, __u32 *hid);
+
+#endif
@@ -1,7 +1,16 @@
 /* 
- * Basic driver that will store 64 bytes of data. You can write to it
- * to store this data, or you can read the data you put in. It will
- * start with the text "Welcome to the world of mycorrhizae!"
+ * Pedal event device. Every open file of /dev/demo-x gets its own queue
+ * of timestamped press/release events (struct demo_event, see
+ * demo_driver.h): read() blocks until there is one, or returns -EAGAIN
+ * with O_NONBLOCK, and poll()/epoll wake up when one arrives. Writing
+ * events to the device queues them for every open file, which is how
+ * synthetic events get in (see demo_test.c). HID drivers hand it real
+ * edges with demo_report_event() (see hid_descriptor_remap.c). The device's current state
+ * is also on a page that can be mmap()ed read-only (struct demo_page),
+ * and DEMO_IOC_FETCH drains many events per syscall.
+ *
+ * Nothing here logs. Every file operation and event has a tracepoint
+ * (demo_trace.h), and per-CPU counters are in /sys/kernel/debug/demo/stats.
  * 
 */
 
@@ -9,82 +18,430 @@
 #include <linux/init.h>
 
 #include <linux/cdev.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/kernel.h>
 #include <linux/fs.h>
 #include <linux/uaccess.h>
 
-#include <linux/string.h>
+#include <linux/kfifo.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/poll.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#include "demo_driver.h"
+
+#define CREATE_TRACE_POINTS
+#include "demo_trace.h"
 
 // max Minor devices
 #define MAX_DEV 1
 
-static char data[64] = "Welcome to the world of mycorrhizae!\n";
+// device data holder, this structure may be extended to hold additional data
+struct demo_dev_data {
+    struct cdev cdev;
 
-static int demo_open(struct inode *inode, struct file *file)
+    // protects clients, and makes whoever holds it the one producer
+    // for all of their fifos
+    spinlock_t lock;
+    struct list_head clients;
+
+    // readers sleep here until their fifo has something in it
+    wait_queue_head_t wait;
+
+    // what consumers mmap(), only written under lock
+    struct demo_page *page;
+};
+
+// one per open file, like an evdev client. the fifo has one producer
+// (under demo_dev_data.lock) and one consumer (under read_lock), so
+// kfifo itself needs no locking
+struct demo_client {
+    struct list_head node;
+    struct demo_dev_data *dev;
+    struct mutex read_lock;
+    unsigned long dropped;  // events that didn't fit in the fifo
+    DECLARE_KFIFO(fifo, struct demo_event, DEMO_QUEUE_LEN);
+};
+
+// counted per CPU so the hot paths never share a cache line, and only
+// added up when someone reads them from debugfs
+struct demo_stats {
+    u64 opens;
+    u64 reads;
+    u64 writes;
+    u64 bytes;      // read and written
+    u64 faults;     // bad user pointers
+    u64 overflows;  // events a full queue had to drop
+};
+
+static DEFINE_PER_CPU(struct demo_stats, demo_stats);
+
+static struct dentry *demo_debugfs;
+
+static int demo_stats_show(struct seq_file *m, void *v)
 {
-    printk(KERN_INFO "demo driver: Device open\n");
+    struct demo_stats sum = { 0 };
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct demo_stats *s = per_cpu_ptr(&demo_stats, cpu);
+
+        sum.opens += READ_ONCE(s->opens);
+        sum.reads += READ_ONCE(s->reads);
+        sum.writes += READ_ONCE(s->writes);
+        sum.bytes += READ_ONCE(s->bytes);
+        sum.faults += READ_ONCE(s->faults);
+        sum.overflows += READ_ONCE(s->overflows);
+    }
+
+    seq_printf(m, "opens: %llu\nreads: %llu\nwrites: %llu\nbytes: %llu\nfaults: %llu\noverflows: %llu\n",
+               sum.opens, sum.reads, sum.writes, sum.bytes, sum.faults, sum.overflows);
     return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(demo_stats);
+
+// the write side of the page's seqcount, same as the vDSO data page
+static void demo_page_begin(struct demo_page *pg)
+{
+    WRITE_ONCE(pg->seq, pg->seq + 1);
+    smp_wmb();
+}
+
+static void demo_page_end(struct demo_page *pg)
+{
+    smp_wmb();
+    WRITE_ONCE(pg->seq, pg->seq + 1);
+}
+
+// queue already stamped events for every open file and wake whoever
+// waits for them. takes the lock with irqsave so a HID raw_event handler
+// can call it too
+static void demo_push_events(struct demo_dev_data *d, const struct demo_event *ev, size_t n)
+{
+    struct demo_page *pg = d->page;
+    struct demo_client *c;
+    unsigned long flags;
+    u64 dropped = 0;
+    size_t i;
+
+    spin_lock_irqsave(&d->lock, flags);
+    for (i = 0; i < n; i++) {
+        unsigned int full = 0;
+
+        list_for_each_entry(c, &d->clients, node) {
+            if (!kfifo_put(&c->fifo, ev[i])) {
+                c->dropped++;
+                full++;
+            }
+        }
+        dropped += full;
+        trace_demo_event(MINOR(d->cdev.dev), &ev[i], full);
+    }
+    if (dropped)
+        this_cpu_add(demo_stats.overflows, dropped);
+
+    demo_page_begin(pg);
+    for (i = 0; i < n; i++) {
+        u64 bit = 1ull << ev[i].pedal;
+
+        if (!(pg->pressed & bit) == !ev[i].pressed)
+            continue;
+        pg->pressed ^= bit;
+        pg->last_pedal = ev[i].pedal;
+        pg->last_edge_ns = ev[i].time_ns;
+        pg->edges++;
+    }
+    pg->events += n;
+    pg->dropped += dropped;
+    demo_page_end(pg);
+    spin_unlock_irqrestore(&d->lock, flags);
+
+    wake_up_interruptible_poll(&d->wait, EPOLLIN | EPOLLRDNORM);
+}
+
+static int demo_open(struct inode *inode, struct file *file)
+{
+    struct demo_dev_data *d = container_of(inode->i_cdev, struct demo_dev_data, cdev);
+    struct demo_client *c;
+
+    trace_demo_open(MINOR(inode->i_rdev));
+    this_cpu_inc(demo_stats.opens);
+
+    c = kzalloc(sizeof(*c), GFP_KERNEL);
+    if (!c)
+        return -ENOMEM;
+
+    c->dev = d;
+    mutex_init(&c->read_lock);
+    INIT_KFIFO(c->fifo);
+
+    spin_lock_irq(&d->lock);
+    list_add_tail(&c->node, &d->clients);
+    demo_page_begin(d->page);
+    d->page->opens++;
+    demo_page_end(d->page);
+    spin_unlock_irq(&d->lock);
+
+    file->private_data = c;
+    return nonseekable_open(inode, file);
+}
 
 static int demo_release(struct inode *inode, struct file *file)
 {
-    printk(KERN_INFO "demo driver: Device close\n");
+    struct demo_client *c = file->private_data;
+
+    trace_demo_release(MINOR(inode->i_rdev));
+
+    spin_lock_irq(&c->dev->lock);
+    list_del(&c->node);
+    spin_unlock_irq(&c->dev->lock);
+
+    kfree(c);
     return 0;
 }
 
-static long demo_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+// wait until there are f->min events, then copy up to f->max of them
+static long demo_fetch(struct demo_client *c, struct demo_fetch *f)
 {
-    printk(KERN_INFO "demo driver: Device ioctl\n");
+    unsigned int want = min3(f->min, f->max, (u32)DEMO_QUEUE_LEN);
+    unsigned int copied;
+    long ret = 0;
+    int err;
+
+    if (f->max == 0)
+        return -EINVAL;
+
+    if (want > 0 && f->timeout_ms < 0)
+        ret = wait_event_interruptible(c->dev->wait, kfifo_len(&c->fifo) >= want);
+    else if (want > 0 && f->timeout_ms > 0)
+        ret = wait_event_interruptible_timeout(c->dev->wait, kfifo_len(&c->fifo) >= want,
+                                               msecs_to_jiffies(f->timeout_ms));
+    if (ret < 0)
+        return ret;
+
+    if (mutex_lock_interruptible(&c->read_lock))
+        return -ERESTARTSYS;
+    // the queue never holds more than DEMO_QUEUE_LEN anyway
+    err = kfifo_to_user(&c->fifo, u64_to_user_ptr(f->events),
+                        min(f->max, (u32)DEMO_QUEUE_LEN) * sizeof(struct demo_event), &copied);
+    mutex_unlock(&c->read_lock);
+    if (err)
+        return err;
+
+    f->count = copied / sizeof(struct demo_event);
     return 0;
 }
 
-static ssize_t demo_read(struct file *file, char __user *buf, size_t count, loff_t *offset)
+static long __demo_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
-    printk(KERN_INFO "more stuff!\n");
-    printk(KERN_INFO "demo driver: Device read\n");
-    printk(KERN_INFO "Offset: %lld\n", *offset);
+    struct demo_client *c = file->private_data;
+    struct demo_dev_data *d = c->dev;
+    void __user *uarg = (void __user *)arg;
+    long ret;
+
+    switch (cmd) {
+    case DEMO_IOC_FETCH: {
+        struct demo_fetch f;
+
+        if (copy_from_user(&f, uarg, sizeof(f)))
+            return -EFAULT;
+        ret = demo_fetch(c, &f);
+        if (ret)
+            return ret;
+        if (copy_to_user(uarg, &f, sizeof(f)))
+            return -EFAULT;
+        return 0;
+    }
 
-    // we must use copy_to_user rather than memcpy to make sure
-    // the user hasn't passed in some malicious pointer (would be really bad)
-    // if we injected some data into some random target program on
-    // this PC!
+    case DEMO_IOC_GET_COUNTERS: {
+        struct demo_counters cnt;
 
-    size_t data_len = min((size_t)64, strlen(data) + 1);
+        spin_lock_irq(&d->lock);
+        cnt.events = d->page->events;
+        cnt.edges = d->page->edges;
+        cnt.dropped = d->page->dropped;
+        cnt.opens = d->page->opens;
+        spin_unlock_irq(&d->lock);
 
-    if(*offset >= data_len){
+        if (copy_to_user(uarg, &cnt, sizeof(cnt)))
+            return -EFAULT;
         return 0;
     }
 
-    count = min(count, (size_t)(data_len - *offset));
+    case DEMO_IOC_RESET_COUNTERS:
+        spin_lock_irq(&d->lock);
+        demo_page_begin(d->page);
+        d->page->events = 0;
+        d->page->edges = 0;
+        d->page->dropped = 0;
+        d->page->opens = 0;
+        demo_page_end(d->page);
+        spin_unlock_irq(&d->lock);
+        return 0;
 
-    if(_copy_to_user(buf, data + *offset, count)){
-        return -EFAULT;
-    }
+    case DEMO_IOC_QUEUE: {
+        struct demo_queue q;
 
-    *offset += count;
+        spin_lock_irq(&d->lock);
+        q.len = kfifo_len(&c->fifo);
+        q.size = kfifo_size(&c->fifo);
+        q.dropped = c->dropped;
+        spin_unlock_irq(&d->lock);
 
-    return count;
+        if (copy_to_user(uarg, &q, sizeof(q)))
+            return -EFAULT;
+        return 0;
+    }
+    }
+
+    return -ENOTTY;
 }
 
-static ssize_t demo_write(struct file *file, const char __user *buf, size_t count, loff_t *offset)
+static ssize_t __demo_read(struct file *file, char __user *buf, size_t count)
 {
-    printk(KERN_INFO "demo driver: Device write\n");
-    printk(KERN_INFO "offset: %lld count: %ld", *offset, count);
+    struct demo_client *c = file->private_data;
+    unsigned int copied;
+    int err;
 
-    count = min(count, (size_t)(64 - *offset));
+    // only whole events
+    if (count < sizeof(struct demo_event))
+        return -EINVAL;
 
-    if(*offset > 64){
-        return 0;
+    for (;;) {
+        if (mutex_lock_interruptible(&c->read_lock))
+            return -ERESTARTSYS;
+
+        // kfifo_to_user uses copy_to_user, so a bad pointer from
+        // userspace gets us -EFAULT rather than a write to who knows where
+        err = kfifo_to_user(&c->fifo, buf, count, &copied);
+        mutex_unlock(&c->read_lock);
+
+        if (err)
+            return err;
+        if (copied)
+            return copied;
+
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+
+        if (wait_event_interruptible(c->dev->wait, !kfifo_is_empty(&c->fifo)))
+            return -ERESTARTSYS;
     }
+}
 
-    if(copy_from_user(data + *offset, buf, count)){
-        return -EFAULT;
+static ssize_t __demo_write(struct file *file, const char __user *buf, size_t count)
+{
+    struct demo_client *c = file->private_data;
+    struct demo_event ev[16];
+    u64 now = ktime_get_ns();
+    size_t done = 0;
+
+    if (count < sizeof(ev[0]))
+        return -EINVAL;
+
+    // a few events at a time, each batch is one wakeup
+    while (count - done >= sizeof(ev[0])) {
+        size_t n = min((count - done) / sizeof(ev[0]), ARRAY_SIZE(ev));
+        size_t i;
+
+        if (copy_from_user(ev, buf + done, n * sizeof(ev[0])))
+            return done ? done : -EFAULT;
+
+        for (i = 0; i < n; i++) {
+            if (ev[i].pedal >= DEMO_MAX_PEDALS)
+                return done ? done : -EINVAL;
+            ev[i].time_ns = now;
+        }
+
+        demo_push_events(c->dev, ev, n);
+        done += n * sizeof(ev[0]);
     }
 
-    *offset += count;
+    return done;
+}
+
+// the file operations proper, wrapped to trace and count each call
+
+static unsigned int demo_minor(struct file *file)
+{
+    return MINOR(file_inode(file)->i_rdev);
+}
+
+static void demo_count_rw(ssize_t ret)
+{
+    if (ret > 0)
+        this_cpu_add(demo_stats.bytes, ret);
+    else if (ret == -EFAULT)
+        this_cpu_inc(demo_stats.faults);
+}
+
+static long demo_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    long ret = __demo_ioctl(file, cmd, arg);
+
+    trace_demo_ioctl(demo_minor(file), cmd, ret);
+    if (ret == -EFAULT)
+        this_cpu_inc(demo_stats.faults);
+    return ret;
+}
+
+static ssize_t demo_read(struct file *file, char __user *buf, size_t count, loff_t *offset)
+{
+    ssize_t ret = __demo_read(file, buf, count);
 
-    return count;
+    trace_demo_read(demo_minor(file), count, ret);
+    this_cpu_inc(demo_stats.reads);
+    demo_count_rw(ret);
+    return ret;
+}
+
+static ssize_t demo_write(struct file *file, const char __user *buf, size_t count, loff_t *offset)
+{
+    ssize_t ret = __demo_write(file, buf, count);
+
+    trace_demo_write(demo_minor(file), count, ret);
+    this_cpu_inc(demo_stats.writes);
+    demo_count_rw(ret);
+    return ret;
+}
+
+// we never have to wait to take events, only to hand them out
+static __poll_t demo_poll(struct file *file, poll_table *wait)
+{
+    struct demo_client *c = file->private_data;
+    __poll_t mask = EPOLLOUT | EPOLLWRNORM;
+
+    poll_wait(file, &c->dev->wait, wait);
+
+    if (!kfifo_is_empty(&c->fifo))
+        mask |= EPOLLIN | EPOLLRDNORM;
+
+    return mask;
+}
+
+// map the state page. it's the kernel's, so nobody gets to write to it
+static int demo_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct demo_client *c = file->private_data;
+
+    if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE)
+        return -EINVAL;
+
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    vma->vm_flags &= ~VM_MAYWRITE;
+
+    return remap_pfn_range(vma, vma->vm_start, page_to_pfn(virt_to_page(c->dev->page)),
+                           PAGE_SIZE, vma->vm_page_prot);
 }
 
 // initialize file_operations
@@ -94,12 +451,9 @@ static const struct file_operations demo_fops = {
     .release    = demo_release,
     .unlocked_ioctl = demo_ioctl,
     .read       = demo_read,
-    .write       = demo_write
-};
-
-// device data holder, this structure may be extended to hold additional data
-struct demo_dev_data {
-    struct cdev cdev;
+    .write       = demo_write,
+    .poll       = demo_poll,
+    .mmap       = demo_mmap,
 };
 
 //global storage for device
@@ -114,10 +468,39 @@ static struct class *demo_class = NULL;
 // array of mychar_device_data for
 static struct demo_dev_data demo_data[MAX_DEV];
 
+// for HID drivers: queue one pedal edge on /dev/demo-0, with the time
+// the caller saw it. fine to call from the URB completion raw_event runs in
+void demo_report_event(u32 pedal, bool pressed, u64 time_ns)
+{
+    struct demo_event ev = {
+        .time_ns = time_ns,
+        .pedal = pedal,
+        .pressed = pressed,
+    };
+
+    if (pedal >= DEMO_MAX_PEDALS)
+        return;
+
+    demo_push_events(&demo_data[0], &ev, 1);
+}
+EXPORT_SYMBOL_GPL(demo_report_event);
+
 int __init demo_init(void)
 {
     int err, i;
 
+    BUILD_BUG_ON(sizeof(struct demo_page) > PAGE_SIZE);
+
+    // the state pages go to userspace whole, so each gets a page of its own
+    for (i = 0; i < MAX_DEV; i++) {
+        demo_data[i].page = (struct demo_page *)get_zeroed_page(GFP_KERNEL);
+        if (!demo_data[i].page) {
+            while (i--)
+                free_page((unsigned long)demo_data[i].page);
+            return -ENOMEM;
+        }
+    }
+
     // allocate chardev region and assign Major number
     err = alloc_chrdev_region(&dev, 0, MAX_DEV, "demo");
 
@@ -128,6 +511,10 @@ int __init demo_init(void)
 
     // Create necessary number of the devices
     for (i = 0; i < MAX_DEV; i++) {
+        spin_lock_init(&demo_data[i].lock);
+        INIT_LIST_HEAD(&demo_data[i].clients);
+        init_waitqueue_head(&demo_data[i].wait);
+
         // init new device
         cdev_init(&demo_data[i].cdev, &demo_fops);
         demo_data[i].cdev.owner = THIS_MODULE;
@@ -139,6 +526,10 @@ int __init demo_init(void)
         device_create(demo_class, NULL, MKDEV(dev_major, i), NULL, "demo-%d", i);
     }
 
+    // debugfs is best effort, the device works without it
+    demo_debugfs = debugfs_create_dir("demo", NULL);
+    debugfs_create_file("stats", 0444, demo_debugfs, NULL, &demo_stats_fops);
+
     return 0;
 }
 
@@ -146,9 +537,12 @@ static void __exit demo_exit(void)
 {
     int i;
 
+    debugfs_remove_recursive(demo_debugfs);
+
     for (i = 0; i < MAX_DEV; i++) {
         cdev_del(&demo_data[i].cdev);
         device_destroy(demo_class, MKDEV(dev_major, i));
+        free_page((unsigned long)demo_data[i].page);
     }
 
     class_unregister(demo_class);
@@ -161,7 +555,7 @@ module_init(demo_init);
 module_exit(demo_exit);
 
 #define DRIVER_AUTHOR "Kenneth Ge <kge@redhat.com>"
-#define DRIVER_DESC   "A sample driver"
+#define DRIVER_DESC   "Foot pedal event device"
 
 /* 
  * Get rid of taint message by declaring code as GPL. 
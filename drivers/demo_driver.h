@@ -0,0 +1,99 @@
+/*
+ * What /dev/demo-x hands out and takes in, shared between demo_driver.c
+ * and the programs that use it.
+ *
+ * Besides the event queue, each device has one page with its current
+ * state that consumers can mmap() read-only (offset 0, one page) and
+ * sample without a syscall, like a vDSO data page. The kernel updates it
+ * under a seqcount; demo_page_snapshot() retries until it got a
+ * consistent copy.
+ *
+ * ioctl()s, all on an open file of the device:
+ *  DEMO_IOC_FETCH           copy up to `max` queued events in one call,
+ *                           after waiting until `min` are queued or
+ *                           `timeout_ms` passed (-1 waits forever)
+ *  DEMO_IOC_GET_COUNTERS    the device's counters, as on the page
+ *  DEMO_IOC_RESET_COUNTERS  zero them
+ *  DEMO_IOC_QUEUE           how full this file's queue is and how many
+ *                           events it had to drop
+ */
+
+#ifndef DEMO_DRIVER_H
+#define DEMO_DRIVER_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+// same as FP_MAX_PEDALS in footpedal_userspace/footpedal_shm.h
+#define DEMO_MAX_PEDALS 64
+
+// events each open file can have queued before new ones are dropped
+#define DEMO_QUEUE_LEN 256
+
+// one press or release. read() returns whole records only, write() takes
+// records too and ignores time_ns, the driver stamps them itself
+struct demo_event {
+    __u64 time_ns;  // CLOCK_MONOTONIC, ktime_get_ns()
+    __u32 pedal;
+    __u32 pressed;
+};
+
+// the page mmap() gives you
+struct demo_page {
+    __u32 seq;          // odd while the kernel is in the middle of an update
+    __u32 last_pedal;   // pedal of the last edge
+    __u64 pressed;      // bit n is set while pedal n is down
+    __u64 last_edge_ns; // when the last edge happened, CLOCK_MONOTONIC
+    __u64 events;       // events taken in, edges or not
+    __u64 edges;        // events that changed a pedal's state
+    __u64 dropped;      // events that didn't fit in some open file's queue
+    __u64 opens;
+};
+
+struct demo_fetch {
+    __u64 events;       // user pointer to room for `max` struct demo_event
+    __u32 max;
+    __u32 min;          // wait for this many, at most max and DEMO_QUEUE_LEN
+    __s32 timeout_ms;   // how long to wait for them, -1 forever, 0 not at all
+    __u32 count;        // out: events copied, can be fewer than min on timeout
+};
+
+struct demo_counters {
+    __u64 events;
+    __u64 edges;
+    __u64 dropped;
+    __u64 opens;
+};
+
+struct demo_queue {
+    __u32 len;          // events queued right now
+    __u32 size;         // DEMO_QUEUE_LEN
+    __u64 dropped;      // events this file lost to a full queue since it was opened
+};
+
+#define DEMO_IOC_MAGIC 'd'
+#define DEMO_IOC_FETCH          _IOWR(DEMO_IOC_MAGIC, 1, struct demo_fetch)
+#define DEMO_IOC_GET_COUNTERS   _IOR(DEMO_IOC_MAGIC, 2, struct demo_counters)
+#define DEMO_IOC_RESET_COUNTERS _IO(DEMO_IOC_MAGIC, 3)
+#define DEMO_IOC_QUEUE          _IOR(DEMO_IOC_MAGIC, 4, struct demo_queue)
+
+#ifdef __KERNEL__
+// queue an edge for every reader of /dev/demo-0, see demo_driver.c
+void demo_report_event(u32 pedal, bool pressed, u64 time_ns);
+#else
+#include <stdatomic.h>
+
+// torn-read-safe copy of the page
+static inline void demo_page_snapshot(const struct demo_page *pg, struct demo_page *out){
+    __u32 seq;
+    do {
+        while((seq = atomic_load_explicit((_Atomic __u32 *)&pg->seq, memory_order_acquire)) & 1)
+            ;
+        *out = *pg;
+        atomic_thread_fence(memory_order_acquire);
+    } while(atomic_load_explicit((_Atomic __u32 *)&pg->seq, memory_order_relaxed) != seq);
+    out->seq = seq;
+}
+#endif
+
+#endif
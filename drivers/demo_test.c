@@ -0,0 +1,492 @@
+/*
+ * Selftest for demo_driver: feeds synthetic events into /dev/demo-0 and
+ * checks what comes back out, then measures how long a reader blocked in
+ * read() takes to wake up after an event and how many events per second
+ * get through, what sampling the state page costs next to a read(), and
+ * how fast DEMO_IOC_FETCH drains a queue next to one read() per event.
+ *
+ * If hid_descriptor_remap is loaded too and /dev/uhid is there, it also
+ * presses a virtual QinHeng pedal and checks that the edges come out of
+ * the device, and how long they took.
+ * Prints TAP like the kernel selftests do. Needs the module
+ * loaded and access to the device node.
+ *
+ * usage: ./demo_test [device]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <linux/uhid.h>
+
+#include "demo_driver.h"
+
+#define WAKEUPS 2000
+#define THROUGHPUT_EVENTS 1000000
+#define SNAPSHOTS 1000000
+#define UHID_EDGES 200
+
+const char *path = "/dev/demo-0";
+int test_num = 0;
+int failed = 0;
+
+uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void result(bool ok, const char *name){
+    printf("%s %d - %s\n", ok ? "ok" : "not ok", ++test_num, name);
+    if(!ok)
+        failed++;
+}
+
+int cmp_u64(const void *a, const void *b){
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+bool send_event(int fd, int pedal, int pressed){
+    struct demo_event ev = { .pedal = pedal, .pressed = pressed };
+    return write(fd, &ev, sizeof(ev)) == sizeof(ev);
+}
+
+void test_empty(){
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    struct demo_event ev;
+    bool ok = fd >= 0 && read(fd, &ev, sizeof(ev)) < 0 && errno == EAGAIN;
+    result(ok, "read on an empty queue returns EAGAIN");
+    close(fd);
+}
+
+void test_roundtrip(){
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    struct demo_event ev;
+    uint64_t before = now_ns();
+    bool ok = fd >= 0 && send_event(fd, 3, 1) && read(fd, &ev, sizeof(ev)) == sizeof(ev);
+    ok = ok && ev.pedal == 3 && ev.pressed == 1 && ev.time_ns >= before && ev.time_ns <= now_ns();
+    result(ok, "event comes back with its pedal, state and a monotonic timestamp");
+    close(fd);
+}
+
+void test_short_read(){
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    char buf[sizeof(struct demo_event) - 1];
+    bool ok = fd >= 0 && send_event(fd, 0, 1) && read(fd, buf, sizeof(buf)) < 0 && errno == EINVAL;
+    result(ok, "read smaller than one event is EINVAL");
+    close(fd);
+}
+
+void test_cursors(){
+    int a = open(path, O_RDWR | O_NONBLOCK);
+    int b = open(path, O_RDWR | O_NONBLOCK);
+    struct demo_event ev[4];
+
+    bool ok = a >= 0 && b >= 0 && send_event(a, 1, 1) && send_event(a, 1, 0);
+    ok = ok && read(a, ev, sizeof(ev)) == 2 * sizeof(ev[0]);
+    ok = ok && read(b, ev, sizeof(ev)) == 2 * sizeof(ev[0]) && ev[0].pressed == 1 && ev[1].pressed == 0;
+    ok = ok && read(a, ev, sizeof(ev)) < 0 && errno == EAGAIN;
+    result(ok, "every open file has its own cursor");
+    close(a);
+    close(b);
+}
+
+void test_poll(){
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    struct demo_event ev;
+
+    bool ok = fd >= 0 && poll(&pfd, 1, 0) == 0;
+    ok = ok && send_event(fd, 2, 1) && poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+    ok = ok && read(fd, &ev, sizeof(ev)) == sizeof(ev) && poll(&pfd, 1, 0) == 0;
+    result(ok, "poll() is readable exactly while events are queued");
+    close(fd);
+}
+
+void test_overflow(){
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    struct demo_event ev[DEMO_QUEUE_LEN + 16];
+    memset(ev, 0, sizeof(ev));
+    // numbered in pressed, the driver restamps time_ns but passes that through
+    for(int i = 0; i < DEMO_QUEUE_LEN + 16; i++)
+        ev[i].pressed = i;
+
+    bool ok = fd >= 0 && write(fd, ev, sizeof(ev)) == sizeof(ev);
+    memset(ev, 0xff, sizeof(ev));
+    ok = ok && read(fd, ev, sizeof(ev)) == DEMO_QUEUE_LEN * sizeof(ev[0]);
+    ok = ok && ev[0].pressed == 0 && ev[DEMO_QUEUE_LEN - 1].pressed == DEMO_QUEUE_LEN - 1;
+    result(ok, "a full queue keeps the oldest events");
+    close(fd);
+}
+
+void test_bad_pedal(){
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    struct demo_event ev = { .pedal = DEMO_MAX_PEDALS };
+    bool ok = fd >= 0 && write(fd, &ev, sizeof(ev)) < 0 && errno == EINVAL;
+    result(ok, "events for pedals that can't exist are refused");
+    close(fd);
+}
+
+void test_page(){
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    struct demo_page *pg = mmap(NULL, getpagesize(), PROT_READ, MAP_SHARED, fd, 0);
+    struct demo_page before, after;
+    struct demo_event ev;
+
+    bool ok = fd >= 0 && pg != MAP_FAILED;
+    if(ok){
+        demo_page_snapshot(pg, &before);
+        bool was_down = before.pressed & (1ull << 5);
+        ok = send_event(fd, 5, !was_down) && read(fd, &ev, sizeof(ev)) == sizeof(ev);
+        demo_page_snapshot(pg, &after);
+        ok = ok && !(after.pressed & (1ull << 5)) == was_down && after.last_pedal == 5;
+        ok = ok && after.last_edge_ns == ev.time_ns && after.edges == before.edges + 1;
+        ok = ok && after.events == before.events + 1 && !(after.seq & 1);
+        munmap(pg, getpagesize());
+    }
+    result(ok, "mapped page follows every edge");
+    close(fd);
+}
+
+void test_page_readonly(){
+    int fd = open(path, O_RDWR);
+    void *pg = mmap(NULL, getpagesize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    bool ok = fd >= 0 && pg == MAP_FAILED;
+    if(pg != MAP_FAILED)
+        munmap(pg, getpagesize());
+    result(ok, "page can't be mapped writable");
+    close(fd);
+}
+
+// what it costs to look at the state: a snapshot of the mapped page, and
+// the cheapest read() there is, one that finds the queue empty
+void snapshot_cost(){
+    int fd = open(path, O_RDONLY | O_NONBLOCK);
+    struct demo_page *pg = mmap(NULL, getpagesize(), PROT_READ, MAP_SHARED, fd, 0);
+    struct demo_page snap;
+    struct demo_event ev;
+
+    bool ok = fd >= 0 && pg != MAP_FAILED;
+    if(ok){
+        uint64_t start = now_ns();
+        for(int i = 0; i < SNAPSHOTS; i++)
+            demo_page_snapshot(pg, &snap);
+        uint64_t t_mmap = now_ns() - start;
+
+        start = now_ns();
+        for(int i = 0; ok && i < SNAPSHOTS; i++)
+            ok = read(fd, &ev, sizeof(ev)) < 0 && errno == EAGAIN;
+        uint64_t t_read = now_ns() - start;
+
+        if(ok)
+            printf("# state via mmap: %.1f ns, via read(): %.1f ns\n", (double)t_mmap / SNAPSHOTS, (double)t_read / SNAPSHOTS);
+        munmap(pg, getpagesize());
+    }
+    result(ok, "snapshot cost");
+    close(fd);
+}
+
+int fetch(int fd, struct demo_event *ev, int max, int min, int timeout_ms){
+    struct demo_fetch f = {
+        .events = (uintptr_t)ev,
+        .max = max,
+        .min = min,
+        .timeout_ms = timeout_ms,
+    };
+    return ioctl(fd, DEMO_IOC_FETCH, &f) < 0 ? -1 : (int)f.count;
+}
+
+void test_fetch_timeout(){
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    struct demo_event ev[16];
+    memset(ev, 0, sizeof(ev));
+
+    bool ok = fd >= 0 && write(fd, ev, 3 * sizeof(ev[0])) == 3 * sizeof(ev[0]);
+    uint64_t start = now_ns();
+    ok = ok && fetch(fd, ev, 16, 8, 50) == 3 && now_ns() - start >= 40000000;
+    ok = ok && fetch(fd, ev, 16, 0, 0) == 0;
+    result(ok, "fetch returns what it has when the timeout runs out");
+    close(fd);
+}
+
+void *send_later(void *arg){
+    int fd = *(int *)arg;
+    struct demo_event ev[8];
+    memset(ev, 0, sizeof(ev));
+    usleep(20000);
+    for(int i = 0; i < 8; i++)
+        write(fd, &ev[i], sizeof(ev[i]));
+    return NULL;
+}
+
+void test_fetch_wait(){
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    struct demo_event ev[16];
+    pthread_t thread;
+
+    bool ok = fd >= 0 && pthread_create(&thread, NULL, send_later, &fd) == 0;
+    ok = ok && fetch(fd, ev, 16, 8, -1) == 8;
+    if(fd >= 0)
+        pthread_join(thread, NULL);
+    result(ok, "fetch waits for the minimum number of events");
+    close(fd);
+}
+
+void test_queue_info(){
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    struct demo_event ev[DEMO_QUEUE_LEN + 5];
+    struct demo_queue q;
+    memset(ev, 0, sizeof(ev));
+
+    bool ok = fd >= 0 && write(fd, ev, sizeof(ev)) == sizeof(ev) && ioctl(fd, DEMO_IOC_QUEUE, &q) == 0;
+    ok = ok && q.len == DEMO_QUEUE_LEN && q.size == DEMO_QUEUE_LEN && q.dropped == 5;
+    result(ok, "queue reports its fill level and overflows");
+    close(fd);
+}
+
+void test_counters(){
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    struct demo_event ev[4];
+    struct demo_counters cnt;
+    memset(ev, 0, sizeof(ev));
+
+    bool ok = fd >= 0 && ioctl(fd, DEMO_IOC_RESET_COUNTERS) == 0;
+    ok = ok && write(fd, ev, sizeof(ev)) == sizeof(ev) && ioctl(fd, DEMO_IOC_GET_COUNTERS, &cnt) == 0;
+    ok = ok && cnt.events == 4 && cnt.dropped == 0 && cnt.opens == 0;
+    result(ok, "counters count from the last reset");
+    close(fd);
+}
+
+// drain full queues with one read() per event and with one fetch each
+void drain_rate(bool use_ioctl){
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    static struct demo_event ev[DEMO_QUEUE_LEN];
+    memset(ev, 0, sizeof(ev));
+
+    uint64_t spent = 0;
+    long drained = 0;
+    bool ok = fd >= 0;
+    while(ok && drained < THROUGHPUT_EVENTS){
+        ok = write(fd, ev, sizeof(ev)) == sizeof(ev);
+        uint64_t start = now_ns();
+        if(use_ioctl){
+            ok = ok && fetch(fd, ev, DEMO_QUEUE_LEN, 0, 0) == DEMO_QUEUE_LEN;
+        }else{
+            for(int i = 0; ok && i < DEMO_QUEUE_LEN; i++)
+                ok = read(fd, &ev[i], sizeof(ev[i])) == sizeof(ev[i]);
+        }
+        spent += now_ns() - start;
+        drained += DEMO_QUEUE_LEN;
+    }
+
+    const char *name = use_ioctl ? "drain with DEMO_IOC_FETCH" : "drain with one read() per event";
+    if(ok)
+        printf("# %s: %.0f events/s\n", name, drained / (spent / 1e9));
+    result(ok, name);
+    close(fd);
+}
+
+// the keyboard part of pedal_rdesc_fixed, hid_descriptor_remap puts in
+// the rest. all it needs to see is report 1
+const unsigned char pedal_rdesc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x01, 0x05, 0x07, 0x19, 0xE0,
+    0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x08, 0x81, 0x01, 0x95, 0x06, 0x75, 0x08, 0x15, 0x00,
+    0x25, 0xFF, 0x05, 0x07, 0x19, 0x00, 0x29, 0xFF, 0x81, 0x00, 0xC0,
+};
+
+// wait for the kernel to start the uhid device, i.e. a driver bound to it
+bool uhid_wait_start(int ufd){
+    struct pollfd pfd = { .fd = ufd, .events = POLLIN };
+    struct uhid_event ev;
+    while(poll(&pfd, 1, 1000) == 1 && read(ufd, &ev, sizeof(ev)) > 0){
+        if(ev.type == UHID_START)
+            return true;
+    }
+    return false;
+}
+
+bool uhid_send(int ufd, bool pressed){
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_INPUT2;
+    ev.u.input2.size = 9;
+    ev.u.input2.data[0] = 1;
+    ev.u.input2.data[3] = pressed ? 5 : 0;
+    size_t len = offsetof(struct uhid_event, u.input2.data) + ev.u.input2.size;
+    return write(ufd, &ev, len) == (ssize_t)len;
+}
+
+void test_uhid_pedal(){
+    if(access("/sys/bus/hid/drivers/FootSwitch2", F_OK) != 0){
+        printf("ok %d # SKIP hid_descriptor_remap isn't loaded\n", ++test_num);
+        return;
+    }
+    int ufd = open("/dev/uhid", O_RDWR);
+    if(ufd < 0){
+        printf("ok %d # SKIP no /dev/uhid\n", ++test_num);
+        return;
+    }
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    snprintf((char *)ev.u.create2.name, sizeof(ev.u.create2.name), "demo_test FootSwitch");
+    memcpy(ev.u.create2.rd_data, pedal_rdesc, sizeof(pedal_rdesc));
+    ev.u.create2.rd_size = sizeof(pedal_rdesc);
+    ev.u.create2.bus = BUS_USB;
+    ev.u.create2.vendor = 0x1a86;
+    ev.u.create2.product = 0xe026;
+
+    bool ok = fd >= 0 && write(ufd, &ev, sizeof(ev)) == sizeof(ev) && uhid_wait_start(ufd);
+
+    static uint64_t latency[UHID_EDGES];
+    int pedal = -1;
+    for(int i = 0; ok && i < UHID_EDGES; i++){
+        struct demo_event got;
+        bool pressed = !(i & 1);
+        uint64_t sent = now_ns();
+        ok = uhid_send(ufd, pressed) && fetch(fd, &got, 1, 1, 1000) == 1;
+        ok = ok && got.pressed == pressed && (pedal < 0 || (int)got.pedal == pedal);
+        pedal = got.pedal;
+        latency[i] = got.time_ns - sent;
+    }
+
+    if(ok){
+        qsort(latency, UHID_EDGES, sizeof(uint64_t), cmp_u64);
+        printf("# uhid write to edge on %s: p50 %.1f us  p99 %.1f us\n",
+               path, latency[UHID_EDGES / 2] / 1e3, latency[UHID_EDGES * 99 / 100] / 1e3);
+    }
+    result(ok, "edges of a uhid pedal come out of the device");
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_DESTROY;
+    write(ufd, &ev, sizeof(ev));
+    close(ufd);
+    close(fd);
+}
+
+struct sleeper {
+    int fd;
+    uint64_t latency[WAKEUPS];
+    volatile int count;
+};
+
+void *sleeper_main(void *arg){
+    struct sleeper *s = arg;
+    struct demo_event ev;
+
+    while(s->count < WAKEUPS && read(s->fd, &ev, sizeof(ev)) == sizeof(ev))
+        s->latency[s->count++] = now_ns() - ev.time_ns;
+    return NULL;
+}
+
+// one thread asleep in a blocking read(), we send an event whenever it
+// has picked up the last one
+void test_wakeup_latency(){
+    static struct sleeper s;
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    s.fd = open(path, O_RDONLY);
+    s.count = 0;
+
+    pthread_t thread;
+    bool ok = fd >= 0 && s.fd >= 0 && pthread_create(&thread, NULL, sleeper_main, &s) == 0;
+    for(int i = 0; ok && i < WAKEUPS; i++){
+        // give it time to go back to sleep so we measure a real wakeup
+        while(s.count < i)
+            usleep(10);
+        usleep(50);
+        ok = send_event(fd, 0, i & 1);
+    }
+    if(ok)
+        pthread_join(thread, NULL);
+
+    ok = ok && s.count == WAKEUPS;
+    if(ok){
+        qsort(s.latency, s.count, sizeof(uint64_t), cmp_u64);
+        printf("# wakeup latency: p50 %.1f us  p99 %.1f us  max %.1f us\n",
+               s.latency[s.count / 2] / 1e3, s.latency[s.count * 99 / 100] / 1e3, s.latency[s.count - 1] / 1e3);
+    }
+    result(ok, "blocked reader wakes up for every event");
+    close(fd);
+    close(s.fd);
+}
+
+// write a queue's worth, read it back, as fast as we can, with one
+// event per syscall and with whole batches
+void throughput(int batch){
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    static struct demo_event ev[DEMO_QUEUE_LEN];
+    memset(ev, 0, sizeof(ev));
+
+    uint64_t start = now_ns();
+    long moved = 0;
+    bool ok = fd >= 0;
+    while(ok && moved < THROUGHPUT_EVENTS){
+        ok = write(fd, ev, batch * sizeof(ev[0])) == (ssize_t)(batch * sizeof(ev[0]));
+        ok = ok && read(fd, ev, batch * sizeof(ev[0])) == (ssize_t)(batch * sizeof(ev[0]));
+        moved += batch;
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    char name[64];
+    snprintf(name, sizeof(name), "throughput with %d event%s per syscall", batch, batch == 1 ? "" : "s");
+    if(ok)
+        printf("# %s: %.0f events/s\n", name, moved / (elapsed / 1e9));
+    result(ok, name);
+    close(fd);
+}
+
+int main(int argc, char **argv){
+    if(argc > 1)
+        path = argv[1];
+
+    printf("TAP version 13\n");
+
+    int fd = open(path, O_RDWR);
+    if(fd < 0){
+        printf("1..0 # SKIP could not open %s, is demo_driver loaded?\n", path);
+        return 4; // KSFT_SKIP
+    }
+    close(fd);
+
+    printf("1..20\n");
+
+    test_empty();
+    test_roundtrip();
+    test_short_read();
+    test_cursors();
+    test_poll();
+    test_overflow();
+    test_bad_pedal();
+    test_page();
+    test_page_readonly();
+    test_fetch_timeout();
+    test_fetch_wait();
+    test_queue_info();
+    test_counters();
+    test_uhid_pedal();
+    test_wakeup_latency();
+    throughput(1);
+    throughput(DEMO_QUEUE_LEN);
+    snapshot_cost();
+    drain_rate(false);
+    drain_rate(true);
+
+    return failed ? 1 : 0;
+}
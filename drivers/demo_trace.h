@@ -0,0 +1,112 @@
+/*
+ * Tracepoints for demo_driver, under events/demo/ in tracefs. They cost
+ * a static branch while disabled, so they stay in the hot paths:
+ *
+ *  echo 1 > /sys/kernel/tracing/events/demo/enable
+ *  perf record -e 'demo:*' ...
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM demo
+
+#if !defined(_DEMO_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _DEMO_TRACE_H
+
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(demo_file,
+    TP_PROTO(unsigned int minor),
+    TP_ARGS(minor),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+    ),
+    TP_printk("demo-%u", __entry->minor)
+);
+
+DEFINE_EVENT(demo_file, demo_open,
+    TP_PROTO(unsigned int minor),
+    TP_ARGS(minor)
+);
+
+DEFINE_EVENT(demo_file, demo_release,
+    TP_PROTO(unsigned int minor),
+    TP_ARGS(minor)
+);
+
+// read() and write(): what was asked for and what came of it
+DECLARE_EVENT_CLASS(demo_rw,
+    TP_PROTO(unsigned int minor, size_t count, ssize_t ret),
+    TP_ARGS(minor, count, ret),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(size_t, count)
+        __field(ssize_t, ret)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->count = count;
+        __entry->ret = ret;
+    ),
+    TP_printk("demo-%u count=%zu ret=%zd", __entry->minor, __entry->count, __entry->ret)
+);
+
+DEFINE_EVENT(demo_rw, demo_read,
+    TP_PROTO(unsigned int minor, size_t count, ssize_t ret),
+    TP_ARGS(minor, count, ret)
+);
+
+DEFINE_EVENT(demo_rw, demo_write,
+    TP_PROTO(unsigned int minor, size_t count, ssize_t ret),
+    TP_ARGS(minor, count, ret)
+);
+
+TRACE_EVENT(demo_ioctl,
+    TP_PROTO(unsigned int minor, unsigned int cmd, long ret),
+    TP_ARGS(minor, cmd, ret),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(unsigned int, cmd)
+        __field(long, ret)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->cmd = cmd;
+        __entry->ret = ret;
+    ),
+    TP_printk("demo-%u cmd=%#x ret=%ld", __entry->minor, __entry->cmd, __entry->ret)
+);
+
+// every event taken in, and how many open files had no room for it
+TRACE_EVENT(demo_event,
+    TP_PROTO(unsigned int minor, const struct demo_event *ev, unsigned int dropped),
+    TP_ARGS(minor, ev, dropped),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(u64, time_ns)
+        __field(u32, pedal)
+        __field(u32, pressed)
+        __field(unsigned int, dropped)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->time_ns = ev->time_ns;
+        __entry->pedal = ev->pedal;
+        __entry->pressed = ev->pressed;
+        __entry->dropped = dropped;
+    ),
+    TP_printk("demo-%u pedal=%u pressed=%u time=%llu dropped=%u", __entry->minor,
+              __entry->pedal, __entry->pressed, __entry->time_ns, __entry->dropped)
+);
+
+#endif
+
+// this file isn't in include/trace/events, tell define_trace.h where it is
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE demo_trace
+
+#include <trace/define_trace.h>
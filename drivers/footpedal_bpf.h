@@ -0,0 +1,62 @@
+/*
+ * Shared between FootSwitch_BPF.c and the tools that talk to it
+ * (pedal_ringbuf.c, pedal_keymap.c, pedal_gesture.c): the record the BPF
+ * program puts in its ring buffer for every press and release, the map
+ * that turns that on, and the maps it takes its key bindings and gestures
+ * from. Include <linux/types.h> (or vmlinux.h) first.
+ */
+
+#ifndef FOOTPEDAL_BPF_H
+#define FOOTPEDAL_BPF_H
+
+#define PEDAL_EDGES_MAP "pedal_edges"
+#define PEDAL_OPTS_MAP "pedal_opts"
+#define PEDAL_KEYMAP_MAP "pedal_keymap"
+#define PEDAL_GESTURES_MAP "pedal_gestures"
+
+// bytes of ring buffer, a power of two and a multiple of the page size
+#define PEDAL_EDGES_SIZE (64 * 1024)
+
+struct pedal_edge {
+    __u64 time_ns;  // bpf_ktime_get_ns() when the report came in, CLOCK_MONOTONIC
+    __u32 hid;      // hid_device id, the last part of /sys/bus/hid/devices/0003:1A86:E026.<id>
+    __u32 pressed;
+};
+
+// value 0 of PEDAL_OPTS_MAP
+struct pedal_opts {
+    __u32 export_edges; // how many consumers want a pedal_edge for every press and release
+};
+
+// PEDAL_KEYMAP_MAP is keyed by hid id (see pedal_edge), this key is the
+// binding for every pedal that doesn't have its own. hid ids start at 1
+#define PEDAL_KEYMAP_ANY 0
+#define PEDAL_KEYMAP_MAX 64
+
+// what a press sends: a chord of modifiers and up to 6 keys, the keyboard
+// report's own layout. Usages from the Keyboard/Keypad page, 0 is no key
+struct pedal_binding {
+    __u8 modifiers; // bit 0 left ctrl, 1 left shift, 2 left alt, 3 left gui, 4-7 the right ones
+    __u8 keys[6];
+    __u8 pad;
+};
+
+enum {
+    PEDAL_TAP,
+    PEDAL_DOUBLE_TAP,
+    PEDAL_LONG_PRESS,
+    PEDAL_GESTURE_COUNT,
+};
+
+// PEDAL_GESTURES_MAP, keyed like PEDAL_KEYMAP_MAP. A pedal with gestures
+// set up sends one of the three bindings depending on how it was pressed,
+// and ignores its pedal_keymap binding
+struct pedal_gestures {
+    __u32 long_press_ms;    // held at least this long is a long press
+    __u32 double_tap_ms;    // pressed again within this long of a tap is a double tap
+    __u32 repeat_ms;        // nonzero: send the long press again this often while held
+    __u32 pad;
+    struct pedal_binding binding[PEDAL_GESTURE_COUNT];
+};
+
+#endif
@@ -1,5 +1,25 @@
 /*
  * Modified from https://www.marcusfolkesson.se/blog/hid-report-descriptors/
+ *
+ * Besides fixing up the descriptor, this decodes the pedal's keyboard
+ * report in .raw_event and hands every press/release straight to
+ * demo_driver's event device (/dev/demo-0), so consumers get the edge
+ * without going through hidinput, hidraw or any parsing in userspace.
+ * Load demo_driver first. With suppress_keys=1 the pedal doesn't type
+ * anything anymore and is only seen through /dev/demo-0 (and hidraw).
+ *
+ * What the pedal types is configurable without rebuilding:
+ *  - usage_min (module parameter) is the Usage Minimum patched into each
+ *    pedal's copy of the descriptor when it's probed, i.e. how far all of
+ *    its keys get shifted. The default shifts 'b' to Keypad XOR.
+ *  - keymap (module parameter, and a keymap file in each pedal's sysfs
+ *    directory that can be changed while it runs) maps keyboard usages,
+ *    after that shift, to Linux keycodes: "0xc2:30,0xc3:48" makes the
+ *    pedal type 'a'. Each pedal gets a 256 entry table, so remapping a
+ *    key costs one lookup.
+ *  - other pedals can be added with new_id, e.g.
+ *    echo "3 1a86 e026 0" > /sys/bus/hid/drivers/FootSwitch2/new_id
+ *    where the last number picks the entry in pedal_models.
  * */
 
 #include <linux/module.h>
@@ -11,10 +31,82 @@
 #include <linux/fs.h>
 #include <linux/input.h>
 #include <linux/hid.h>
+#include <linux/idr.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/string.h>
 
 #include <asm/irq.h>
 #include <asm/io.h>
 
+#include "demo_driver.h"
+
+static bool suppress_keys;
+module_param(suppress_keys, bool, 0444);
+MODULE_PARM_DESC(suppress_keys, "Don't create a keyboard for the pedal, only deliver its edges to /dev/demo-0");
+
+static int usage_min = 0xC2 - 0x05;
+module_param(usage_min, int, 0644);
+MODULE_PARM_DESC(usage_min, "Usage Minimum of the pedal's keys, applied when a pedal is probed");
+
+static char *keymap = "";
+module_param(keymap, charp, 0644);
+MODULE_PARM_DESC(keymap, "usage:keycode pairs every pedal starts with, e.g. 0xc2:30,0xc3:48");
+
+// hands out the pedal numbers that go into struct demo_event
+static DEFINE_IDA(pedal_ida);
+
+/*
+ * What we need to know about each kind of pedal. The driver_data of an
+ * entry in pedal_devices (or one added through new_id) is its index here.
+ *
+ * The PCsensor and QinHeng pedals give us 2 separate USB endpoints. One of
+ * those (the one with report descriptor size of 23) is just bogus so ignore it
+ *
+ * we can tell because we get the following output from /var/log/messages:
+ * Aug  7 11:54:10 kge kernel: Report descriptor size 23
+ * Aug  7 11:54:10 kge mtp-probe[201656]: checking bus 3, device 35: "/sys/devices/pci0000:00/0000:00:14.0/usb3/3-7"
+ * Aug  7 11:54:10 kge mtp-probe[201656]: bus: 3, device: 35 was not an MTP device
+ * Aug  7 11:54:10 kge /usr/libexec/gdm-x-session[3310]: (**) PCsensor FootSwitch: Applying InputClass "system-keyboard"
+ * Aug  7 11:54:10 kge /usr/libexec/gdm-x-session[3310]: (II) No input driver specified, ignoring this device.
+ * Aug  7 11:54:10 kge /usr/libexec/gdm-x-session[3310]: (II) This device may have been added with another device file.
+ *
+ * This "other device file" is the other driver with a much longer report descriptor
+ * The reason it's so long is because this pedal can simulate all sorts of different things, including
+ * mouse movements, meta keys, etc.
+ */
+struct pedal_model {
+    const char *name;
+    unsigned int bogus_rsize;   // descriptor size of the interface to ignore, 0 for none
+    u8 press_key;               // usage in report 1's first key slot while the pedal is down
+};
+
+static const struct pedal_model pedal_models[] = {
+    { "FootSwitch", 23, 0x05 }, // PCsensor and QinHeng, both send 'b'
+};
+
+// linux keycode for every keyboard usage, 0 leaves the usage alone
+struct pedal_keymap {
+    u16 code[256];
+};
+
+struct pedal_data {
+    const struct pedal_model *model;
+    int pedal;
+    bool pressed;
+
+    u8 *rdesc;          // pedal_rdesc_fixed with this pedal's usage_min
+
+    // read under RCU in the event path, replaced whole under keymap_lock
+    struct pedal_keymap __rcu *keymap;
+    struct mutex keymap_lock;
+    struct input_dev *input;
+    // keys hidinput gave the input device itself, before any keymap's
+    unsigned long hid_keybit[BITS_TO_LONGS(KEY_CNT)];
+};
+
 //parsed using https://eleccelerator.com/usbdescreqparser/ 
 static __u8 pedal_rdesc_fixed[] = {
     0x05, 0x01,        // Usage Page (Generic Desktop Ctrls)
@@ -47,6 +139,7 @@ static __u8 pedal_rdesc_fixed[] = {
     0x25, 0xFF,        //   Logical Maximum (-1)
     0x05, 0x07,        //   Usage Page (Kbrd/Keypad)
     // this is where the standard keys are mapped
+    // (each pedal's copy gets usage_min here, see pedal_patch_rdesc)
     // if we shift the usage minimum by some amount X, 
     // the kernel will interpret scancodes as being 
     // shifted up by X
@@ -110,57 +203,328 @@ static __u8 pedal_rdesc_fixed[] = {
     // 162 bytes
 };
 
+// copy pedal_rdesc_fixed with the keys' Usage Minimum (the one followed by
+// Usage Maximum 0xFF) set to usage_min
+static u8 *pedal_patch_rdesc(struct hid_device *hdev)
+{
+    u8 *rdesc;
+    size_t i;
+
+    if (usage_min < 0 || usage_min > 0xFF)
+        return NULL;
+
+    rdesc = devm_kmemdup(&hdev->dev, pedal_rdesc_fixed, sizeof(pedal_rdesc_fixed), GFP_KERNEL);
+    if (!rdesc)
+        return NULL;
+
+    for (i = 0; i + 3 < sizeof(pedal_rdesc_fixed); i++) {
+        if (rdesc[i] == 0x19 && rdesc[i + 2] == 0x29 && rdesc[i + 3] == 0xFF) {
+            rdesc[i + 1] = usage_min;
+            return rdesc;
+        }
+    }
+    return NULL;
+}
+
+// "usage:keycode" pairs separated by commas or spaces
+static int pedal_parse_keymap(const char *str, struct pedal_keymap *km)
+{
+    char *buf, *p, *tok;
+    int ret = 0;
+
+    buf = kstrdup(str ? str : "", GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+
+    p = strim(buf);
+    while ((tok = strsep(&p, ", \n")) != NULL) {
+        int usage, code;
+
+        if (!*tok)
+            continue;
+        if (sscanf(tok, "%i:%i", &usage, &code) != 2 || usage < 0 || usage > 0xFF ||
+            code < 0 || code > KEY_MAX) {
+            ret = -EINVAL;
+            break;
+        }
+        km->code[usage] = code;
+    }
+
+    kfree(buf);
+    return ret;
+}
+
+// let the input device send every key the keymap can produce
+static void pedal_set_keybits(struct pedal_data *pd, const struct pedal_keymap *km)
+{
+    int i;
+
+    if (!pd->input)
+        return;
+    for (i = 0; i < 256; i++) {
+        if (km->code[i])
+            __set_bit(km->code[i], pd->input->keybit);
+    }
+}
+
+/*
+ * The old map is out of the event path: let go of whatever keys it has
+ * down, while the input device still has them, then stop advertising the
+ * ones neither hidinput nor the new map produce.
+ */
+static void pedal_clear_keybits(struct pedal_data *pd, const struct pedal_keymap *old,
+                const struct pedal_keymap *km)
+{
+    DECLARE_BITMAP(keep, KEY_CNT);
+    bool released = false;
+    int i;
+
+    if (!pd->input)
+        return;
+
+    bitmap_copy(keep, pd->hid_keybit, KEY_CNT);
+    for (i = 0; i < 256; i++) {
+        if (km->code[i])
+            __set_bit(km->code[i], keep);
+    }
+
+    for (i = 0; i < 256; i++) {
+        u16 code = old->code[i];
+
+        // the same key for the same usage carries on as it is
+        if (!code || km->code[i] == code || !test_bit(code, pd->input->key))
+            continue;
+        input_report_key(pd->input, code, 0);
+        released = true;
+    }
+    if (released)
+        input_sync(pd->input);
+
+    for (i = 0; i < 256; i++) {
+        if (old->code[i] && !test_bit(old->code[i], keep))
+            __clear_bit(old->code[i], pd->input->keybit);
+    }
+}
+
+static ssize_t keymap_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct pedal_data *pd = hid_get_drvdata(to_hid_device(dev));
+    struct pedal_keymap *km;
+    ssize_t len = 0;
+    int i;
+
+    rcu_read_lock();
+    km = rcu_dereference(pd->keymap);
+    for (i = 0; i < 256; i++) {
+        if (km->code[i])
+            len += sysfs_emit_at(buf, len, "%s0x%02x:%u", len ? "," : "", i, km->code[i]);
+    }
+    rcu_read_unlock();
+
+    len += sysfs_emit_at(buf, len, "\n");
+    return len;
+}
+
+// build the new table off to the side and swap it in, so the event path
+// sees either the old map or the new one, never half of each. once no
+// event can be using the old one, the keys it had down are released and
+// its keys are dropped from the input device
+static ssize_t keymap_store(struct device *dev, struct device_attribute *attr,
+                const char *buf, size_t count)
+{
+    struct pedal_data *pd = hid_get_drvdata(to_hid_device(dev));
+    struct pedal_keymap *km, *old;
+    int ret;
+
+    km = kzalloc(sizeof(*km), GFP_KERNEL);
+    if (!km)
+        return -ENOMEM;
+
+    ret = pedal_parse_keymap(buf, km);
+    if (ret) {
+        kfree(km);
+        return ret;
+    }
+
+    mutex_lock(&pd->keymap_lock);
+    pedal_set_keybits(pd, km);
+    old = rcu_dereference_protected(pd->keymap, lockdep_is_held(&pd->keymap_lock));
+    rcu_assign_pointer(pd->keymap, km);
+    synchronize_rcu();
+    pedal_clear_keybits(pd, old, km);
+    mutex_unlock(&pd->keymap_lock);
+
+    kfree(old);
+    return count;
+}
+static DEVICE_ATTR_RW(keymap);
+
 static __u8 *pedal_report_fixup(struct hid_device *hdev, __u8 *rdesc,
                 unsigned int *rsize)
 {
-    printk(KERN_INFO "Changing driver\n");
-    hid_info(hdev, "Editing FootSwitch report descriptor\n");
+    struct pedal_data *pd = hid_get_drvdata(hdev);
+
+    hid_info(hdev, "Editing %s report descriptor\n", pd->model->name);
     *rsize = sizeof(pedal_rdesc_fixed);
-    return pedal_rdesc_fixed;
+    return pd->rdesc;
+}
+
+static int pedal_input_configured(struct hid_device *hdev, struct hid_input *hi)
+{
+    struct pedal_data *pd = hid_get_drvdata(hdev);
+
+    mutex_lock(&pd->keymap_lock);
+    pd->input = hi->input;
+    bitmap_copy(pd->hid_keybit, hi->input->keybit, KEY_CNT);
+    pedal_set_keybits(pd, rcu_dereference_protected(pd->keymap, lockdep_is_held(&pd->keymap_lock)));
+    mutex_unlock(&pd->keymap_lock);
+    return 0;
+}
+
+// hidinput hands us every key before mapping it itself. if the keymap
+// has the usage, we send our key and hidinput doesn't do anything
+static int pedal_event(struct hid_device *hdev, struct hid_field *field,
+                struct hid_usage *usage, __s32 value)
+{
+    struct pedal_data *pd = hid_get_drvdata(hdev);
+    struct pedal_keymap *km;
+    u16 code = 0;
+
+    if ((usage->hid & HID_USAGE_PAGE) != HID_UP_KEYBOARD || !field->hidinput)
+        return 0;
+
+    rcu_read_lock();
+    km = rcu_dereference(pd->keymap);
+    if (km)
+        code = km->code[usage->hid & 0xFF];
+    rcu_read_unlock();
+
+    if (!code)
+        return 0;
+
+    input_event(field->hidinput->input, EV_KEY, code, value);
+    return 1;
+}
+
+/*
+ * Report 1 is the keyboard report: report ID, modifiers, a reserved byte
+ * and then the keys. While the pedal is down it sends its model's
+ * press_key in the first key slot ('b' (5) for the ones we know, same as
+ * what footpedal_userspace/reader.c looks for).
+ * This runs from the URB completion, so the time we stamp is as close to
+ * the report arriving as we can get.
+ */
+static int pedal_raw_event(struct hid_device *hdev, struct hid_report *report,
+                u8 *data, int size)
+{
+    struct pedal_data *pd = hid_get_drvdata(hdev);
+    bool pressed;
+
+    if (!pd || report->id != 1 || size < 4)
+        return 0;
+
+    pressed = data[3] == pd->model->press_key;
+    if (pressed != pd->pressed) {
+        pd->pressed = pressed;
+        demo_report_event(pd->pedal, pressed, ktime_get_ns());
+    }
+
+    // carry on to hidinput and hidraw as usual
+    return 0;
 }
 
 static int pedal_probe(struct hid_device *hdev, const struct hid_device_id *id)
 {
+    const struct pedal_model *model;
+    struct pedal_keymap *km;
+    struct pedal_data *pd;
     int ret;
 
+    if (id->driver_data >= ARRAY_SIZE(pedal_models))
+        return -EINVAL;
+    model = &pedal_models[id->driver_data];
+
     printk(KERN_INFO "Report descriptor size %d\n", hdev->dev_rsize);
-    /*
-     * The device gives us 2 separate USB endpoints.
-     * One of those (the one with report descriptor size of 23) is just bogus so ignore it
-     * 
-     * we can tell because we get the following output from /var/log/messages:
-     * Aug  7 11:54:10 kge kernel: Report descriptor size 23
-     * Aug  7 11:54:10 kge mtp-probe[201656]: checking bus 3, device 35: "/sys/devices/pci0000:00/0000:00:14.0/usb3/3-7"
-     * Aug  7 11:54:10 kge mtp-probe[201656]: bus: 3, device: 35 was not an MTP device
-     * Aug  7 11:54:10 kge /usr/libexec/gdm-x-session[3310]: (**) PCsensor FootSwitch: Applying InputClass "system-keyboard"
-     * Aug  7 11:54:10 kge /usr/libexec/gdm-x-session[3310]: (II) No input driver specified, ignoring this device.
-     * Aug  7 11:54:10 kge /usr/libexec/gdm-x-session[3310]: (II) This device may have been added with another device file.
-     * 
-     * This "other device file" is the other driver with a much longer report descriptor
-     * The reason it's so long is because this pedal can simulate all sorts of different things, including
-     * mouse movements, meta keys, etc. 
-     */
-    if (hdev->dev_rsize == 23)
+    if (model->bogus_rsize && hdev->dev_rsize == model->bogus_rsize)
         return -ENODEV;
 
+    pd = devm_kzalloc(&hdev->dev, sizeof(*pd), GFP_KERNEL);
+    if (!pd)
+        return -ENOMEM;
+    pd->model = model;
+    mutex_init(&pd->keymap_lock);
+
+    // everything the event path looks at is worked out once, here
+    pd->rdesc = pedal_patch_rdesc(hdev);
+    if (!pd->rdesc) {
+        hid_err(hdev, "bad usage_min %d\n", usage_min);
+        return -EINVAL;
+    }
+
+    km = kzalloc(sizeof(*km), GFP_KERNEL);
+    if (!km)
+        return -ENOMEM;
+    ret = pedal_parse_keymap(keymap, km);
+    if (ret) {
+        hid_err(hdev, "bad keymap \"%s\"\n", keymap);
+        kfree(km);
+        return ret;
+    }
+    RCU_INIT_POINTER(pd->keymap, km);
+
+    pd->pedal = ida_alloc_max(&pedal_ida, DEMO_MAX_PEDALS - 1, GFP_KERNEL);
+    if (pd->pedal < 0) {
+        kfree(km);
+        return pd->pedal;
+    }
+    hid_set_drvdata(hdev, pd);
+
     ret = hid_parse(hdev);
     if (ret) {
         hid_err(hdev, "parse failed\n");
-        return ret;
+        goto err;
     }
 
-    ret = hid_hw_start(hdev, HID_CONNECT_DEFAULT);
+    ret = hid_hw_start(hdev, suppress_keys ? HID_CONNECT_DEFAULT & ~HID_CONNECT_HIDINPUT : HID_CONNECT_DEFAULT);
     if (ret) {
         hid_err(hdev, "hw start failed\n");
-        return ret;
+        goto err;
     }
 
+    ret = device_create_file(&hdev->dev, &dev_attr_keymap);
+    if (ret) {
+        hid_hw_stop(hdev);
+        goto err;
+    }
+
+    hid_info(hdev, "pedal %d on /dev/demo-0\n", pd->pedal);
     return 0;
+
+err:
+    ida_free(&pedal_ida, pd->pedal);
+    kfree(km);
+    return ret;
+}
+
+static void pedal_remove(struct hid_device *hdev)
+{
+    struct pedal_data *pd = hid_get_drvdata(hdev);
+
+    device_remove_file(&hdev->dev, &dev_attr_keymap);
+    hid_hw_stop(hdev);
+
+    // a pedal unplugged while down shouldn't stay down for consumers
+    if (pd->pressed)
+        demo_report_event(pd->pedal, false, ktime_get_ns());
+    ida_free(&pedal_ida, pd->pedal);
+
+    // no more events can see it once the device is stopped
+    kfree(rcu_dereference_protected(pd->keymap, 1));
 }
 
 static const struct hid_device_id pedal_devices[] = {
-    { HID_USB_DEVICE(0x3553, 0xb001) }, // vendor and product ID for PCSensor FootSwitch
-    { HID_USB_DEVICE(0x1a86, 0xe026) }, // vendor and product ID for QinHeng FootSwitch
+    { HID_USB_DEVICE(0x3553, 0xb001), .driver_data = 0 }, // vendor and product ID for PCSensor FootSwitch
+    { HID_USB_DEVICE(0x1a86, 0xe026), .driver_data = 0 }, // vendor and product ID for QinHeng FootSwitch
     {} // terminate with a null entry
 };
 MODULE_DEVICE_TABLE(hid, pedal_devices);
@@ -170,6 +534,10 @@ static struct hid_driver pedal_driver = {
     .id_table = pedal_devices,
     .report_fixup = pedal_report_fixup,
     .probe = pedal_probe,
+    .remove = pedal_remove,
+    .raw_event = pedal_raw_event,
+    .event = pedal_event,
+    .input_configured = pedal_input_configured,
 };
 module_hid_driver(pedal_driver);
 
@@ -0,0 +1,324 @@
+/*
+ * Sets up FootSwitch_BPF's gestures: what a tap, a double tap and a long
+ * press send, and how long each takes. Like pedal_keymap, it only writes
+ * the program's pedal_gestures map, the program stays attached. Needs
+ * CAP_BPF (or root).
+ *
+ * usage: ./pedal_gesture                                  list gesture setups
+ *        ./pedal_gesture [-p hid] [-l ms] [-w ms] [-r ms] tap double long
+ *                                                         set up gestures, for one
+ *                                                         pedal or all of them
+ *        ./pedal_gesture [-p hid] -d                      back to pedal_keymap
+ *        ./pedal_gesture -t                               replay test, see below
+ *
+ *  -l  held this long is a long press (default 400)
+ *  -w  a second press this soon after a tap is a double tap (default 250)
+ *  -r  while a long press is held, send it again this often (default off)
+ *
+ * A binding is modifiers:key,key... in the numbers pedal_keymap takes, so
+ * 0x1:0x6 is Ctrl+C and 0:0x3a is F1. Use 0:0 for a gesture you don't
+ * want; without a double tap binding taps go out without waiting.
+ *
+ * Every pedal has its own copy of the program and with it its own maps,
+ * so gestures go into all of them.
+ *
+ * The replay test plays fixed press and release timings on a uhid pedal
+ * and checks which gestures come out on hidraw. The timings stay well
+ * clear of the thresholds, so it's deterministic on any machine that gets
+ * reports through within a few tens of milliseconds.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <linux/uhid.h>
+
+#include "footpedal_bpf.h"
+#include "bpf_util.h"
+
+#define LONG_PRESS_MS 400
+#define DOUBLE_TAP_MS 250
+
+const char *gesture_names[PEDAL_GESTURE_COUNT] = { "tap", "double tap", "long press" };
+
+int parse_binding(const char *s, struct pedal_binding *b){
+    char *end;
+    memset(b, 0, sizeof(*b));
+    b->modifiers = strtoul(s, &end, 0);
+    if(*end != ':')
+        return -1;
+    for(int i = 0; i < 6 && *end != '\0'; i++){
+        b->keys[i] = strtoul(end + 1, &end, 0);
+        if(*end != ',' && *end != '\0')
+            return -1;
+    }
+    return *end == '\0' ? 0 : -1;
+}
+
+void print_gestures(__u32 hid, const struct pedal_gestures *g){
+    if(hid == PEDAL_KEYMAP_ANY)
+        printf("all pedals:");
+    else
+        printf("hid %x:", hid);
+    printf(" long press %u ms, double tap %u ms, repeat ", g->long_press_ms, g->double_tap_ms);
+    if(g->repeat_ms)
+        printf("%u ms\n", g->repeat_ms);
+    else
+        printf("off\n");
+
+    for(int k = 0; k < PEDAL_GESTURE_COUNT; k++){
+        const struct pedal_binding *b = &g->binding[k];
+        printf("  %-10s %#04x:", gesture_names[k], b->modifiers);
+        for(int i = 0; i < 6 && (i == 0 || b->keys[i] != 0); i++)
+            printf("%s%#04x", i ? "," : "", b->keys[i]);
+        printf("\n");
+    }
+}
+
+int update_all(int *fds, int n, __u32 hid, const struct pedal_gestures *g){
+    for(int i = 0; i < n; i++)
+        if(map_update(fds[i], &hid, g) < 0)
+            return -1;
+    return 0;
+}
+
+// fine if some maps never had it, not if none did
+int delete_all(int *fds, int n, __u32 hid){
+    int deleted = 0;
+    for(int i = 0; i < n; i++)
+        if(map_delete(fds[i], &hid) == 0)
+            deleted++;
+    return deleted > 0 ? 0 : -1;
+}
+
+int list(int *fds, int nmaps){
+    __u32 key, next;
+    struct pedal_gestures g;
+    int n = 0;
+
+    for(int i = 0; i < nmaps; i++){
+        if(nmaps > 1)
+            printf("pedal program %d:\n", i + 1);
+        for(int ret = map_next_key(fds[i], NULL, &next); ret == 0; ret = map_next_key(fds[i], &key, &next)){
+            key = next;
+            if(map_lookup(fds[i], &key, &g) == 0){
+                print_gestures(key, &g);
+                n++;
+            }
+        }
+    }
+    if(n == 0)
+        printf("no gestures, pedals send their pedal_keymap binding\n");
+    return 0;
+}
+
+/*
+ * The replay test. Each step waits `ms` after the previous one, then
+ * presses or releases the pedal. `expect` is the gestures that should
+ * come out, one letter each: t tap, d double tap, l long press.
+ */
+#define TEST_LONG_MS 300
+#define TEST_DOUBLE_MS 200
+#define TEST_REPEAT_MS 100
+
+struct step {
+    int ms;
+    bool pressed;
+};
+
+struct sequence {
+    const char *name;
+    bool repeat;
+    const char *expect;
+    int nsteps;
+    struct step steps[8];
+};
+
+const struct sequence sequences[] = {
+    { "tap", false, "t", 2, { { 0, true }, { 50, false } } },
+    { "double tap", false, "d", 4, { { 0, true }, { 50, false }, { 50, true }, { 50, false } } },
+    { "long press", false, "l", 2, { { 0, true }, { 500, false } } },
+    { "two slow taps", false, "tt", 4, { { 0, true }, { 50, false }, { 400, true }, { 50, false } } },
+    { "tap, then long press", false, "tl", 4, { { 0, true }, { 50, false }, { 400, true }, { 500, false } } },
+    { "double tap, held", false, "d", 4, { { 0, true }, { 50, false }, { 50, true }, { 500, false } } },
+    { "long press, repeating", true, "lll", 2, { { 0, true }, { 550, false } } },
+};
+
+// one letter per key press that came out, from key usage to gesture
+void collect(int hfd, char *out, size_t size){
+    unsigned char report[64];
+    unsigned char last = 0;
+    size_t n = 0;
+    ssize_t len;
+
+    while((len = read(hfd, report, sizeof(report))) > 0){
+        if(len < 9 || report[0] != 1)
+            continue;
+        if(report[3] != 0 && last == 0 && n + 1 < size)
+            out[n++] = report[3] == 0x04 ? 't' : report[3] == 0x05 ? 'd' : report[3] == 0x06 ? 'l' : '?';
+        last = report[3];
+    }
+    out[n] = '\0';
+}
+
+int test(){
+    char uniq[64];
+    snprintf(uniq, sizeof(uniq), "pedal_gesture-%d", getpid());
+
+    int ufd = uhid_create(uniq);
+    if(ufd < 0){
+        perror("Error: could not create uhid device (are you root, is the uhid module loaded?)");
+        return 1;
+    }
+
+    // udev-hid-bpf attaches the program (and with it creates the maps)
+    // a little while after the device shows up. Other pedals' programs
+    // have their own maps, so wait for ours to join them
+    __u32 hid;
+    int fds[MAX_MAPS];
+    int before = find_maps(PEDAL_GESTURES_MAP, fds, NULL, MAX_MAPS), n = 0;
+    close_maps(fds, before);
+
+    int hfd = -1;
+    for(int i = 0; i < 500 && (hfd < 0 || n <= before); i++){
+        usleep(10000);
+        if(hfd < 0)
+            hfd = open_hidraw(uniq, &hid);
+        close_maps(fds, n);
+        n = find_maps(PEDAL_GESTURES_MAP, fds, NULL, MAX_MAPS);
+    }
+    if(hfd < 0 || n <= before){
+        printf("Error: no hidraw node or no %s map, is FootSwitch_BPF attached to uhid pedals?\n", PEDAL_GESTURES_MAP);
+        return 1;
+    }
+
+    int nseq = sizeof(sequences) / sizeof(sequences[0]), failed = 0;
+    printf("1..%d\n", nseq);
+
+    for(int i = 0; i < nseq; i++){
+        const struct sequence *seq = &sequences[i];
+        struct pedal_gestures g = {
+            .long_press_ms = TEST_LONG_MS,
+            .double_tap_ms = TEST_DOUBLE_MS,
+            .repeat_ms = seq->repeat ? TEST_REPEAT_MS : 0,
+            .binding = { { .keys = { 0x04 } }, { .keys = { 0x05 } }, { .keys = { 0x06 } } },
+        };
+        if(update_all(fds, n, hid, &g) < 0){
+            perror("Error: could not set up gestures");
+            failed = nseq;
+            break;
+        }
+
+        char got[32];
+        collect(hfd, got, sizeof(got));
+
+        // absolute deadlines, so the steps don't drift
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        for(int k = 0; k < seq->nsteps; k++){
+            t.tv_nsec += seq->steps[k].ms * 1000000l;
+            t.tv_sec += t.tv_nsec / 1000000000l;
+            t.tv_nsec %= 1000000000l;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+            uhid_send(ufd, seq->steps[k].pressed);
+        }
+
+        // long enough for any pending tap to go out
+        usleep(2 * TEST_LONG_MS * 1000);
+        collect(hfd, got, sizeof(got));
+
+        bool ok = strcmp(got, seq->expect) == 0;
+        printf("%s %d - %s\n", ok ? "ok" : "not ok", i + 1, seq->name);
+        if(!ok){
+            printf("# expected \"%s\", got \"%s\"\n", seq->expect, got);
+            failed++;
+        }
+    }
+
+    delete_all(fds, n, hid);
+    close_maps(fds, n);
+    struct uhid_event destroy = { .type = UHID_DESTROY };
+    write(ufd, &destroy, sizeof(destroy));
+    close(ufd);
+    close(hfd);
+    return failed ? 1 : 0;
+}
+
+void usage(const char *name){
+    fprintf(stderr, "usage: %s [-p hid] [-l ms] [-w ms] [-r ms] [-d | tap double long]\n"
+                    "       %s -t\n", name, name);
+}
+
+int main(int argc, char **argv){
+    __u32 hid = PEDAL_KEYMAP_ANY;
+    struct pedal_gestures g = { .long_press_ms = LONG_PRESS_MS, .double_tap_ms = DOUBLE_TAP_MS };
+    bool del = false;
+    int opt;
+
+    while((opt = getopt(argc, argv, "p:l:w:r:dt")) != -1){
+        switch(opt){
+        case 'p':
+            hid = strtoul(optarg, NULL, 16);
+            break;
+        case 'l':
+            g.long_press_ms = atoi(optarg);
+            break;
+        case 'w':
+            g.double_tap_ms = atoi(optarg);
+            break;
+        case 'r':
+            g.repeat_ms = atoi(optarg);
+            break;
+        case 'd':
+            del = true;
+            break;
+        case 't':
+            return test();
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    int nargs = argc - optind;
+    if(del ? nargs != 0 : nargs != 0 && nargs != PEDAL_GESTURE_COUNT){
+        usage(argv[0]);
+        return 1;
+    }
+    for(int k = 0; k < nargs; k++){
+        if(parse_binding(argv[optind + k], &g.binding[k]) < 0){
+            fprintf(stderr, "Error: bad %s binding \"%s\", want modifiers:key,key...\n", gesture_names[k], argv[optind + k]);
+            return 1;
+        }
+    }
+
+    int fds[MAX_MAPS];
+    int n = find_maps(PEDAL_GESTURES_MAP, fds, NULL, MAX_MAPS);
+    if(n == 0){
+        printf("Error: no %s map, is FootSwitch_BPF attached to a pedal? (needs root or CAP_BPF)\n", PEDAL_GESTURES_MAP);
+        return 1;
+    }
+
+    int ret = 0;
+    if(del){
+        if(delete_all(fds, n, hid) < 0){
+            perror("Error: could not remove gestures");
+            ret = 1;
+        }
+    }else if(nargs == 0){
+        ret = list(fds, n);
+    }else if(update_all(fds, n, hid, &g) < 0){
+        perror("Error: could not set up gestures");
+        ret = 1;
+    }else{
+        print_gestures(hid, &g);
+    }
+    close_maps(fds, n);
+    return ret;
+}
@@ -0,0 +1,277 @@
+/*
+ * Changes what FootSwitch_BPF makes a pedal send, while it's attached:
+ * writes a struct pedal_binding into the program's pedal_keymap map, and
+ * the next press uses it. No recompiling, no reloading, no lost reports.
+ * Needs CAP_BPF (or root).
+ *
+ * usage: ./pedal_keymap                             list bindings
+ *        ./pedal_keymap [-p hid] modifiers key...   bind a chord, for one pedal
+ *                                                   or (without -p) all of them
+ *        ./pedal_keymap [-p hid] -d                 remove a binding
+ *        ./pedal_keymap -t [n]                      test: rebind two uhid pedals
+ *                                                   n times in turn and check
+ *                                                   every rebind shows up in
+ *                                                   the very next report
+ *
+ * Every pedal has its own copy of the program and with it its own maps,
+ * so bindings go into all of them.
+ *
+ * hid is the number after the last dot in /sys/bus/hid/devices/, in hex.
+ * modifiers and keys are numbers (0x.. for hex), keys are usages from the
+ * Keyboard/Keypad page: ./pedal_keymap 0x1 0x6 is Ctrl+C.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <linux/uhid.h>
+
+#include "footpedal_bpf.h"
+#include "bpf_util.h"
+
+#define TEST_REBINDS 1000
+
+// every pedal_keymap map, one per pedal the program is attached to
+int open_keymaps(int *fds){
+    int n = find_maps(PEDAL_KEYMAP_MAP, fds, NULL, MAX_MAPS);
+    if(n == 0)
+        printf("Error: no %s map, is FootSwitch_BPF attached to a pedal? (needs root or CAP_BPF)\n", PEDAL_KEYMAP_MAP);
+    return n;
+}
+
+int update_all(int *fds, int n, __u32 hid, const struct pedal_binding *b){
+    for(int i = 0; i < n; i++)
+        if(map_update(fds[i], &hid, b) < 0)
+            return -1;
+    return 0;
+}
+
+// fine if some maps never had it, not if none did
+int delete_all(int *fds, int n, __u32 hid){
+    int deleted = 0;
+    for(int i = 0; i < n; i++)
+        if(map_delete(fds[i], &hid) == 0)
+            deleted++;
+    return deleted > 0 ? 0 : -1;
+}
+
+void print_binding(__u32 hid, const struct pedal_binding *b){
+    if(hid == PEDAL_KEYMAP_ANY)
+        printf("all pedals:");
+    else
+        printf("hid %x:", hid);
+    printf(" modifiers %#04x keys", b->modifiers);
+    for(int i = 0; i < 6 && b->keys[i] != 0; i++)
+        printf(" %#04x", b->keys[i]);
+    printf("\n");
+}
+
+int list(int *fds, int nmaps){
+    __u32 key, next;
+    struct pedal_binding b;
+    int n = 0;
+
+    for(int i = 0; i < nmaps; i++){
+        if(nmaps > 1)
+            printf("pedal program %d:\n", i + 1);
+        for(int ret = map_next_key(fds[i], NULL, &next); ret == 0; ret = map_next_key(fds[i], &key, &next)){
+            key = next;
+            if(map_lookup(fds[i], &key, &b) == 0){
+                print_binding(key, &b);
+                n++;
+            }
+        }
+    }
+    if(n == 0)
+        printf("no bindings, every pedal sends Ctrl+C\n");
+    return 0;
+}
+
+// wait for the next report on hidraw, 0 if none came within a second
+int next_report(int hfd, unsigned char *report, size_t size){
+    struct pollfd p = { .fd = hfd, .events = POLLIN };
+    if(poll(&p, 1, 1000) <= 0)
+        return 0;
+    ssize_t n = read(hfd, report, size);
+    return n > 0 ? n : 0;
+}
+
+struct test_pedal {
+    char uniq[64];
+    int ufd, hfd;
+    __u32 hid;
+};
+
+// press the pedal, 0 if its report has this binding. Releases it again after
+int check_press(struct test_pedal *p, const struct pedal_binding *b){
+    unsigned char report[64];
+
+    while(read(p->hfd, report, sizeof(report)) > 0)
+        ;
+    uhid_send(p->ufd, true);
+    int n = next_report(p->hfd, report, sizeof(report));
+    int ret = n < 9 ? -1 : report[1] != b->modifiers || memcmp(&report[3], b->keys, sizeof(b->keys)) != 0 ? 1 : 0;
+    uhid_send(p->ufd, false);
+    next_report(p->hfd, report, sizeof(report));
+    return ret;
+}
+
+/*
+ * Two pedals, because each gets its own copy of the program: a binding
+ * that only lands in one copy's map shows up as the other pedal's rebinds
+ * not taking effect.
+ */
+int test(int rebinds){
+    struct test_pedal pedals[2];
+    int fds[MAX_MAPS];
+    int before = find_maps(PEDAL_KEYMAP_MAP, fds, NULL, MAX_MAPS);
+    close_maps(fds, before);
+
+    for(int k = 0; k < 2; k++){
+        struct test_pedal *p = &pedals[k];
+        snprintf(p->uniq, sizeof(p->uniq), "pedal_keymap-%d-%d", getpid(), k);
+        p->ufd = uhid_create(p->uniq);
+        p->hfd = -1;
+        if(p->ufd < 0){
+            perror("Error: could not create uhid device (are you root, is the uhid module loaded?)");
+            return 1;
+        }
+    }
+
+    // udev-hid-bpf attaches the program (and with it creates the maps)
+    // a little while after each device shows up
+    int n = 0;
+    for(int i = 0; i < 500 && (pedals[0].hfd < 0 || pedals[1].hfd < 0 || n < before + 2); i++){
+        usleep(10000);
+        for(int k = 0; k < 2; k++)
+            if(pedals[k].hfd < 0)
+                pedals[k].hfd = open_hidraw(pedals[k].uniq, &pedals[k].hid);
+        close_maps(fds, n);
+        n = find_maps(PEDAL_KEYMAP_MAP, fds, NULL, MAX_MAPS);
+    }
+    if(pedals[0].hfd < 0 || pedals[1].hfd < 0 || n < before + 2){
+        printf("Error: no hidraw nodes or not a %s map per pedal, is FootSwitch_BPF attached to uhid pedals?\n", PEDAL_KEYMAP_MAP);
+        return 1;
+    }
+
+    int late = 0, missing = 0, done = 0;
+    uint64_t worst = 0;
+
+    for(int i = 0; i < rebinds; i++){
+        // a different chord every time, so a stale binding can't pass,
+        // on each pedal in turn
+        struct test_pedal *p = &pedals[i % 2];
+        struct pedal_binding b = { .modifiers = i & 0xff, .keys = { 4 + i % 26, 0x1e + i % 10 } };
+        uint64_t start = now_ns();
+        if(update_all(fds, n, p->hid, &b) < 0){
+            perror("Error: could not update binding");
+            break;
+        }
+
+        int ret = check_press(p, &b);
+        uint64_t took = now_ns() - start;
+        if(ret < 0)
+            missing++;
+        else if(ret > 0)
+            late++;
+        else if(took > worst)
+            worst = took;
+        done++;
+    }
+
+    // and one binding for all pedals reaches both
+    struct pedal_binding any = { .modifiers = 0x2, .keys = { 0x3a } };
+    int any_failed = 0;
+    for(int k = 0; k < 2; k++)
+        delete_all(fds, n, pedals[k].hid);
+    if(update_all(fds, n, PEDAL_KEYMAP_ANY, &any) < 0)
+        perror("Error: could not update binding");
+    for(int k = 0; k < 2; k++)
+        if(check_press(&pedals[k], &any) != 0)
+            any_failed++;
+
+    printf("%d rebinds over 2 pedals: %d took effect on the next report, %d didn't, %d reports never came\n",
+           done, done - late - missing, late, missing);
+    printf("slowest rebind to report: %.1f us\n", worst / 1e3);
+    printf("binding for all pedals: %d of 2 pedals sent it\n", 2 - any_failed);
+
+    delete_all(fds, n, PEDAL_KEYMAP_ANY);
+    close_maps(fds, n);
+    for(int k = 0; k < 2; k++){
+        struct uhid_event destroy = { .type = UHID_DESTROY };
+        write(pedals[k].ufd, &destroy, sizeof(destroy));
+        close(pedals[k].ufd);
+        close(pedals[k].hfd);
+    }
+    return done == rebinds && late == 0 && missing == 0 && any_failed == 0 ? 0 : 1;
+}
+
+void usage(const char *name){
+    fprintf(stderr, "usage: %s [-p hid] [-d | modifiers key...]\n"
+                    "       %s -t [rebinds]\n", name, name);
+}
+
+int main(int argc, char **argv){
+    __u32 hid = PEDAL_KEYMAP_ANY;
+    bool del = false, run_test = false;
+    int opt;
+
+    while((opt = getopt(argc, argv, "p:dt")) != -1){
+        switch(opt){
+        case 'p':
+            hid = strtoul(optarg, NULL, 16);
+            break;
+        case 'd':
+            del = true;
+            break;
+        case 't':
+            run_test = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(run_test)
+        return test(optind < argc ? atoi(argv[optind]) : TEST_REBINDS);
+
+    int nargs = argc - optind;
+    if((del && nargs > 0) || nargs > 7){
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fds[MAX_MAPS];
+    int n = open_keymaps(fds);
+    if(n == 0)
+        return 1;
+
+    int ret = 0;
+    if(del){
+        if(delete_all(fds, n, hid) < 0){
+            perror("Error: could not remove binding");
+            ret = 1;
+        }
+    }else if(nargs == 0){
+        ret = list(fds, n);
+    }else{
+        struct pedal_binding b = { .modifiers = strtoul(argv[optind], NULL, 0) };
+        for(int i = 1; i < nargs; i++)
+            b.keys[i - 1] = strtoul(argv[optind + i], NULL, 0);
+        if(update_all(fds, n, hid, &b) < 0){
+            perror("Error: could not update binding");
+            ret = 1;
+        }else{
+            print_binding(hid, &b);
+        }
+    }
+    close_maps(fds, n);
+    return ret;
+}
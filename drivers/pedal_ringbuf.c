@@ -0,0 +1,347 @@
+/*
+ * Reads pedal edges out of FootSwitch_BPF's ring buffer: finds the
+ * program's maps, switches export_edges on and maps the ring buffer, so
+ * every edge is a plain memory read after an epoll wakeup. No hidraw, no
+ * report parsing. Needs CAP_BPF (or root) and the program attached to a
+ * pedal, e.g. by udev-hid-bpf. Every pedal has its own copy of the
+ * program with its own maps, so it does that for each of them.
+ *
+ * usage: ./pedal_ringbuf          print edges as they come
+ *        ./pedal_ringbuf -b [n]   benchmark: press and release a uhid pedal
+ *                                 n times and compare how long each edge
+ *                                 takes to reach us through the ring buffer
+ *                                 and through hidraw
+ *        ./pedal_ringbuf -R       set export_edges back to 0 everywhere,
+ *                                 after a consumer was killed
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <linux/uhid.h>
+
+#include "footpedal_bpf.h"
+#include "bpf_util.h"
+
+#define BENCH_EDGES 1000
+
+struct ringbuf {
+    int fd;
+    size_t size;
+    unsigned long *consumer_pos;    // ours, read-write
+    unsigned long *producer_pos;    // the kernel's, read-only
+    unsigned char *data;            // mapped twice in a row, so records never wrap
+};
+
+volatile sig_atomic_t running = 1;
+
+// pedal_opts of every program we switched export on in, mapped
+struct pedal_opts *exports[MAX_MAPS];
+int nexports;
+
+/*
+ * export_edges counts the consumers, so when we go away it only goes
+ * off if nobody else is still reading. Needs pedal_opts to be mmapable,
+ * for an atomic add instead of a lookup and update racing another one.
+ *
+ * The count lives in the map, not in anything the kernel cleans up for
+ * us, so a consumer that dies without export_stop() (SIGKILL, a crash)
+ * leaves it one too high and the program keeps exporting to nobody.
+ * -R resets it; run it once nothing is reading.
+ */
+int export_start(){
+    int fds[MAX_MAPS];
+    int n = find_maps(PEDAL_OPTS_MAP, fds, NULL, MAX_MAPS);
+    long page = sysconf(_SC_PAGESIZE);
+
+    for(int i = 0; i < n; i++){
+        struct pedal_opts *opts = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED, fds[i], 0);
+        close(fds[i]);
+        if(opts == MAP_FAILED)
+            continue;
+        __atomic_fetch_add(&opts->export_edges, 1, __ATOMIC_SEQ_CST);
+        exports[nexports++] = opts;
+    }
+    return nexports > 0 ? 0 : -1;
+}
+
+// -R: no consumers left, whatever the count says. the number of programs
+// it was reset in, -1 if there are none
+int export_reset(){
+    int fds[MAX_MAPS];
+    int n = find_maps(PEDAL_OPTS_MAP, fds, NULL, MAX_MAPS);
+    long page = sysconf(_SC_PAGESIZE);
+    int reset = 0;
+
+    for(int i = 0; i < n; i++){
+        struct pedal_opts *opts = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED, fds[i], 0);
+        close(fds[i]);
+        if(opts == MAP_FAILED)
+            continue;
+        unsigned was = __atomic_exchange_n(&opts->export_edges, 0, __ATOMIC_SEQ_CST);
+        printf("%s %d: export_edges %u -> 0\n", PEDAL_OPTS_MAP, i, was);
+        munmap(opts, page);
+        reset++;
+    }
+    return reset > 0 ? reset : -1;
+}
+
+void export_stop(){
+    long page = sysconf(_SC_PAGESIZE);
+    for(int i = 0; i < nexports; i++){
+        __atomic_fetch_sub(&exports[i]->export_edges, 1, __ATOMIC_SEQ_CST);
+        munmap(exports[i], page);
+    }
+    nexports = 0;
+}
+
+int ringbuf_map(struct ringbuf *rb, int fd, size_t size){
+    long page = sysconf(_SC_PAGESIZE);
+    rb->fd = fd;
+    rb->size = size;
+    rb->consumer_pos = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED, rb->fd, 0);
+    void *prod = mmap(NULL, page + 2 * rb->size, PROT_READ, MAP_SHARED, rb->fd, page);
+    if(rb->consumer_pos == MAP_FAILED || prod == MAP_FAILED){
+        close(rb->fd);
+        return -1;
+    }
+    rb->producer_pos = prod;
+    rb->data = (unsigned char *)prod + page;
+    return 0;
+}
+
+// every pedal's ring buffer, returns how many
+int ringbufs_open(struct ringbuf *rbs){
+    int fds[MAX_MAPS];
+    struct bpf_map_info info[MAX_MAPS];
+    int n = find_maps(PEDAL_EDGES_MAP, fds, info, MAX_MAPS), m = 0;
+
+    for(int i = 0; i < n; i++)
+        if(ringbuf_map(&rbs[m], fds[i], info[i].max_entries) == 0)
+            m++;
+    return m;
+}
+
+// hand every committed record to fn, then tell the kernel we're done with them
+int ringbuf_consume(struct ringbuf *rb, void (*fn)(const struct pedal_edge *e, void *arg), void *arg){
+    unsigned long cons = *rb->consumer_pos;
+    unsigned long prod = __atomic_load_n(rb->producer_pos, __ATOMIC_ACQUIRE);
+    int n = 0;
+
+    while(cons < prod){
+        __u32 *hdr = (__u32 *)(rb->data + (cons & (rb->size - 1)));
+        __u32 len = __atomic_load_n(hdr, __ATOMIC_ACQUIRE);
+        if(len & BPF_RINGBUF_BUSY_BIT)
+            break;
+
+        __u32 size = len & ~(BPF_RINGBUF_BUSY_BIT | BPF_RINGBUF_DISCARD_BIT);
+        if(!(len & BPF_RINGBUF_DISCARD_BIT) && size >= sizeof(struct pedal_edge)){
+            fn((const struct pedal_edge *)(hdr + BPF_RINGBUF_HDR_SZ / sizeof(*hdr)), arg);
+            n++;
+        }
+
+        cons += (size + BPF_RINGBUF_HDR_SZ + 7) & ~7ul;
+        __atomic_store_n(rb->consumer_pos, cons, __ATOMIC_RELEASE);
+    }
+    return n;
+}
+
+void print_edge(const struct pedal_edge *e, void *arg){
+    printf("hid %u: %s, %.1f us ago\n", e->hid, e->pressed ? "pressed" : "released", (now_ns() - e->time_ns) / 1e3);
+}
+
+void stop(int sig){
+    running = 0;
+}
+
+int watch(struct ringbuf *rbs, int n){
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    for(int i = 0; i < n; i++){
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &rbs[i] };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, rbs[i].fd, &ev);
+    }
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    while(running){
+        struct epoll_event events[MAX_MAPS];
+        int ready = epoll_wait(epfd, events, MAX_MAPS, -1);
+        if(ready < 0 && errno != EINTR)
+            break;
+        for(int i = 0; i < ready; i++)
+            ringbuf_consume(events[i].data.ptr, print_edge, NULL);
+        fflush(stdout);
+    }
+    close(epfd);
+    return 0;
+}
+
+struct bench {
+    __u32 hid;
+    bool pressed;       // what we're waiting for
+    uint64_t got_ns;    // when the ring buffer had it, 0 until then
+    uint64_t stamp_ns;  // the BPF program's timestamp
+};
+
+void bench_edge(const struct pedal_edge *e, void *arg){
+    struct bench *b = arg;
+    if(e->hid == b->hid && e->pressed == b->pressed && b->got_ns == 0){
+        b->got_ns = now_ns();
+        b->stamp_ns = e->time_ns;
+    }
+}
+
+int cmp_u64(const void *a, const void *b){
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+void print_latency(const char *name, uint64_t *lat, int n){
+    qsort(lat, n, sizeof(uint64_t), cmp_u64);
+    printf("%-22s p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", name,
+           lat[n / 2] / 1e3, lat[n * 99 / 100] / 1e3, lat[n - 1] / 1e3);
+}
+
+int bench(int edges){
+    char uniq[64];
+    snprintf(uniq, sizeof(uniq), "pedal_ringbuf-%d", getpid());
+
+    int ufd = uhid_create(uniq);
+    if(ufd < 0){
+        perror("Error: could not create uhid device (are you root, is the uhid module loaded?)");
+        return 1;
+    }
+
+    // udev-hid-bpf attaches the program (and with it creates the maps)
+    // a little while after the device shows up. Our pedal's edges only
+    // go into its own program's ring buffer
+    struct ringbuf rbs[MAX_MAPS];
+    struct bench b = { 0 };
+    int fds[MAX_MAPS];
+    int before = find_maps(PEDAL_EDGES_MAP, fds, NULL, MAX_MAPS), n = before;
+    close_maps(fds, before);
+
+    int hfd = -1;
+    for(int i = 0; i < 500 && (hfd < 0 || n <= before); i++){
+        usleep(10000);
+        if(hfd < 0)
+            hfd = open_hidraw(uniq, &b.hid);
+        n = find_maps(PEDAL_EDGES_MAP, fds, NULL, MAX_MAPS);
+        close_maps(fds, n);
+    }
+    n = hfd >= 0 && n > before ? ringbufs_open(rbs) : 0;
+    if(n == 0 || export_start() < 0){
+        printf("Error: no hidraw node or no %s map, is FootSwitch_BPF attached to uhid pedals?\n", PEDAL_EDGES_MAP);
+        return 1;
+    }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, hfd, &ev);
+    for(int i = 0; i < n; i++){
+        ev.data.ptr = &rbs[i];
+        epoll_ctl(epfd, EPOLL_CTL_ADD, rbs[i].fd, &ev);
+    }
+
+    uint64_t *ring = calloc(edges, sizeof(uint64_t));
+    uint64_t *raw = calloc(edges, sizeof(uint64_t));
+    uint64_t *stamp = calloc(edges, sizeof(uint64_t));
+    int done = 0;
+
+    // start from released so the first press is an edge
+    uhid_send(ufd, false);
+    usleep(10000);
+    for(int i = 0; i < n; i++)
+        ringbuf_consume(&rbs[i], bench_edge, &b);
+
+    for(int i = 0; i < edges && running; i++){
+        unsigned char report[64];
+        uint64_t raw_ns = 0;
+
+        b.pressed = i % 2 == 0;
+        b.got_ns = 0;
+        while(read(hfd, report, sizeof(report)) > 0)
+            ;
+
+        uint64_t sent = now_ns();
+        uhid_send(ufd, b.pressed);
+
+        // wait for the edge to come out both ways
+        while((b.got_ns == 0 || raw_ns == 0) && now_ns() - sent < 1000000000ull){
+            struct epoll_event events[MAX_MAPS + 1];
+            int ready = epoll_wait(epfd, events, MAX_MAPS + 1, 100);
+            for(int k = 0; k < ready; k++){
+                if(events[k].data.ptr == NULL){
+                    if(read(hfd, report, sizeof(report)) > 0 && raw_ns == 0)
+                        raw_ns = now_ns();
+                }else{
+                    ringbuf_consume(events[k].data.ptr, bench_edge, &b);
+                }
+            }
+        }
+        if(b.got_ns == 0 || raw_ns == 0)
+            break;
+
+        ring[done] = b.got_ns - sent;
+        raw[done] = raw_ns - sent;
+        stamp[done] = b.stamp_ns - sent;
+        done++;
+        usleep(1000);
+    }
+
+    printf("%d of %d edges\n", done, edges);
+    if(done > 0){
+        print_latency("report to BPF stamp", stamp, done);
+        print_latency("report to ring buffer", ring, done);
+        print_latency("report to hidraw", raw, done);
+    }
+
+    export_stop();
+    struct uhid_event destroy = { .type = UHID_DESTROY };
+    write(ufd, &destroy, sizeof(destroy));
+    close(ufd);
+    close(hfd);
+    close(epfd);
+    return done == edges ? 0 : 1;
+}
+
+int main(int argc, char **argv){
+    if(argc > 1 && strcmp(argv[1], "-b") == 0){
+        signal(SIGINT, stop);
+        return bench(argc > 2 ? atoi(argv[2]) : BENCH_EDGES);
+    }
+    if(argc > 1 && strcmp(argv[1], "-R") == 0){
+        if(export_reset() < 0){
+            printf("Error: no %s map, is FootSwitch_BPF attached to a pedal? (needs root or CAP_BPF)\n", PEDAL_OPTS_MAP);
+            return 1;
+        }
+        return 0;
+    }
+    if(argc > 1){
+        fprintf(stderr, "usage: %s [-b [edges] | -R]\n", argv[0]);
+        return 1;
+    }
+
+    struct ringbuf rbs[MAX_MAPS];
+    int n = ringbufs_open(rbs);
+    if(n == 0 || export_start() < 0){
+        printf("Error: no %s map, is FootSwitch_BPF attached to a pedal? (needs root or CAP_BPF)\n", PEDAL_EDGES_MAP);
+        return 1;
+    }
+    int ret = watch(rbs, n);
+    export_stop();
+    return ret;
+}
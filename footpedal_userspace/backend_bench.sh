@@ -0,0 +1,40 @@
+#!/bin/bash
+# Runs the epoll and the io_uring reader (make reader_epoll reader_uring)
+# against virtual pedals at high report rates, and compares syscalls per
+# report, the reader's CPU time and vpedal's report-to-edge latency.
+# Needs root and the uhid module.
+
+READER_LOG=/tmp/footpedal-backend-reader.log
+. "$(dirname "$0")/bench_lib.sh"
+
+TCK=$(getconf CLK_TCK)
+SUMMARY=""
+
+# user + system time of a process, in ms
+cpu_ms() {
+  awk -v tck=$TCK '{ print ($14 + $15) * 1000 / tck }' /proc/$1/stat
+}
+
+run() {
+  READER_BIN=$1
+  shift
+  echo "== $READER_BIN, vpedal $*"
+  start_reader
+  CPU_BEFORE=$(cpu_ms $READER)
+  ./vpedal "$@" | tee /tmp/footpedal-backend-vpedal.log
+  CPU=$(awk -v a=$(cpu_ms $READER) -v b=$CPU_BEFORE 'BEGIN { print a - b }')
+  stop_reader
+
+  SYSCALLS=$(grep -o '([0-9.]* per report)' $READER_LOG | tr -d '(' | cut -d' ' -f1)
+  LATENCY=$(grep '^latency' /tmp/footpedal-backend-vpedal.log | sed 's/^latency *//')
+  SUMMARY+=$(printf '%-13s %-26s %8s %10s   %s' $READER_BIN "$*" "$SYSCALLS" "$CPU" "$LATENCY")$'\n'
+  echo
+}
+
+for args in "-n 1 -c 20000 -r 0" "-n 1 -c 5000 -r 5000 -b 32" "-n 8 -c 5000 -r 2000" "-n 64 -c 1000 -r 1000"; do
+  run reader_epoll $args
+  run reader_uring $args
+done
+
+printf '%-13s %-26s %8s %10s   %s\n' reader vpedal sys/rep "cpu ms" "report to edge"
+printf '%s' "$SUMMARY"
@@ -0,0 +1,25 @@
+#!/bin/bash
+# Runs the reader against virtual pedals (see vpedal.c) at a few rates,
+# burst sizes and device counts. Needs root and the uhid module.
+
+. "$(dirname "$0")/bench_lib.sh"
+
+start_reader
+
+run() {
+  echo "== vpedal $*"
+  ./vpedal "$@"
+  echo
+}
+
+run -n 1 -c 2000 -r 1000
+run -n 1 -c 20000 -r 0
+run -n 1 -c 2000 -r 1000 -b 32
+run -n 1 -c 2000 -r 1000 -b 128
+run -n 8 -c 2000 -r 1000
+run -n 32 -c 1000 -r 1000
+run -n 64 -c 1000 -r 1000
+
+echo "== reader"
+./fpstat
+stop_reader
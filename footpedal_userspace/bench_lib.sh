@@ -0,0 +1,32 @@
+# What the bench scripts share, sourced by each of them: run from this
+# directory, with the uhid module loaded, and start and stop the reader
+# around every run. Needs root.
+
+cd "$(dirname "${BASH_SOURCE[0]}")"
+
+# load a module unless its device node is already there
+need_module() {
+  if [ ! -e "/dev/$1" ]; then
+    modprobe "$1" 2>/dev/null
+  fi
+}
+
+need_module uhid
+
+# where the reader's output goes, and which build to run
+READER_LOG=${READER_LOG:-/tmp/footpedal-bench-reader.log}
+READER_BIN=${READER_BIN:-reader}
+
+# start_reader [args]: run the reader in the background and give it time
+# to find the pedals it's going to get
+start_reader() {
+  ./$READER_BIN "$@" > "$READER_LOG" 2>&1 &
+  READER=$!
+  sleep 0.5
+}
+
+# stop it the way Ctrl+C would, so it prints its stats to READER_LOG
+stop_reader() {
+  kill -INT $READER
+  wait $READER
+}
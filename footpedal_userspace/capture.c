@@ -0,0 +1,117 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "capture.h"
+
+// reports are a few bytes each, so buffer plenty of them per write()
+#define WRITE_BUFFER (64 * 1024)
+// how far behind the replay cursor we let pages pile up before dropping them
+#define RELEASE_CHUNK (1024 * 1024)
+
+int fp_cap_create(struct fp_cap_writer *w, const char *path){
+    w->f = fopen(path, "ae");
+    if(w->f == NULL)
+        return -1;
+    setvbuf(w->f, NULL, _IOFBF, WRITE_BUFFER);
+    w->dirty = false;
+
+    // appending to an existing capture just continues it
+    if(ftell(w->f) == 0){
+        struct fp_cap_header hdr = { .magic = FP_CAP_MAGIC, .version = FP_CAP_VERSION };
+        fwrite(&hdr, sizeof(hdr), 1, w->f);
+        w->dirty = true;
+    }
+    return 0;
+}
+
+void fp_cap_write(struct fp_cap_writer *w, uint64_t time_ns, int type, int pedal, const void *data, size_t len){
+    struct fp_cap_record rec = {
+        .time_ns = time_ns,
+        .type = type,
+        .pedal = pedal,
+        .len = len,
+    };
+    fwrite(&rec, sizeof(rec), 1, w->f);
+    fwrite(data, len, 1, w->f);
+    w->dirty = true;
+}
+
+void fp_cap_flush(struct fp_cap_writer *w){
+    fflush(w->f);
+    w->dirty = false;
+}
+
+void fp_cap_close(struct fp_cap_writer *w){
+    if(w->f != NULL)
+        fclose(w->f);
+    w->f = NULL;
+}
+
+int fp_cap_open(struct fp_cap_reader *r, const char *path){
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return -1;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0){
+        close(fd);
+        return -1;
+    }
+    if((size_t)st.st_size < sizeof(struct fp_cap_header)){
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED)
+        return -1;
+
+    const struct fp_cap_header *hdr = base;
+    if(memcmp(hdr->magic, FP_CAP_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != FP_CAP_VERSION){
+        munmap(base, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+    r->base = base;
+    r->size = st.st_size;
+    r->pos = sizeof(struct fp_cap_header);
+    r->released = 0;
+    return 0;
+}
+
+bool fp_cap_peek(struct fp_cap_reader *r, struct fp_cap_record *rec){
+    if(r->pos + sizeof(*rec) > r->size)
+        return false;
+    memcpy(rec, r->base + r->pos, sizeof(*rec));
+    // a capture cut off in the middle of a record just ends early
+    return r->pos + sizeof(*rec) + rec->len <= r->size;
+}
+
+bool fp_cap_next(struct fp_cap_reader *r, struct fp_cap_record *rec, const unsigned char **payload){
+    if(!fp_cap_peek(r, rec))
+        return false;
+
+    *payload = r->base + r->pos + sizeof(*rec);
+    r->pos += sizeof(*rec) + rec->len;
+
+    if(r->pos - r->released >= 2 * RELEASE_CHUNK){
+        madvise((void *)(r->base + r->released), RELEASE_CHUNK, MADV_DONTNEED);
+        r->released += RELEASE_CHUNK;
+    }
+    return true;
+}
+
+void fp_cap_close_reader(struct fp_cap_reader *r){
+    if(r->base != NULL)
+        munmap((void *)r->base, r->size);
+    r->base = NULL;
+}
@@ -0,0 +1,70 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+/*
+ * Capture files: an append-only log of every raw report the reader got,
+ * so we can see what a pedal actually sent and replay it later.
+ *
+ * A capture is a header followed by records. Each record is a 12 byte
+ * header and `len` bytes of payload: the raw report for FP_CAP_REPORT, or
+ * the pedal's identity (serial or USB path) for FP_CAP_PEDAL, which is
+ * written whenever a pedal attaches so replay can give it the same slot,
+ * followed by its report descriptor as FP_CAP_RDESC so replay decodes
+ * its reports the same way.
+ * All integers are little endian, which is all this runs on.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FP_CAP_MAGIC "FPCAP\r\n"
+#define FP_CAP_VERSION 1
+
+enum fp_cap_type {
+    FP_CAP_REPORT = 1,
+    FP_CAP_PEDAL = 2,
+    FP_CAP_RDESC = 3,
+};
+
+struct fp_cap_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct fp_cap_record {
+    uint64_t time_ns;   // CLOCK_MONOTONIC
+    uint8_t type;       // enum fp_cap_type
+    uint8_t pedal;      // slot of the pedal
+    uint16_t len;       // payload bytes that follow
+} __attribute__((packed));
+
+struct fp_cap_writer {
+    FILE *f;
+    bool dirty;         // records that haven't been flushed yet
+};
+
+int fp_cap_create(struct fp_cap_writer *w, const char *path);
+void fp_cap_write(struct fp_cap_writer *w, uint64_t time_ns, int type, int pedal, const void *data, size_t len);
+void fp_cap_flush(struct fp_cap_writer *w);
+void fp_cap_close(struct fp_cap_writer *w);
+
+// replay maps the file and walks it front to back, handing pages it's done
+// with back to the kernel, so a capture never has to fit in memory
+struct fp_cap_reader {
+    const unsigned char *base;
+    size_t size;
+    size_t pos;
+    size_t released;    // everything before this has been dropped from memory
+};
+
+int fp_cap_open(struct fp_cap_reader *r, const char *path);
+// the next record and a pointer to its payload, false at the end of the file
+bool fp_cap_next(struct fp_cap_reader *r, struct fp_cap_record *rec, const unsigned char **payload);
+// look at the next record without consuming it
+bool fp_cap_peek(struct fp_cap_reader *r, struct fp_cap_record *rec);
+void fp_cap_close_reader(struct fp_cap_reader *r);
+
+#endif
@@ -0,0 +1,39 @@
+#!/bin/bash
+# Runs the reader against a virtual pedal with no control traffic, then
+# with fpctl sending it commands as fast as anyone reasonably would (stats
+# dumps at 1000/s, pedal listings at 1000/s, rescans at 100/s), and prints
+# vpedal's report-to-edge latency and the reader's own wakeup-to-published
+# latency for each, next to how long the commands took to answer. The
+# worst report-to-edge latency of each run comes last, as that's what a
+# command holding up a report shows up in. Needs root and the uhid module.
+
+READER_LOG=/tmp/footpedal-ctl-reader.log
+VPEDAL_OUT=/tmp/footpedal-ctl-vpedal.out
+MAX=""
+. "$(dirname "$0")/bench_lib.sh"
+
+run() {
+  echo "== control traffic: ${*:-none}"
+  start_reader
+  if [ $# -gt 0 ]; then
+    ./fpctl -t 6 "$@" &
+    CTL=$!
+  fi
+  ./vpedal -n 1 -c 5000 -r 1000 | grep -E '^(published|latency)' | tee "$VPEDAL_OUT"
+  MAX="$MAX$(printf '%-20s' "${*:-none}")$(awk '/^latency/ { for(i = 1; i < NF; i++) if($i == "max") print $(i + 1), $(i + 2) }' "$VPEDAL_OUT")
+"
+  if [ $# -gt 0 ]; then
+    wait $CTL
+  fi
+  ./fpstat | grep -E '^(reports|control|total)'
+  stop_reader
+  echo
+}
+
+run
+run -r 1000 stats
+run -r 1000 pedals
+run -r 100 rescan
+
+echo "== max report-to-edge latency, by control traffic"
+printf '%s' "$MAX"
@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "debounce.h"
+
+void fp_debounce_init(struct fp_debounce *d, uint32_t state){
+    memset(d, 0, sizeof(*d));
+    d->raw = state;
+    d->stable = state;
+}
+
+// how long a change from `from` to `to` has to settle
+static uint64_t window(const struct fp_debounce_config *c, uint32_t from, uint32_t to){
+    return (to & ~from) ? c->press_ns : c->release_ns;
+}
+
+bool fp_debounce_report(struct fp_debounce *d, const struct fp_debounce_config *c, uint32_t buttons, uint64_t t, uint32_t *out){
+    if(buttons == d->raw)
+        return false;
+
+    uint32_t from = d->raw;
+    d->raw = buttons;
+    d->raw_ns = t;
+    d->changes++;
+
+    switch(c->mode){
+    case FP_DEBOUNCE_OFF:
+        break;
+
+    case FP_DEBOUNCE_LEADING:
+        // still settling from the last edge, whatever it ends up at is
+        // published when the window is over
+        if(d->deadline != 0){
+            d->filtered++;
+            return false;
+        }
+        d->deadline = t + window(c, d->stable, buttons);
+        break;
+
+    case FP_DEBOUNCE_TRAILING:
+        // a pending change that didn't hold
+        if(from != d->stable)
+            d->filtered++;
+        if(buttons == d->stable){
+            d->filtered++;
+            d->deadline = 0;
+        }else{
+            d->deadline = t + window(c, d->stable, buttons);
+        }
+        return false;
+    }
+
+    d->stable = buttons;
+    *out = buttons;
+    return true;
+}
+
+bool fp_debounce_expire(struct fp_debounce *d, const struct fp_debounce_config *c, uint64_t t, uint32_t *out){
+    if(d->deadline == 0 || t < d->deadline)
+        return false;
+    d->deadline = 0;
+
+    if(d->raw == d->stable)
+        return false;
+
+    // the last change was counted as filtered when it came in during the
+    // window, but it does get out
+    if(c->mode == FP_DEBOUNCE_LEADING){
+        d->filtered--;
+        d->deadline = t + window(c, d->stable, d->raw);
+    }
+    d->stable = d->raw;
+    *out = d->raw;
+    return true;
+}
+
+int fp_debounce_parse(struct fp_debounce_config *c, const char *s){
+    char *end;
+    double press = strtod(s, &end), release = press;
+    if(end == s)
+        return -1;
+    if(*end == ','){
+        const char *r = end + 1;
+        release = strtod(r, &end);
+        if(end == r)
+            return -1;
+    }
+    if(*end != '\0' || press < 0 || release < 0)
+        return -1;
+
+    c->press_ns = press * 1e6;
+    c->release_ns = release * 1e6;
+    return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+/*
+ * Debouncing between decoding a report and publishing it, for pedals
+ * whose contacts chatter for a few milliseconds on press and release.
+ *
+ * Leading edge publishes the first change right away and then ignores
+ * the pedal for the settle window, publishing whatever it settled on
+ * when the window ends: no added latency, but a glitch shorter than the
+ * window still gets out as a press and a release. Trailing edge only
+ * publishes a state once the pedal has held it for the whole window:
+ * nothing spurious gets out, at the price of one window of latency.
+ *
+ * Windows are per direction: a change that presses a button uses
+ * press_ns, one that only lets go of buttons uses release_ns, since
+ * contacts usually bounce longer on release.
+ *
+ * Nothing in here reads a clock. The caller passes the time of every
+ * report and calls fp_debounce_expire() once `deadline` has passed, so
+ * replaying a capture debounces exactly like the live pedal did.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum fp_debounce_mode {
+    FP_DEBOUNCE_OFF,
+    FP_DEBOUNCE_LEADING,
+    FP_DEBOUNCE_TRAILING,
+};
+
+struct fp_debounce_config {
+    enum fp_debounce_mode mode;
+    uint64_t press_ns;
+    uint64_t release_ns;
+};
+
+struct fp_debounce {
+    uint32_t raw;           // what the pedal says
+    uint32_t stable;        // what we published
+    uint64_t raw_ns;        // when raw last changed
+    uint64_t deadline;      // when fp_debounce_expire() wants to run, 0 for never
+    uint64_t changes;       // changes of raw
+    uint64_t filtered;      // changes that were never published
+};
+
+void fp_debounce_init(struct fp_debounce *d, uint32_t state);
+// the pedal reports `buttons` at time t. true if *out should be published now
+bool fp_debounce_report(struct fp_debounce *d, const struct fp_debounce_config *c, uint32_t buttons, uint64_t t, uint32_t *out);
+// d->deadline passed, t is at or after it. true if *out should be published now
+bool fp_debounce_expire(struct fp_debounce *d, const struct fp_debounce_config *c, uint64_t t, uint32_t *out);
+// parse "press_ms[,release_ms]" into c's windows, -1 if it's not that
+int fp_debounce_parse(struct fp_debounce_config *c, const char *s);
+
+#endif
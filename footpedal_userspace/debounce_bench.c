@@ -0,0 +1,264 @@
+/*
+ * Replays bounce patterns through debounce.c in each mode and shows what
+ * each one lets through and how much latency it adds: for every edge it
+ * publishes, the time from the pedal first moving away from the last
+ * published state to that edge going out.
+ *
+ * The built-in patterns are timings of the sort cheap pedals produce,
+ * each with the edges and filtered changes every mode should come up
+ * with; a mismatch prints a FAIL line and makes it exit nonzero, as do a
+ * few direct checks of the settle windows. Given a capture (reader -w),
+ * it replays every pedal's reports from that instead, decoded the way the
+ * reader would.
+ *
+ * usage: ./debounce_bench [capture]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "debounce.h"
+#include "hidparse.h"
+#include "capture.h"
+#include "footpedal_stats.h"
+
+struct change {
+    uint64_t time_ns;
+    uint32_t buttons;
+};
+
+struct mode {
+    const char *name;
+    struct fp_debounce_config config;
+};
+
+#define MS 1000000ull
+#define NUM_MODES 5
+
+const struct mode modes[NUM_MODES] = {
+    { "off", { FP_DEBOUNCE_OFF, 0, 0 } },
+    { "leading 5,5", { FP_DEBOUNCE_LEADING, 5 * MS, 5 * MS } },
+    { "leading 2,10", { FP_DEBOUNCE_LEADING, 2 * MS, 10 * MS } },
+    { "trailing 5,5", { FP_DEBOUNCE_TRAILING, 5 * MS, 5 * MS } },
+    { "trailing 2,10", { FP_DEBOUNCE_TRAILING, 2 * MS, 10 * MS } },
+};
+
+// times in microseconds, `real` is how many edges a person actually made,
+// `expect` the edges and filtered changes for each of modes[]
+struct pattern {
+    const char *name;
+    int real;
+    int n;
+    struct { int us; int pressed; } steps[16];
+    struct { int edges; int filtered; } expect[NUM_MODES];
+};
+
+const struct pattern patterns[] = {
+    { "clean press", 2, 2, { { 0, 1 }, { 80000, 0 } },
+      { { 2, 0 }, { 2, 0 }, { 2, 0 }, { 2, 0 }, { 2, 0 } } },
+    { "press chatter", 2, 6, { { 0, 1 }, { 300, 0 }, { 700, 1 }, { 1500, 0 }, { 1900, 1 }, { 80000, 0 } },
+      { { 6, 0 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 } } },
+    { "release chatter", 2, 6, { { 0, 1 }, { 80000, 0 }, { 80400, 1 }, { 81000, 0 }, { 82500, 1 }, { 83000, 0 } },
+      { { 6, 0 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 } } },
+    // the 2 ms press window ends before the press chatter does, so what
+    // it settled on gets out as well
+    { "both", 2, 10, { { 0, 1 }, { 200, 0 }, { 500, 1 }, { 2600, 0 }, { 2900, 1 },
+                       { 80000, 0 }, { 80300, 1 }, { 81500, 0 }, { 84000, 1 }, { 84200, 0 } },
+      { { 10, 0 }, { 2, 8 }, { 4, 6 }, { 2, 8 }, { 2, 8 } } },
+    { "long release chatter", 2, 8, { { 0, 1 }, { 80000, 0 }, { 81000, 1 }, { 83000, 0 }, { 85000, 1 },
+                                      { 87500, 0 }, { 90000, 1 }, { 91000, 0 } },
+      { { 8, 0 }, { 4, 4 }, { 4, 4 }, { 2, 6 }, { 2, 6 } } },
+    // leading edge can't tell a glitch from a press, trailing edge drops it
+    { "glitch", 0, 2, { { 0, 1 }, { 600, 0 } },
+      { { 2, 0 }, { 2, 0 }, { 2, 0 }, { 0, 2 }, { 0, 2 } } },
+    { "fast taps", 8, 8, { { 0, 1 }, { 40000, 0 }, { 80000, 1 }, { 120000, 0 },
+                           { 160000, 1 }, { 200000, 0 }, { 240000, 1 }, { 280000, 0 } },
+      { { 8, 0 }, { 8, 0 }, { 8, 0 }, { 8, 0 }, { 8, 0 } } },
+};
+
+int failed = 0;
+
+void check(const char *what, uint64_t got, uint64_t want){
+    printf("%s %s", got == want ? "ok  " : "FAIL", what);
+    if(got != want){
+        printf(": got %lu, want %lu", (unsigned long)got, (unsigned long)want);
+        failed++;
+    }
+    printf("\n");
+}
+
+// what the patterns don't pin down on their own
+void checks(){
+    struct fp_debounce_config c = { FP_DEBOUNCE_TRAILING, 2 * MS, 10 * MS };
+    struct fp_debounce d;
+    uint32_t out = 0;
+    uint64_t t = 1000 * MS;
+
+    // each direction settles for its own window
+    fp_debounce_init(&d, 0);
+    fp_debounce_report(&d, &c, 1, t, &out);
+    check("trailing: a press waits press_ns", d.deadline - t, 2 * MS);
+    check("trailing: and then gets out", fp_debounce_expire(&d, &c, d.deadline, &out) && out == 1, 1);
+    t += 50 * MS;
+    fp_debounce_report(&d, &c, 0, t, &out);
+    check("trailing: a release waits release_ns", d.deadline - t, 10 * MS);
+    // a second button going down while the first comes up is still a press
+    fp_debounce_init(&d, 1);
+    fp_debounce_report(&d, &c, 2, t, &out);
+    check("trailing: swapping buttons waits press_ns", d.deadline - t, 2 * MS);
+
+    // leading: a change during the window is filtered until the window
+    // ends on it, then it goes out after all and isn't filtered any more
+    c.mode = FP_DEBOUNCE_LEADING;
+    fp_debounce_init(&d, 0);
+    check("leading: a press goes out right away", fp_debounce_report(&d, &c, 1, t, &out) && out == 1, 1);
+    check("leading: releasing in the window is held back", fp_debounce_report(&d, &c, 0, t + MS, &out), 0);
+    check("leading: and counted as filtered", d.filtered, 1);
+    check("leading: the window ends on the release", fp_debounce_expire(&d, &c, t + 2 * MS, &out) && out == 0, 1);
+    check("leading: which is no longer filtered", d.filtered, 0);
+    check("leading: and starts a release window", d.deadline, t + 12 * MS);
+}
+
+struct result {
+    uint64_t edges;
+    uint64_t filtered;
+    struct fp_hist latency;
+};
+
+struct run {
+    struct fp_debounce db;
+    uint64_t moved_ns;  // when the pedal first moved away from what we published, 0 if it hasn't
+};
+
+void published(struct run *run, struct result *res, uint64_t t){
+    fp_hist_record(&res->latency, t - run->moved_ns);
+    res->edges++;
+    run->moved_ns = 0;
+}
+
+// the reader's handle_report() and settle(), with the capture's clock
+void replay(const struct fp_debounce_config *c, const struct change *ch, int n, struct result *res){
+    struct run run = { .moved_ns = 0 };
+    uint32_t out;
+    fp_debounce_init(&run.db, 0);
+
+    for(int i = 0; i <= n; i++){
+        uint64_t t = i < n ? ch[i].time_ns : UINT64_MAX;
+        while(run.db.deadline != 0 && run.db.deadline <= t){
+            uint64_t at = run.db.deadline;
+            if(fp_debounce_expire(&run.db, c, at, &out))
+                published(&run, res, at);
+        }
+        if(i == n)
+            break;
+
+        if(ch[i].buttons != run.db.raw && run.moved_ns == 0)
+            run.moved_ns = t;
+        if(fp_debounce_report(&run.db, c, ch[i].buttons, t, &out))
+            published(&run, res, t);
+        // chatter that came back to where it was
+        if(run.db.raw == run.db.stable)
+            run.moved_ns = 0;
+    }
+    res->filtered += run.db.filtered;
+}
+
+void print_result(const char *name, const char *mode, const struct result *r, int real){
+    printf("%-22s %-14s %6lu", name, mode, (unsigned long)r->edges);
+    if(real >= 0)
+        printf(" %6d", real);
+    printf(" %8lu   %8.2f %8.2f %8.2f\n", (unsigned long)r->filtered,
+           r->latency.count ? r->latency.sum / (double)r->latency.count / 1e6 : 0.0,
+           fp_hist_percentile(&r->latency, 0.99) / 1e6, r->latency.max / 1e6);
+}
+
+int bench_patterns(){
+    printf("%-22s %-14s %6s %6s %8s   %8s %8s %8s\n", "pattern", "mode", "edges", "real", "filtered", "avg ms", "p99 ms", "max ms");
+
+    int nmodes = sizeof(modes) / sizeof(modes[0]);
+    for(size_t k = 0; k < sizeof(patterns) / sizeof(patterns[0]); k++){
+        const struct pattern *pat = &patterns[k];
+        struct change ch[16];
+        for(int i = 0; i < pat->n; i++){
+            ch[i].time_ns = 1000000000ull + pat->steps[i].us * 1000ull;
+            ch[i].buttons = pat->steps[i].pressed;
+        }
+
+        for(int m = 0; m < nmodes; m++){
+            struct result res;
+            memset(&res, 0, sizeof(res));
+            replay(&modes[m].config, ch, pat->n, &res);
+            print_result(m == 0 ? pat->name : "", modes[m].name, &res, pat->real);
+            if(res.edges != (uint64_t)pat->expect[m].edges || res.filtered != (uint64_t)pat->expect[m].filtered){
+                printf("FAIL %s, %s: want %d edges and %d filtered\n", pat->name, modes[m].name,
+                       pat->expect[m].edges, pat->expect[m].filtered);
+                failed++;
+            }
+        }
+    }
+
+    printf("\n");
+    checks();
+    return failed ? 1 : 0;
+}
+
+int bench_capture(const char *path){
+    struct fp_cap_reader r;
+    if(fp_cap_open(&r, path) < 0){
+        perror("Error: could not open capture");
+        return 1;
+    }
+
+    // every pedal's decoded changes, in capture order
+    static struct fp_parser parsers[256];
+    int num[256] = { 0 }, size[256] = { 0 };
+    struct change *changes[256] = { NULL };
+    uint32_t last[256] = { 0 };
+    struct fp_cap_record rec;
+    const unsigned char *payload;
+
+    for(int i = 0; i < 256; i++)
+        fp_parser_fallback(&parsers[i]);
+
+    while(fp_cap_next(&r, &rec, &payload)){
+        if(rec.type == FP_CAP_RDESC){
+            fp_parser_compile(&parsers[rec.pedal], payload, rec.len);
+        }else if(rec.type == FP_CAP_REPORT){
+            uint32_t b = fp_parser_decode(&parsers[rec.pedal], payload, rec.len);
+            if(b == last[rec.pedal])
+                continue;
+            last[rec.pedal] = b;
+            if(num[rec.pedal] == size[rec.pedal]){
+                size[rec.pedal] = size[rec.pedal] ? size[rec.pedal] * 2 : 1024;
+                changes[rec.pedal] = realloc(changes[rec.pedal], size[rec.pedal] * sizeof(struct change));
+            }
+            changes[rec.pedal][num[rec.pedal]++] = (struct change){ rec.time_ns, b };
+        }
+    }
+    fp_cap_close_reader(&r);
+
+    printf("%-22s %-14s %6s %8s   %8s %8s %8s\n", "capture", "mode", "edges", "filtered", "avg ms", "p99 ms", "max ms");
+    for(size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++){
+        struct result res;
+        memset(&res, 0, sizeof(res));
+        for(int p = 0; p < 256; p++){
+            if(num[p] > 0)
+                replay(&modes[m].config, changes[p], num[p], &res);
+        }
+        print_result(m == 0 ? path : "", modes[m].name, &res, -1);
+    }
+
+    for(int p = 0; p < 256; p++)
+        free(changes[p]);
+    return 0;
+}
+
+int main(int argc, char **argv){
+    if(argc > 2){
+        fprintf(stderr, "usage: %s [capture]\n", argv[0]);
+        return 1;
+    }
+    return argc == 2 ? bench_capture(argv[1]) : bench_patterns();
+}
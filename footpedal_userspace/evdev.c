@@ -0,0 +1,66 @@
+#include <string.h>
+
+#include "evdev.h"
+
+void fp_evdev_init(struct fp_evdev *e){
+    memset(e, 0, sizeof(*e));
+}
+
+// the button for a key code: from its scan code if it ever came with one
+static int button(struct fp_evdev *e, unsigned code){
+    return e->buttons[code] ? e->buttons[code] - 1 : FP_BUTTON(code);
+}
+
+enum fp_evdev_result fp_evdev_event(struct fp_evdev *e, const struct input_event *ev, uint32_t *buttons){
+    if(ev->type == EV_SYN && ev->code == SYN_DROPPED){
+        e->dropped = true;
+        e->drops++;
+        return FP_EVDEV_NONE;
+    }
+
+    if(ev->type == EV_SYN && ev->code == SYN_REPORT){
+        e->scanned = false;
+        if(e->dropped){
+            e->dropped = false;
+            return FP_EVDEV_RESYNC;
+        }
+        e->packets++;
+        e->state = e->pending;
+        *buttons = e->state;
+        return FP_EVDEV_PACKET;
+    }
+
+    if(ev->type == EV_MSC && ev->code == MSC_SCAN){
+        e->scanned = true;
+        e->scan = ev->value;
+        return FP_EVDEV_NONE;
+    }
+
+    // 2 is autorepeat
+    if(ev->type != EV_KEY || ev->code >= KEY_CNT)
+        return FP_EVDEV_NONE;
+    if(e->scanned)
+        e->buttons[ev->code] = FP_BUTTON(e->scan) + 1;
+    e->scanned = false;
+    if(e->dropped || ev->value > 1)
+        return FP_EVDEV_NONE;
+
+    int b = button(e, ev->code);
+    if(ev->value)
+        e->pending |= 1u << b;
+    else
+        e->pending &= ~(1u << b);
+    return FP_EVDEV_NONE;
+}
+
+uint32_t fp_evdev_resync(struct fp_evdev *e, const unsigned char *keys, size_t len){
+    uint32_t state = 0;
+
+    for(size_t code = 0; code < len * 8 && code < KEY_CNT; code++){
+        if(keys[code / 8] & (1 << (code % 8)))
+            state |= 1u << button(e, code);
+    }
+
+    e->state = e->pending = state;
+    return state;
+}
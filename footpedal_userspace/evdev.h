@@ -0,0 +1,58 @@
+#ifndef EVDEV_H
+#define EVDEV_H
+
+/*
+ * Turns a pedal's evdev events into the buttons it holds down, for the
+ * reader's evdev backend (reader -e), which reads /dev/input/eventN
+ * instead of hidraw and lets the kernel's HID driver do the decoding.
+ *
+ * Events come in packets ending in SYN_REPORT, and only a whole packet is
+ * a state: fp_evdev_event() collects key changes and hands out the
+ * buttons once the packet is complete. If the client buffer overflowed
+ * the kernel sends SYN_DROPPED, and everything up to and including the
+ * next SYN_REPORT is incomplete; the caller then asks the device which
+ * keys are down (EVIOCGKEY) and hands that to fp_evdev_resync().
+ *
+ * A key's button comes from the MSC_SCAN event the HID driver sends
+ * before it, which is the key's HID usage, numbered the way hidparse.h
+ * does it, so on a HID pedal either backend calls a pedal the same button.
+ * A key that never came with a scan code (a uinput device that doesn't
+ * send them) is button code & 31 instead. Autorepeat is ignored.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <linux/input.h>
+
+#include "hidparse.h"
+
+enum fp_evdev_result {
+    FP_EVDEV_NONE,      // nothing to do yet
+    FP_EVDEV_PACKET,    // a packet is complete, *buttons is the state after it
+    FP_EVDEV_RESYNC,    // events were lost, get the key state and call fp_evdev_resync()
+};
+
+struct fp_evdev {
+    uint32_t state;     // buttons as of the last complete packet
+    uint32_t pending;   // state with the current packet's keys applied
+    bool dropped;       // after SYN_DROPPED, until its SYN_REPORT
+    uint64_t packets;
+    uint64_t drops;     // SYN_DROPPED seen
+
+    bool scanned;       // an MSC_SCAN came since the last key
+    uint32_t scan;      // its value, the next key's usage
+    uint8_t buttons[KEY_CNT];   // key code -> its button + 1, 0 until it came with a scan code
+};
+
+void fp_evdev_init(struct fp_evdev *e);
+enum fp_evdev_result fp_evdev_event(struct fp_evdev *e, const struct input_event *ev, uint32_t *buttons);
+// the buttons held according to an EVIOCGKEY bitmap of len bytes
+uint32_t fp_evdev_resync(struct fp_evdev *e, const unsigned char *keys, size_t len);
+
+// an event's kernel timestamp in ns, on whichever clock the fd was set to
+static inline uint64_t fp_evdev_time(const struct input_event *ev){
+    return (uint64_t)ev->input_event_sec * 1000000000ull + (uint64_t)ev->input_event_usec * 1000;
+}
+
+#endif
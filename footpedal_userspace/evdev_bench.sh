@@ -0,0 +1,34 @@
+#!/bin/bash
+# Runs the reader against virtual pedals with the hidraw and the evdev
+# backend: first uhid pedals, which have both nodes, read each way, then
+# uinput pedals (vpedal -u), which only have the evdev one. Prints
+# vpedal's report-to-edge latency and the reader's stats, which with -e
+# include the kernel stage: the kernel's timestamp on the event to our
+# read() returning. Also checks each pedal took one slot: with -e, a uhid
+# pedal has an evdev node per application in its descriptor, and only
+# one of them is the pedal. Needs root and the uhid and uinput modules.
+
+READER_LOG=/tmp/footpedal-evdev-reader.log
+. "$(dirname "$0")/bench_lib.sh"
+
+need_module uinput
+
+run() {
+  READER_ARGS=$1
+  shift
+  echo "== reader $READER_ARGS, vpedal $*"
+  start_reader $READER_ARGS
+  ./vpedal "$@" | grep -E '^(published|latency)'
+  ./fpstat | grep -E '^(reports|evdev|kernel|read|parse|total)'
+  stop_reader
+  want=$(echo "$*" | sed -n 's/.*-n \([0-9]*\).*/\1/p')
+  got=$(grep -cE '^pedal [0-9]+: /dev/[^ ]+ \(' "$READER_LOG")
+  [ "$got" = "$want" ] || echo "FAIL $want pedals took $got slots"
+  echo
+}
+
+for args in "-n 1 -c 2000 -r 1000" "-n 8 -c 1000 -r 1000 -b 8"; do
+  run "" $args
+  run "-e -g" $args
+  run "-e -g" $args -u
+done
@@ -0,0 +1,114 @@
+/*
+ * Checks that evdev.c turns event sequences into the right buttons, the
+ * way a pedal's /dev/input/eventN would send them: whole packets,
+ * autorepeat, a SYN_DROPPED and the resync after it. No device needed.
+ *
+ * usage: ./evdev_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "evdev.h"
+
+int failed = 0;
+
+void check(const char *what, uint32_t got, uint32_t want){
+    printf("%s %s", got == want ? "ok  " : "FAIL", what);
+    if(got != want){
+        printf(": got %#x, want %#x", got, want);
+        failed++;
+    }
+    printf("\n");
+}
+
+// feed n events, the result of the last one. *buttons is left alone
+// unless a packet completes
+enum fp_evdev_result feed(struct fp_evdev *e, const struct input_event *ev, int n, uint32_t *buttons){
+    enum fp_evdev_result r = FP_EVDEV_NONE;
+    for(int i = 0; i < n; i++)
+        r = fp_evdev_event(e, &ev[i], buttons);
+    return r;
+}
+
+#define KEY(k, v) { .type = EV_KEY, .code = (k), .value = (v) }
+#define SCAN(v) { .type = EV_MSC, .code = MSC_SCAN, .value = (v) }
+#define SYN(k) { .type = EV_SYN, .code = (k) }
+
+int main(){
+    struct fp_evdev e;
+    uint32_t b = 0xdead;
+    fp_evdev_init(&e);
+
+    // what usbhid sends for the factory 'b', scan code and all
+    const struct input_event press[] = { SCAN(0x70005), KEY(KEY_B, 1), SYN(SYN_REPORT) };
+    check("press is a packet", feed(&e, press, 3, &b), FP_EVDEV_PACKET);
+    check("press holds button 5, the usage's", b, 1 << 5);
+
+    const struct input_event half[] = { KEY(KEY_B, 0) };
+    b = 0xdead;
+    check("no packet before SYN_REPORT", feed(&e, half, 1, &b), FP_EVDEV_NONE);
+    check("and no buttons handed out", b, 0xdead);
+    check("state stays as of the last packet", e.state, 1 << 5);
+    const struct input_event repress[] = { KEY(KEY_B, 1), SYN(SYN_REPORT) };
+    feed(&e, repress, 2, &b);
+    check("release and press in one packet cancel out", b, 1 << 5);
+
+    const struct input_event repeat[] = { KEY(KEY_B, 2), SYN(SYN_REPORT) };
+    check("autorepeat packet", feed(&e, repeat, 2, &b), FP_EVDEV_PACKET);
+    check("autorepeat changes nothing", b, 1 << 5);
+
+    // a second key gets its own usage's button, whichever came first
+    const struct input_event chord[] = { SCAN(0x70004), KEY(KEY_A, 1), SYN(SYN_REPORT) };
+    feed(&e, chord, 3, &b);
+    check("second key is button 4", b, 1 << 4 | 1 << 5);
+    const struct input_event release[] = { KEY(KEY_B, 0), KEY(KEY_A, 0), SYN(SYN_REPORT) };
+    feed(&e, release, 3, &b);
+    check("both released", b, 0);
+
+    // everything from SYN_DROPPED up to and including the next
+    // SYN_REPORT is incomplete and has to be thrown away
+    feed(&e, press, 3, &b);
+    const struct input_event dropped[] = {
+        KEY(KEY_A, 1), SYN(SYN_DROPPED), KEY(KEY_B, 0), KEY(KEY_A, 0), SCAN(0x70006), KEY(KEY_C, 1),
+    };
+    uint64_t packets = e.packets;
+    b = 0xdead;
+    check("nothing after SYN_DROPPED", feed(&e, dropped, 6, &b), FP_EVDEV_NONE);
+    const struct input_event end[] = { SYN(SYN_REPORT) };
+    check("its SYN_REPORT asks for a resync", feed(&e, end, 1, &b), FP_EVDEV_RESYNC);
+    check("no buttons handed out meanwhile", b, 0xdead);
+    check("no packet counted", e.packets - packets, 0);
+    check("drop counted", e.drops, 1);
+    check("state still as of the last whole packet", e.state, 1 << 5);
+
+    // EVIOCGKEY says B and C are down: C, which we only ever saw in the
+    // dropped part, still goes by the scan code it came with there
+    unsigned char keys[KEY_MAX / 8 + 1];
+    memset(keys, 0, sizeof(keys));
+    keys[KEY_B / 8] |= 1 << (KEY_B % 8);
+    keys[KEY_C / 8] |= 1 << (KEY_C % 8);
+    check("resync with a new key", fp_evdev_resync(&e, keys, sizeof(keys)), 1 << 5 | 1 << 6);
+    check("which is the state now", e.state, 1 << 5 | 1 << 6);
+    check("and what the next packet starts from", e.pending, 1 << 5 | 1 << 6);
+
+    const struct input_event after[] = { KEY(KEY_C, 0), SYN(SYN_REPORT) };
+    check("packets count again after the resync", feed(&e, after, 2, &b), FP_EVDEV_PACKET);
+    check("releasing the new key", b, 1 << 5);
+    const struct input_event a_again[] = { KEY(KEY_A, 1), SYN(SYN_REPORT) };
+    feed(&e, a_again, 2, &b);
+    check("keys keep their buttons without a scan code", b, 1 << 4 | 1 << 5);
+
+    // a key that never came with one goes by its key code
+    const struct input_event bare[] = { KEY(KEY_LEFTCTRL, 1), SYN(SYN_REPORT) };
+    feed(&e, bare, 2, &b);
+    check("key without a scan code", b, 1 << 4 | 1 << 5 | 1 << (KEY_LEFTCTRL & 31));
+
+    // a resync that finds nothing down releases everything
+    memset(keys, 0, sizeof(keys));
+    check("resync with nothing down", fp_evdev_resync(&e, keys, sizeof(keys)), 0);
+
+    return failed ? 1 : 0;
+}
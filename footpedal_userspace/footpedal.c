@@ -0,0 +1,208 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "footpedal.h"
+#include "footpedal_shm.h"
+
+struct fp_client {
+    const struct fp_shm *shm;
+    uint64_t seen;  // seq of the last edge handed to the caller
+    int efd;        // eventfd from the reader, -1 until fp_fd() asks for it
+    int sock;       // connection it came over; the reader drops the eventfd when it closes
+};
+
+struct fp_client *fp_open(const char *path){
+    int fd = open(path ? path : FP_SHM_PATH, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return NULL;
+
+    struct fp_shm *shm = mmap(NULL, sizeof(struct fp_shm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(shm == MAP_FAILED)
+        return NULL;
+
+    if(shm->magic != FP_SHM_MAGIC || shm->version != FP_SHM_VERSION || shm->size != sizeof(struct fp_shm)){
+        munmap(shm, sizeof(struct fp_shm));
+        errno = EPROTO;
+        return NULL;
+    }
+
+    struct fp_client *c = calloc(1, sizeof(*c));
+    if(c == NULL){
+        munmap(shm, sizeof(struct fp_shm));
+        return NULL;
+    }
+
+    c->shm = shm;
+    c->efd = -1;
+    c->sock = -1;
+
+    struct fp_state st;
+    fp_snapshot(c, &st);
+    return c;
+}
+
+void fp_close(struct fp_client *c){
+    if(c == NULL)
+        return;
+    if(c->efd >= 0)
+        close(c->efd);
+    if(c->sock >= 0)
+        close(c->sock);
+    munmap((void *)c->shm, sizeof(struct fp_shm));
+    free(c);
+}
+
+void fp_snapshot(struct fp_client *c, struct fp_state *out){
+    fp_shm_snapshot(c->shm, out);
+    c->seen = out->seq;
+}
+
+static uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int fp_wait_change(struct fp_client *c, int timeout_ms, struct fp_state *out){
+    uint64_t deadline = timeout_ms > 0 ? now_ns() + (uint64_t)timeout_ms * 1000000ull : 0;
+
+    if(c->efd >= 0){
+        uint64_t count;
+        read(c->efd, &count, sizeof(count));
+    }
+
+    while(true){
+        // the reader stores wake only after the edge is fully published,
+        // so if it still matches what we've seen, FUTEX_WAIT can't miss one
+        uint64_t seen = c->seen;
+        uint32_t wake = atomic_load_explicit((_Atomic uint32_t *)&c->shm->wake, memory_order_acquire);
+        if(wake != (uint32_t)seen){
+            fp_snapshot(c, out);
+            // an earlier snapshot may have seen the edge just before the
+            // reader stored wake; then this is still nothing new
+            if(out->seq != seen)
+                return 1;
+        }
+
+        if(timeout_ms == 0)
+            return 0;
+
+        struct timespec ts, *tsp = NULL;
+        if(timeout_ms > 0){
+            uint64_t now = now_ns();
+            if(now >= deadline)
+                return 0;
+            ts.tv_sec = (deadline - now) / 1000000000ull;
+            ts.tv_nsec = (deadline - now) % 1000000000ull;
+            tsp = &ts;
+        }
+
+        if(syscall(SYS_futex, &c->shm->wake, FUTEX_WAIT, wake, tsp, NULL, 0) < 0
+           && errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT)
+            return -1;
+    }
+}
+
+int fp_fd(struct fp_client *c){
+    if(c->efd >= 0)
+        return c->efd;
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if(sock < 0)
+        return -1;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, FP_NOTIFY_PATH, sizeof(addr.sun_path) - 1);
+
+    char ok;
+    struct iovec iov = { .iov_base = &ok, .iov_len = 1 };
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } ctrl;
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = ctrl.buf,
+        .msg_controllen = sizeof(ctrl.buf),
+    };
+
+    if(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1){
+        close(sock);
+        return -1;
+    }
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if(cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS){
+        close(sock);
+        return -1;
+    }
+    memcpy(&c->efd, CMSG_DATA(cmsg), sizeof(int));
+    c->sock = sock;
+    return c->efd;
+}
+
+int fp_pedal(struct fp_client *c, int pedal, struct fp_pedal *out){
+    if(pedal < 0 || pedal >= FP_MAX_PEDALS)
+        return -1;
+    fp_shm_pedal(c->shm, pedal, out);
+    return 0;
+}
+
+int fp_find_pedal(struct fp_client *c, const char *id){
+    struct fp_pedal p;
+    for(int i = 0; i < FP_MAX_PEDALS; i++){
+        fp_shm_pedal(c->shm, i, &p);
+        if(p.id[0] && strncmp(p.id, id, FP_ID_LEN - 1) == 0)
+            return i;
+    }
+    return -1;
+}
+
+int fp_edges(struct fp_client *c, struct fp_edge *out, int max, uint64_t *missed){
+    int n = fp_shm_edges_since(c->shm, c->seen, out, max, missed);
+    if(n > 0)
+        c->seen = out[n - 1].seq;
+    return n;
+}
+
+int fp_sub_update(int fd, uint64_t pedals, uint32_t events){
+    struct fp_sub_request req = { .pedals = pedals, .events = events };
+    return send(fd, &req, sizeof(req), MSG_NOSIGNAL) == sizeof(req) ? 0 : -1;
+}
+
+int fp_subscribe(uint64_t pedals, uint32_t events){
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if(sock < 0)
+        return -1;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, FP_SUB_PATH, sizeof(addr.sun_path) - 1);
+
+    if(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || fp_sub_update(sock, pedals, events) < 0){
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int fp_sub_next(int fd, struct fp_sub_record *out){
+    ssize_t len = recv(fd, out, sizeof(*out), 0);
+    if(len == 0)
+        return 0;
+    if(len != sizeof(*out)){
+        if(len > 0)
+            errno = EPROTO;
+        return -1;
+    }
+    return 1;
+}
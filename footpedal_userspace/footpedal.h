@@ -0,0 +1,76 @@
+#ifndef FOOTPEDAL_H
+#define FOOTPEDAL_H
+
+/*
+ * Client library for the state the reader publishes in /dev/shm/footpedal.
+ * Doesn't need root. Link with libfootpedal.a.
+ *
+ *   struct fp_client *c = fp_open(NULL);
+ *   struct fp_state st;
+ *   while(fp_wait_change(c, -1, &st) > 0)
+ *       printf("pedal %d: %s\n", st.pedal, (st.mask >> st.pedal) & 1 ? "press" : "release");
+ *
+ * A client remembers the last edge it has seen, so fp_wait_change() never
+ * sleeps through an edge that happened between two calls.
+ *
+ * Only plain structs come through here, so it works from C++ as well.
+ * footpedal_shm.h, with the segment itself, is C11 only.
+ */
+
+#include "footpedal_types.h"
+#include "footpedal_sub.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct fp_client;
+
+// map the segment read-only; path NULL means FP_SHM_PATH
+struct fp_client *fp_open(const char *path);
+void fp_close(struct fp_client *c);
+
+// current state, without any syscalls. marks it as seen
+void fp_snapshot(struct fp_client *c, struct fp_state *out);
+
+/*
+ * Sleep until there is an edge the client hasn't seen yet, or timeout_ms
+ * passes (-1 waits forever, 0 just checks). Returns 1 and fills *out on
+ * a change, 0 on timeout and -1 on error.
+ */
+int fp_wait_change(struct fp_client *c, int timeout_ms, struct fp_state *out);
+
+/*
+ * An eventfd from the reader that becomes readable after every edge, for
+ * poll()/epoll loops. Once it fires, call fp_wait_change(c, 0, &st) to
+ * get the new state and clear it. Returns -1 if the reader isn't running.
+ */
+int fp_fd(struct fp_client *c);
+
+// copy of one pedal's slot, -1 if pedal isn't a valid slot number
+int fp_pedal(struct fp_client *c, int pedal, struct fp_pedal *out);
+
+// slot of the pedal with this serial or USB path, -1 if it was never seen
+int fp_find_pedal(struct fp_client *c, const char *id);
+
+// edges after the last one the client has seen, see fp_shm_edges_since()
+int fp_edges(struct fp_client *c, struct fp_edge *out, int max, uint64_t *missed);
+
+/*
+ * A subscription on the reader's pub/sub socket (see footpedal_sub.h):
+ * pedals is a mask of slots, events a mask of FP_SUB_*. Returns the
+ * socket, which becomes readable when there's a record, or -1 if the
+ * reader isn't running. Doesn't need an fp_client.
+ */
+int fp_subscribe(uint64_t pedals, uint32_t events);
+// change what a subscription gets
+int fp_sub_update(int fd, uint64_t pedals, uint32_t events);
+// the next record: 1, 0 if the reader went away, -1 on error (EAGAIN on a
+// non-blocking socket with nothing waiting)
+int fp_sub_next(int fd, struct fp_sub_record *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef FOOTPEDAL_CTL_H
+#define FOOTPEDAL_CTL_H
+
+/*
+ * The reader's control socket, FP_CTL_PATH, for changing a running reader
+ * instead of restarting it. Only root can connect.
+ *
+ * A client connects (SOCK_SEQPACKET) and sends one command per message,
+ * as text. Every command gets one message back: "ok\n" followed by
+ * whatever it printed, or "error: <why>\n". Commands:
+ *
+ *   stats                          counters and latency histograms, as the reader prints them on exit
+ *   pedals                         the attached pedals and what they hold
+ *   debounce off|<press_ms>[,<release_ms>] [trailing]
+ *                                  like -d and -T; windows in progress end right away
+ *   output notify|sub on|off       pause or resume the eventfd notifications or
+ *                                  the pub/sub records (subscribers get a gap
+ *                                  record for what they missed)
+ *   rescan                         attach any pedal that isn't yet, like at startup
+ *   attach <node>                  attach hidraw3, or input/event3 with -e
+ *   detach <node>
+ *   capture <path>|off             start or stop writing a capture, like -w
+ *
+ * A thread of its own answers commands. stats runs there, and so does
+ * the sysfs walk behind rescan and attach, and opening or closing a
+ * capture file. The rest changes what the main thread reads pedals with,
+ * so it runs there, after every report that came in before it: attaching
+ * a pedal that was found (open() and its report descriptor, as when one
+ * is plugged in), detach, debounce, output, pedals, and naming the pedals
+ * at the start of a capture (reading each one's descriptor again). A
+ * report that comes in meanwhile waits for that part, so rescan only
+ * costs the main thread anything when there is a new pedal. fpctl sends
+ * commands from the shell.
+ */
+
+#define FP_CTL_PATH "/run/footpedal-ctl.sock"
+// longest command, and longest reply
+#define FP_CTL_CMD 256
+#define FP_CTL_REPLY 16384
+
+#endif
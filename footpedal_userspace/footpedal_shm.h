@@ -0,0 +1,249 @@
+#ifndef FOOTPEDAL_SHM_H
+#define FOOTPEDAL_SHM_H
+
+/*
+ * Layout of /dev/shm/footpedal, the state segment published by reader.c.
+ *
+ * The reader mmaps it read/write, consumers mmap it read-only. The
+ * current state is protected by a seqlock, so a consumer can take a
+ * consistent snapshot without any syscalls and without ever blocking the
+ * reader. Every press/release edge is also appended to a small ring, so
+ * a consumer that samples slowly can still see (or at least count) the
+ * edges it missed.
+ *
+ * Every pedal the reader serves gets its own slot, keyed by a stable
+ * identity (the USB serial if the pedal has one, otherwise its USB path),
+ * so a pedal keeps its slot when it is unplugged and plugged back in.
+ *
+ * Consumers that want to sleep until a pedal moves can FUTEX_WAIT on
+ * `wake`, or ask the reader for an eventfd over FP_NOTIFY_PATH. The client
+ * library in footpedal.h wraps both. The reader makes the FUTEX_WAKE
+ * syscall after every edge whether anyone waits or not: counting waiters
+ * would need a word every consumer can write, and nothing a consumer
+ * writes may decide who gets woken.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "footpedal_types.h"
+
+#define FP_SHM_PATH "/dev/shm/footpedal"
+#define FP_SHM_MAGIC 0x44455046 // "FPED" in memory
+#define FP_SHM_VERSION 5
+
+// unix socket the reader hands out per-client eventfds on
+#define FP_NOTIFY_PATH "/run/footpedal.sock"
+
+struct fp_shm {
+    // header, written once before anything else
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;          // sizeof(struct fp_shm), for sanity checks
+    uint32_t history_len;   // FP_HISTORY
+    uint32_t max_pedals;    // FP_MAX_PEDALS
+
+    // seqlock: odd while the reader is in the middle of an update
+    _Alignas(64) _Atomic uint32_t lock;
+    // futex word: the low 32 bits of seq, stored once an edge is
+    // completely published
+    _Atomic uint32_t wake;
+    uint32_t num_pedals;    // slots that have ever been used
+    uint32_t last_pedal;    // pedal of the last edge
+    uint64_t pressed;       // bit n set while pedal n is pressed
+    uint64_t seq;           // number of edges published so far
+    uint64_t time_ns;       // CLOCK_MONOTONIC time of the last edge
+
+    struct fp_edge history[FP_HISTORY];
+    struct fp_pedal pedals[FP_MAX_PEDALS];
+};
+
+// writer side, only used by the reader
+
+static inline void fp_shm_write_begin(struct fp_shm *shm){
+    atomic_fetch_add_explicit(&shm->lock, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void fp_shm_write_end(struct fp_shm *shm){
+    atomic_fetch_add_explicit(&shm->lock, 1, memory_order_release);
+}
+
+static inline void fp_shm_wake(struct fp_shm *shm, uint64_t seq){
+    atomic_store_explicit(&shm->wake, (uint32_t)seq, memory_order_release);
+    syscall(SYS_futex, &shm->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// append an edge, update the pedal's state and wake any futex waiters
+static inline uint64_t fp_shm_publish(struct fp_shm *shm, int pedal, uint32_t state, uint64_t time_ns){
+    fp_shm_write_begin(shm);
+    uint64_t seq = shm->seq + 1;
+    struct fp_edge *e = &shm->history[seq & (FP_HISTORY - 1)];
+    e->seq = seq;
+    e->time_ns = time_ns;
+    e->state = state;
+    e->pedal = pedal;
+
+    struct fp_pedal *p = &shm->pedals[pedal];
+    p->state = state;
+    p->edges++;
+    p->time_ns = time_ns;
+
+    if(state)
+        shm->pressed |= 1ull << pedal;
+    else
+        shm->pressed &= ~(1ull << pedal);
+    shm->time_ns = time_ns;
+    shm->last_pedal = pedal;
+    shm->seq = seq;
+    fp_shm_write_end(shm);
+
+    fp_shm_wake(shm, seq);
+    return seq;
+}
+
+// (re)initialise a segment that doesn't hold our current layout. pedals
+// from a previous run keep their slots but are marked absent, and any the
+// previous reader left pressed get a release edge, like fp_shm_detach()
+static inline void fp_shm_init(struct fp_shm *shm, uint64_t time_ns){
+    fp_shm_write_begin(shm);
+    if(shm->magic != FP_SHM_MAGIC || shm->version != FP_SHM_VERSION || shm->size != sizeof(struct fp_shm)){
+        memset((char *)shm + offsetof(struct fp_shm, wake), 0, sizeof(*shm) - offsetof(struct fp_shm, wake));
+        shm->version = FP_SHM_VERSION;
+        shm->size = sizeof(struct fp_shm);
+        shm->history_len = FP_HISTORY;
+        shm->max_pedals = FP_MAX_PEDALS;
+        shm->magic = FP_SHM_MAGIC;
+    }
+    fp_shm_write_end(shm);
+
+    for(int i = 0; i < FP_MAX_PEDALS; i++)
+        if(shm->pedals[i].state)
+            fp_shm_publish(shm, i, 0, time_ns);
+
+    fp_shm_write_begin(shm);
+    for(int i = 0; i < FP_MAX_PEDALS; i++)
+        shm->pedals[i].present = 0;
+    fp_shm_write_end(shm);
+}
+
+// find the slot for a pedal, preferring the one it had before. -1 if full
+static inline int fp_shm_attach(struct fp_shm *shm, const char *id){
+    int slot = -1;
+    for(int i = 0; i < FP_MAX_PEDALS; i++){
+        struct fp_pedal *p = &shm->pedals[i];
+        if(p->present)
+            continue;
+        if(strncmp(p->id, id, FP_ID_LEN - 1) == 0){
+            slot = i;
+            break;
+        }
+        // otherwise the first slot that was never used, then the first absent one
+        if(slot < 0 || (shm->pedals[slot].id[0] && !p->id[0]))
+            slot = i;
+    }
+    if(slot < 0)
+        return -1;
+
+    fp_shm_write_begin(shm);
+    struct fp_pedal *p = &shm->pedals[slot];
+    if(strncmp(p->id, id, FP_ID_LEN - 1) != 0){
+        memset(p, 0, sizeof(*p));
+        memcpy(p->id, id, strnlen(id, FP_ID_LEN - 1));
+    }
+    p->present = 1;
+    p->state = 0;
+    if((uint32_t)slot >= shm->num_pedals)
+        shm->num_pedals = slot + 1;
+    fp_shm_write_end(shm);
+    return slot;
+}
+
+// a pedal that goes away while pressed gets a release edge, so nobody
+// is left thinking it's still held down
+static inline void fp_shm_detach(struct fp_shm *shm, int pedal, uint64_t time_ns){
+    if(shm->pedals[pedal].state)
+        fp_shm_publish(shm, pedal, 0, time_ns);
+
+    fp_shm_write_begin(shm);
+    shm->pedals[pedal].present = 0;
+    fp_shm_write_end(shm);
+}
+
+// consumer side
+
+static inline uint32_t fp_shm_read_begin(const struct fp_shm *shm){
+    uint32_t lock;
+    while((lock = atomic_load_explicit((_Atomic uint32_t *)&shm->lock, memory_order_acquire)) & 1)
+        ;
+    return lock;
+}
+
+static inline bool fp_shm_read_retry(const struct fp_shm *shm, uint32_t lock){
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit((_Atomic uint32_t *)&shm->lock, memory_order_relaxed) != lock;
+}
+
+// torn-read-safe copy of the current state of all pedals
+static inline void fp_shm_snapshot(const struct fp_shm *shm, struct fp_state *out){
+    uint32_t lock;
+    do {
+        lock = fp_shm_read_begin(shm);
+        out->mask = shm->pressed;
+        out->pedal = shm->last_pedal;
+        out->seq = shm->seq;
+        out->time_ns = shm->time_ns;
+    } while(fp_shm_read_retry(shm, lock));
+    out->pressed = out->mask != 0;
+}
+
+// torn-read-safe copy of one pedal's slot
+static inline void fp_shm_pedal(const struct fp_shm *shm, int pedal, struct fp_pedal *out){
+    uint32_t lock;
+    do {
+        lock = fp_shm_read_begin(shm);
+        memcpy(out, &shm->pedals[pedal], sizeof(*out));
+    } while(fp_shm_read_retry(shm, lock));
+    out->id[FP_ID_LEN - 1] = '\0';
+}
+
+/*
+ * Copy the edges published after `since` (a seq from an earlier snapshot)
+ * into `out`, oldest first. Returns how many were copied. Edges that have
+ * already been overwritten in the ring are counted in *missed.
+ */
+static inline int fp_shm_edges_since(const struct fp_shm *shm, uint64_t since,
+                                     struct fp_edge *out, int max, uint64_t *missed){
+    uint32_t lock;
+    int n;
+    uint64_t lost;
+
+    do {
+        lock = fp_shm_read_begin(shm);
+        uint64_t head = shm->seq;
+        uint64_t first = since + 1;
+
+        lost = 0;
+        if(head >= FP_HISTORY && first <= head - FP_HISTORY){
+            lost = head - FP_HISTORY + 1 - first;
+            first = head - FP_HISTORY + 1;
+        }
+
+        n = 0;
+        for(uint64_t s = first; s <= head && n < max; s++)
+            memcpy(&out[n++], &shm->history[s & (FP_HISTORY - 1)], sizeof(*out));
+    } while(fp_shm_read_retry(shm, lock));
+
+    if(missed)
+        *missed = lost;
+    return n;
+}
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef FOOTPEDAL_STATS_H
+#define FOOTPEDAL_STATS_H
+
+/*
+ * Layout of /dev/shm/footpedal-stats, where the reader keeps its counters
+ * and per-stage latency histograms. Only the reader writes it, with plain
+ * stores, so a reader of this page (fpstat) may see a histogram that is
+ * one sample behind its counters; that's fine for statistics.
+ *
+ * The histograms are log-linear: values below 2^FP_HIST_SUB_BITS ns get
+ * their own bucket, every power of two above that is split into
+ * 2^FP_HIST_SUB_BITS linear buckets, so recording is a couple of shifts
+ * and percentiles are within 1/16 (6.25%) of the real value.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define FP_STATS_PATH "/dev/shm/footpedal-stats"
+#define FP_STATS_MAGIC 0x54535046 // "FPST" in memory
+#define FP_STATS_VERSION 6
+
+#define FP_HIST_SUB_BITS 4
+#define FP_HIST_SUB (1 << FP_HIST_SUB_BITS)
+#define FP_HIST_BUCKETS ((64 - FP_HIST_SUB_BITS + 1) * FP_HIST_SUB)
+
+// stages of the path from a report arriving to its edge being published
+enum fp_stage {
+    FP_STAGE_KERNEL,    // with -e: the kernel's timestamp on the input event to read() returning
+    FP_STAGE_READ,      // epoll wakeup (or the previous report) to read() returning
+    FP_STAGE_QUEUE,     // with -p: read() returning to the main thread taking the report
+    FP_STAGE_PARSE,     // read() returning (or leaving the queue) to the report being decoded
+    FP_STAGE_DEBOUNCE,  // the pedal changing to that change being let through, with -d
+    FP_STAGE_PUBLISH,   // decoded to the edge being visible in shm and notified
+    FP_STAGE_TOTAL,     // wakeup to published, for reports that were an edge
+    FP_NUM_STAGES,
+};
+
+static const char *const fp_stage_names[FP_NUM_STAGES] = {
+    "kernel",
+    "read",
+    "queue",
+    "parse",
+    "debounce",
+    "publish",
+    "total",
+};
+
+struct fp_hist {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[FP_HIST_BUCKETS];
+};
+
+struct fp_stats {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;          // sizeof(struct fp_stats)
+    uint32_t latency;       // 0 if the reader was built without latency stats
+
+    uint64_t reports;
+    uint64_t wakeups;
+    uint64_t syscalls;
+    uint64_t edges;
+    uint64_t filtered;          // changes the debouncer never let through
+    uint64_t subscribers;       // connected to FP_SUB_PATH right now
+    uint64_t sub_records;       // records sent to them
+    uint64_t sub_dropped;       // records a full queue (or output sub off) made us drop
+    uint64_t ctl_commands;      // handled on FP_CTL_PATH, by a thread whose syscalls aren't counted
+
+    // with -p. the acquisition thread's own wakeups and syscalls aren't
+    // in the ones above
+    uint64_t acq_wakeups;
+    uint64_t acq_syscalls;
+    uint64_t queue_pushes;      // reports through the queue
+    uint64_t queue_depth_sum;   // what each one found in front of it, for the average
+    uint64_t queue_depth_max;
+    uint64_t queue_full;        // times acquisition had to wait for the main thread
+    uint64_t queue_full_ns;     // time it spent waiting
+    uint64_t queue_kicks;       // times it had to wake the main thread
+
+    // with -e: times the kernel's event buffer overflowed (SYN_DROPPED)
+    // and we had to ask the pedal what it holds
+    uint64_t evdev_resyncs;
+
+    uint64_t discovery_ns;      // sysfs walk at startup
+    uint64_t first_report_ns;   // from start to the first report of any pedal
+
+    struct fp_hist stages[FP_NUM_STAGES];
+};
+
+static inline int fp_hist_index(uint64_t v){
+    if(v < FP_HIST_SUB)
+        return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - FP_HIST_SUB_BITS;
+    return ((shift + 1) << FP_HIST_SUB_BITS) + (int)((v >> shift) & (FP_HIST_SUB - 1));
+}
+
+// smallest value that lands in bucket i
+static inline uint64_t fp_hist_value(int i){
+    if(i < FP_HIST_SUB)
+        return i;
+    int shift = (i >> FP_HIST_SUB_BITS) - 1;
+    return (uint64_t)(FP_HIST_SUB + (i & (FP_HIST_SUB - 1))) << shift;
+}
+
+static inline void fp_hist_record(struct fp_hist *h, uint64_t v){
+    h->buckets[fp_hist_index(v)]++;
+    h->count++;
+    h->sum += v;
+    if(v > h->max)
+        h->max = v;
+}
+
+// value at or below which a fraction p (0..1) of the samples fall
+static inline uint64_t fp_hist_percentile(const struct fp_hist *h, double p){
+    if(h->count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(p * h->count);
+    if(rank >= h->count)
+        rank = h->count - 1;
+
+    uint64_t seen = 0;
+    for(int i = 0; i < FP_HIST_BUCKETS; i++){
+        seen += h->buckets[i];
+        if(seen > rank){
+            if(i == FP_HIST_BUCKETS - 1)
+                return h->max;
+            uint64_t v = fp_hist_value(i + 1) - 1;
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+static inline void fp_hist_print(FILE *f, const char *name, const struct fp_hist *h){
+    fprintf(f, "%-8s p50 %8.2f us  p99 %8.2f us  p999 %8.2f us  max %8.2f us  (%lu)\n", name,
+            fp_hist_percentile(h, 0.5) / 1e3, fp_hist_percentile(h, 0.99) / 1e3,
+            fp_hist_percentile(h, 0.999) / 1e3, h->max / 1e3, (unsigned long)h->count);
+}
+
+#endif
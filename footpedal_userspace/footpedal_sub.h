@@ -0,0 +1,55 @@
+#ifndef FOOTPEDAL_SUB_H
+#define FOOTPEDAL_SUB_H
+
+/*
+ * Wire format of the reader's publish/subscribe socket, FP_SUB_PATH.
+ *
+ * A client connects (SOCK_SEQPACKET) and sends a struct fp_sub_request
+ * saying which pedals and which events it wants; sending another one
+ * replaces it. From then on the reader sends it one struct fp_sub_record
+ * per message for every matching event.
+ *
+ * Records are numbered per client, from 1. The reader never waits for a
+ * client: what the socket can't take right away is queued, and when that
+ * queue is full the newest records are dropped. They still use up their
+ * numbers, and the next record that does get through is preceded by an
+ * FP_SUB_GAP record saying which ones were lost, so a client always
+ * knows exactly what it missed. The shm segment has the current state
+ * to resync from.
+ *
+ * The client library (footpedal.h) has fp_subscribe() and fp_sub_next().
+ */
+
+#include <stdint.h>
+
+#define FP_SUB_PATH "/run/footpedal-sub.sock"
+
+// events, for fp_sub_request.events and fp_sub_record.type
+enum fp_sub_event {
+    FP_SUB_PRESS = 1 << 0,      // an edge where a button went down
+    FP_SUB_RELEASE = 1 << 1,    // an edge where a button came up
+    FP_SUB_ATTACH = 1 << 2,     // a pedal was plugged in
+    FP_SUB_DETACH = 1 << 3,     // a pedal went away, after its release edge
+    FP_SUB_GAP = 1 << 7,        // records were dropped, always sent
+};
+
+#define FP_SUB_EDGES (FP_SUB_PRESS | FP_SUB_RELEASE)
+#define FP_SUB_ALL (FP_SUB_EDGES | FP_SUB_ATTACH | FP_SUB_DETACH)
+
+struct fp_sub_request {
+    uint64_t pedals;    // bit n for pedal slot n
+    uint32_t events;    // FP_SUB_* it wants
+    uint32_t reserved;
+};
+
+struct fp_sub_record {
+    uint64_t seq;       // this client's record number; for FP_SUB_GAP the first one lost
+    uint64_t time_ns;   // CLOCK_MONOTONIC time of the event, or the first one lost
+    uint64_t edge;      // seq of the edge in the shm segment, 0 if it isn't an edge
+    uint32_t state;     // buttons held after it; for FP_SUB_GAP how many records were lost
+    uint8_t pedal;      // slot of the pedal
+    uint8_t type;       // FP_SUB_*, both PRESS and RELEASE if one edge did both
+    uint16_t reserved;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef FOOTPEDAL_TYPES_H
+#define FOOTPEDAL_TYPES_H
+
+/*
+ * The plain records the state segment (footpedal_shm.h) is made of, and
+ * that the client library (footpedal.h) hands out. No atomics, so C++
+ * can include it too.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// must be a power of two
+#define FP_HISTORY 64
+
+// at most 64, so the pressed pedals fit in one mask
+#define FP_MAX_PEDALS 64
+#define FP_ID_LEN 64
+
+struct fp_edge {
+    uint64_t seq;       // edge number across all pedals, starting at 1
+    uint64_t time_ns;   // CLOCK_MONOTONIC time of the edge
+    uint32_t state;     // buttons held after the edge, 0 = released
+    uint32_t pedal;     // slot of the pedal that moved
+};
+
+struct fp_pedal {
+    uint32_t present;   // 1 while the pedal is plugged in
+    uint32_t state;     // buttons held, bit n for usage IDs n mod 32: 1 << 5 for the factory 'b'
+    uint64_t edges;     // number of edges on this pedal
+    uint64_t time_ns;   // CLOCK_MONOTONIC time of its last edge
+    char id[FP_ID_LEN]; // serial or USB path, empty if the slot was never used
+};
+
+// what a consumer gets out of fp_shm_snapshot() or fp_snapshot()
+struct fp_state {
+    bool pressed;       // any pedal pressed
+    uint64_t mask;      // which ones
+    int pedal;          // pedal of the last edge
+    uint64_t seq;
+    uint64_t time_ns;
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef FOOTSWITCH_RDESC_H
+#define FOOTSWITCH_RDESC_H
+
+// captured from a real QinHeng/PCsensor pedal, see drivers/FootSwitch_BPF.c
+static const unsigned char footswitch_rdesc[212] = {
+    0x05, 0x01, 0x09, 0x06, 0xa1, 0x01, 0x85, 0x01, 0x05, 0x07, 0x19, 0xe0, 0x29, 0xe7, 0x15, 0x00,
+    0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02, 0x95, 0x01, 0x75, 0x08, 0x81, 0x01, 0x95, 0x03,
+    0x75, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x03, 0x91, 0x02, 0x95, 0x05, 0x75, 0x01, 0x91, 0x01,
+    0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x25, 0xff, 0x05, 0x07, 0x19, 0x00, 0x29, 0xff, 0x81, 0x00,
+    0xc0, 0x05, 0x01, 0x09, 0x02, 0xa1, 0x01, 0x85, 0x02, 0x09, 0x01, 0xa1, 0x00, 0x05, 0x09, 0x19,
+    0x01, 0x29, 0x05, 0x15, 0x00, 0x25, 0x01, 0x95, 0x05, 0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75,
+    0x03, 0x81, 0x03, 0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x09, 0x38, 0x15, 0x81, 0x25, 0x7f, 0x75,
+    0x08, 0x95, 0x03, 0x81, 0x06, 0xc0, 0xc0, 0x05, 0x01, 0x09, 0x05, 0xa1, 0x01, 0x85, 0x04, 0x09,
+    0x01, 0xa1, 0x00, 0x09, 0x30, 0x09, 0x31, 0x15, 0xff, 0x25, 0x01, 0x95, 0x02, 0x75, 0x02, 0x81,
+    0x02, 0xc0, 0x95, 0x04, 0x75, 0x01, 0x81, 0x03, 0x05, 0x09, 0x19, 0x01, 0x29, 0x08, 0x15, 0x00,
+    0x25, 0x01, 0x95, 0x08, 0x75, 0x01, 0x81, 0x02, 0xc0, 0x05, 0x0c, 0x09, 0x01, 0xa1, 0x01, 0x85,
+    0x03, 0x05, 0x01, 0x09, 0x81, 0x09, 0x82, 0x75, 0x01, 0x95, 0x02, 0x81, 0x02, 0x95, 0x06, 0x75,
+    0x01, 0x81, 0x03, 0x05, 0x0c, 0x95, 0x01, 0x75, 0x10, 0x19, 0x00, 0x2a, 0x2e, 0x02, 0x26, 0x2e,
+    0x02, 0x81, 0x00, 0xc0,
+};
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * Sends a command to a running reader's control socket and prints the
+ * reply (see footpedal_ctl.h for the commands). Needs root, like the
+ * socket.
+ *
+ * With -r, sends the same command that many times a second for -t
+ * seconds instead, and prints how long the replies took. That's control
+ * traffic to load the reader with, see ctl_bench.sh.
+ *
+ * usage: ./fpctl [-r per second [-t seconds]] command [args]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "footpedal_ctl.h"
+#include "footpedal_stats.h"
+
+uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int ctl_connect(){
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, FP_CTL_PATH, sizeof(addr.sun_path) - 1);
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// send cmd and wait for its reply. the reply's length, -1 on error
+ssize_t ctl_send(int fd, const char *cmd, char *reply, size_t size){
+    if(send(fd, cmd, strlen(cmd), MSG_NOSIGNAL) < 0)
+        return -1;
+    ssize_t len = recv(fd, reply, size - 1, 0);
+    if(len <= 0)
+        return -1;
+    reply[len] = '\0';
+    return len;
+}
+
+int main(int argc, char **argv){
+    int rate = 0, seconds = 5;
+    int opt;
+    while((opt = getopt(argc, argv, "+r:t:")) != -1){
+        switch(opt){
+        case 'r': rate = atoi(optarg); break;
+        case 't': seconds = atoi(optarg); break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if(optind >= argc){
+        fprintf(stderr, "usage: %s [-r per second [-t seconds]] command [args]\n", argv[0]);
+        return 1;
+    }
+
+    char cmd[FP_CTL_CMD];
+    cmd[0] = '\0';
+    for(int i = optind; i < argc; i++){
+        if(i > optind)
+            strncat(cmd, " ", sizeof(cmd) - strlen(cmd) - 1);
+        strncat(cmd, argv[i], sizeof(cmd) - strlen(cmd) - 1);
+    }
+
+    int fd = ctl_connect();
+    if(fd < 0){
+        perror("Error: could not connect to " FP_CTL_PATH ", is the reader running (and are you root)?");
+        return 1;
+    }
+
+    static char reply[FP_CTL_REPLY + 1];
+    if(rate <= 0){
+        if(ctl_send(fd, cmd, reply, sizeof(reply)) < 0){
+            perror("Error: no reply from the reader");
+            return 1;
+        }
+        if(strncmp(reply, "ok\n", 3) == 0){
+            fputs(reply + 3, stdout);
+            return 0;
+        }
+        fputs(reply, stderr);
+        return 1;
+    }
+
+    // the same command over and over, at a steady rate
+    struct fp_hist replies = { 0 };
+    uint64_t errors = 0;
+    uint64_t tick_ns = 1000000000ull / rate;
+    uint64_t end = now_ns() + (uint64_t)seconds * 1000000000ull;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while(now_ns() < end){
+        uint64_t t = now_ns();
+        if(ctl_send(fd, cmd, reply, sizeof(reply)) < 0){
+            perror("Error: no reply from the reader");
+            return 1;
+        }
+        fp_hist_record(&replies, now_ns() - t);
+        errors += strncmp(reply, "ok\n", 3) != 0;
+
+        next.tv_nsec += tick_ns;
+        while(next.tv_nsec >= 1000000000){
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    printf("commands: %lu, errors: %lu\n", (unsigned long)replies.count, (unsigned long)errors);
+    fp_hist_print(stdout, "reply", &replies);
+    close(fd);
+    return errors > 0;
+}
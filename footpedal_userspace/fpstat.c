@@ -0,0 +1,66 @@
+/*
+ * Prints the counters and latency percentiles of a running reader from
+ * /dev/shm/footpedal-stats. Doesn't need root.
+ *
+ * usage: ./fpstat [interval in seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "footpedal_stats.h"
+
+void print_stats(const struct fp_stats *s){
+    printf("reports: %lu, edges: %lu, filtered: %lu, wakeups: %lu, syscalls: %lu", s->reports, s->edges, s->filtered, s->wakeups, s->syscalls);
+    if(s->reports > 0)
+        printf(" (%.2f per report)", (double)s->syscalls / s->reports);
+    printf("\n");
+    printf("subscribers: %lu, records sent: %lu, dropped: %lu\n", s->subscribers, s->sub_records, s->sub_dropped);
+    if(s->ctl_commands > 0)
+        printf("control commands: %lu\n", s->ctl_commands);
+    if(s->evdev_resyncs > 0)
+        printf("evdev resyncs after SYN_DROPPED: %lu\n", s->evdev_resyncs);
+    if(s->queue_pushes > 0){
+        printf("acquisition thread: wakeups: %lu, syscalls: %lu\n", s->acq_wakeups, s->acq_syscalls);
+        printf("queue: %lu reports, depth avg %.1f max %lu, full %lu times for %.1f ms, %lu kicks\n",
+               s->queue_pushes, (double)s->queue_depth_sum / s->queue_pushes, s->queue_depth_max,
+               s->queue_full, s->queue_full_ns / 1e6, s->queue_kicks);
+    }
+
+    if(!s->latency){
+        printf("reader was built without latency stats\n");
+        return;
+    }
+
+    for(int i = 0; i < FP_NUM_STAGES; i++)
+        fp_hist_print(stdout, fp_stage_names[i], &s->stages[i]);
+}
+
+int main(int argc, char **argv){
+    int interval = argc > 1 ? atoi(argv[1]) : 0;
+
+    int fd = open(FP_STATS_PATH, O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        perror("Error: could not open " FP_STATS_PATH ", is the reader running?");
+        return 1;
+    }
+
+    const struct fp_stats *s = mmap(NULL, sizeof(struct fp_stats), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(s == MAP_FAILED || s->magic != FP_STATS_MAGIC || s->version != FP_STATS_VERSION || s->size != sizeof(struct fp_stats)){
+        printf("Error: " FP_STATS_PATH " doesn't look like stats from this version of the reader\n");
+        return 1;
+    }
+
+    print_stats(s);
+    while(interval > 0){
+        sleep(interval);
+        printf("\n");
+        print_stats(s);
+    }
+
+    return 0;
+}
@@ -0,0 +1,301 @@
+#include <string.h>
+
+#include "hidparse.h"
+
+// item tags, HID 1.11 section 6.2.2
+enum {
+    MAIN_INPUT = 0x8,
+    MAIN_OUTPUT = 0x9,
+    MAIN_COLLECTION = 0xa,
+    MAIN_FEATURE = 0xb,
+    MAIN_END_COLLECTION = 0xc,
+
+    GLOBAL_USAGE_PAGE = 0x0,
+    GLOBAL_LOGICAL_MIN = 0x1,
+    GLOBAL_LOGICAL_MAX = 0x2,
+    GLOBAL_REPORT_SIZE = 0x7,
+    GLOBAL_REPORT_ID = 0x8,
+    GLOBAL_REPORT_COUNT = 0x9,
+    GLOBAL_PUSH = 0xa,
+    GLOBAL_POP = 0xb,
+
+    LOCAL_USAGE = 0x0,
+    LOCAL_USAGE_MIN = 0x1,
+    LOCAL_USAGE_MAX = 0x2,
+};
+
+// input item flags
+#define INPUT_CONSTANT 0x1
+#define INPUT_VARIABLE 0x2
+#define INPUT_RELATIVE 0x4
+
+#define MAX_USAGES 32
+#define MAX_PUSH 4
+
+struct globals {
+    uint32_t page;
+    int32_t min;
+    int32_t max_signed;
+    uint32_t max_unsigned;
+    uint32_t size, count, id;
+};
+
+struct locals {
+    uint32_t usages[MAX_USAGES];
+    int num_usages;
+    uint32_t min, max;
+    bool range;
+};
+
+// fields as the descriptor lists them, before they're grouped by report
+struct compiling {
+    struct fp_field fields[FP_MAX_FIELDS];
+    int report[FP_MAX_FIELDS];
+    int num_fields;
+    uint32_t bits[FP_MAX_REPORTS];  // input bits of each report so far
+};
+
+static int report_index(struct fp_parser *p, struct compiling *c, uint32_t id){
+    if(id > 255)
+        return -1;
+    if(p->by_id[id] >= 0)
+        return p->by_id[id];
+    if(p->num_reports == FP_MAX_REPORTS)
+        return -1;
+
+    int r = p->num_reports++;
+    p->reports[r].id = id;
+    p->by_id[id] = r;
+    c->bits[r] = p->ids ? 8 : 0;
+    return r;
+}
+
+static int add_field(struct compiling *c, int r, const struct fp_field *f){
+    if(c->num_fields == FP_MAX_FIELDS)
+        return -1;
+    c->report[c->num_fields] = r;
+    c->fields[c->num_fields++] = *f;
+    return 0;
+}
+
+static int add_input(struct fp_parser *p, struct compiling *c, const struct globals *g, const struct locals *l, uint32_t flags){
+    int r = report_index(p, c, g->id);
+    if(r < 0 || g->size > 32 || g->count > 256)
+        return -1;
+    uint32_t bit = c->bits[r];
+    c->bits[r] += g->size * g->count;
+    if(c->bits[r] > FP_MAX_REPORT * 8)
+        return -1;
+
+    if(flags & INPUT_CONSTANT)
+        return 0;
+
+    if(flags & INPUT_VARIABLE){
+        // only on/off fields can be buttons
+        if(g->size != 1 || (flags & INPUT_RELATIVE))
+            return 0;
+        for(uint32_t k = 0; k < g->count; k++){
+            struct fp_field f = { .bit = bit + k, .size = 1 };
+            if((int)k < l->num_usages)
+                f.usage = l->usages[k];
+            else if(l->range)
+                f.usage = l->min + k;
+            else if(l->num_usages > 0)
+                f.usage = l->usages[l->num_usages - 1];
+            f.button = FP_BUTTON(f.usage);
+            if(add_field(c, r, &f) < 0)
+                return -1;
+        }
+        return 0;
+    }
+
+    int32_t max = g->min < 0 ? g->max_signed : (int32_t)g->max_unsigned;
+    uint32_t base = l->range ? l->min : l->num_usages > 0 ? l->usages[0] : 0;
+    for(uint32_t k = 0; k < g->count; k++){
+        struct fp_field f = { .bit = bit + k * g->size, .size = g->size, .array = true,
+                              .min = g->min, .max = max, .usage = base };
+        if(add_field(c, r, &f) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+void fp_parser_fallback(struct fp_parser *p){
+    memset(p, 0, sizeof(*p));
+    memset(p->by_id, -1, sizeof(p->by_id));
+    p->fallback = true;
+}
+
+int fp_parser_compile(struct fp_parser *p, const uint8_t *rdesc, size_t len){
+    struct globals g = { 0 }, stack[MAX_PUSH];
+    struct locals l = { 0 };
+    struct compiling c;
+    int depth = 0;
+    size_t i = 0;
+
+    memset(p, 0, sizeof(*p));
+    memset(p->by_id, -1, sizeof(p->by_id));
+    memset(&c, 0, sizeof(c));
+
+    // report IDs apply to the whole descriptor, and shift every field by a byte
+    for(size_t k = 0; k < len; ){
+        uint8_t prefix = rdesc[k];
+        if(prefix == 0xfe){
+            k += k + 1 < len ? 3 + rdesc[k + 1] : len;
+            continue;
+        }
+        if((prefix & 0xfc) == 0x84)
+            p->ids = true;
+        k += 1 + ((prefix & 3) == 3 ? 4 : prefix & 3);
+    }
+
+    while(i < len){
+        uint8_t prefix = rdesc[i++];
+
+        // long items, reserved for vendors, never describe input we know
+        if(prefix == 0xfe){
+            if(i + 1 >= len)
+                goto bad;
+            i += 2 + rdesc[i];
+            continue;
+        }
+
+        int size = (prefix & 3) == 3 ? 4 : prefix & 3;
+        if(i + size > len)
+            goto bad;
+        uint32_t u = 0;
+        for(int k = 0; k < size; k++)
+            u |= (uint32_t)rdesc[i + k] << (8 * k);
+        int32_t s = size == 1 ? (int8_t)u : size == 2 ? (int16_t)u : (int32_t)u;
+        i += size;
+
+        int tag = prefix >> 4;
+        switch((prefix >> 2) & 3){
+        case 0:
+            if(tag == MAIN_INPUT && add_input(p, &c, &g, &l, u) < 0)
+                goto bad;
+            if(tag == MAIN_INPUT || tag == MAIN_OUTPUT || tag == MAIN_FEATURE || tag == MAIN_COLLECTION || tag == MAIN_END_COLLECTION)
+                memset(&l, 0, sizeof(l));
+            break;
+        case 1:
+            switch(tag){
+            case GLOBAL_USAGE_PAGE: g.page = u; break;
+            case GLOBAL_LOGICAL_MIN: g.min = s; break;
+            case GLOBAL_LOGICAL_MAX: g.max_signed = s; g.max_unsigned = u; break;
+            case GLOBAL_REPORT_SIZE: g.size = u; break;
+            case GLOBAL_REPORT_ID: g.id = u; break;
+            case GLOBAL_REPORT_COUNT: g.count = u; break;
+            case GLOBAL_PUSH:
+                if(depth == MAX_PUSH)
+                    goto bad;
+                stack[depth++] = g;
+                break;
+            case GLOBAL_POP:
+                if(depth == 0)
+                    goto bad;
+                g = stack[--depth];
+                break;
+            }
+            break;
+        case 2: {
+            // a 4 byte usage carries its own page
+            uint32_t usage = size == 4 ? u : g.page << 16 | u;
+            if(tag == LOCAL_USAGE && l.num_usages < MAX_USAGES)
+                l.usages[l.num_usages++] = usage;
+            else if(tag == LOCAL_USAGE_MIN){
+                l.min = usage;
+                l.range = true;
+            }else if(tag == LOCAL_USAGE_MAX)
+                l.max = usage;
+            break;
+        }
+        }
+    }
+
+    // group the fields by report, keeping descriptor order within each
+    for(int r = 0; r < p->num_reports; r++){
+        struct fp_report *rep = &p->reports[r];
+        rep->first = p->num_fields;
+        for(int k = 0; k < c.num_fields; k++){
+            if(c.report[k] == r)
+                p->fields[p->num_fields++] = c.fields[k];
+        }
+        rep->count = p->num_fields - rep->first;
+
+        // so decoding can skip a byte of on/off fields that are all off in one go
+        for(int k = p->num_fields - 2; k >= rep->first; k--){
+            struct fp_field *f = &p->fields[k], *next = f + 1;
+            if(!f->array && !next->array && f->bit / 8 == next->bit / 8)
+                f->same_byte = next->same_byte + 1;
+        }
+        rep->len = (c.bits[r] + 7) / 8;
+    }
+    if(p->num_fields == 0)
+        goto bad;
+    return 0;
+
+bad:
+    fp_parser_fallback(p);
+    return -1;
+}
+
+static inline uint32_t extract(const uint8_t *report, uint32_t bit, int size){
+    const uint8_t *b = report + bit / 8;
+    if(size == 1)
+        return (*b >> (bit & 7)) & 1;
+    if(size == 8 && (bit & 7) == 0)
+        return *b;
+
+    uint64_t w = 0;
+    int bytes = ((bit & 7) + size + 7) / 8;
+    for(int k = 0; k < bytes; k++)
+        w |= (uint64_t)b[k] << (8 * k);
+    return (w >> (bit & 7)) & ((1ull << size) - 1);
+}
+
+uint32_t fp_parser_decode(struct fp_parser *p, const uint8_t *report, size_t len){
+    if(p->fallback){
+        bool any = false;
+        for(size_t k = 1; k < len; k++)
+            any |= report[k] != 0;
+        p->state = any;
+        return p->state;
+    }
+
+    int r = p->ids ? (len > 0 ? p->by_id[report[0]] : -1) : p->by_id[0];
+    if(r < 0 || len < p->reports[r].len)
+        return p->state;
+
+    struct fp_report *rep = &p->reports[r];
+    uint32_t held = 0;
+
+    for(struct fp_field *f = &p->fields[rep->first]; f < &p->fields[rep->first + rep->count]; f++){
+        if(!f->array && report[f->bit / 8] == 0){
+            f += f->same_byte;
+            continue;
+        }
+
+        uint32_t v = extract(report, f->bit, f->size);
+        if(!f->array){
+            if(v)
+                held |= 1u << f->button;
+            continue;
+        }
+
+        int32_t sv = f->min < 0 && f->size < 32 ? (int32_t)(v << (32 - f->size)) >> (32 - f->size) : (int32_t)v;
+        if(sv < f->min || sv > f->max)
+            continue;
+        uint32_t usage = f->usage + (sv - f->min);
+        // usage 0 is "no key", and the keyboard page's 1-3 are rollover errors
+        if((usage & 0xffff) == 0 || (usage >> 16 == 0x07 && (usage & 0xffff) <= 3))
+            continue;
+        held |= 1u << FP_BUTTON(usage);
+    }
+
+    // another report may hold the same button
+    rep->held = held;
+    p->state = 0;
+    for(int k = 0; k < p->num_reports; k++)
+        p->state |= p->reports[k].held;
+    return p->state;
+}
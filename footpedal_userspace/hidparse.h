@@ -0,0 +1,73 @@
+#ifndef HIDPARSE_H
+#define HIDPARSE_H
+
+/*
+ * Turns a pedal's raw reports into the buttons it holds down, going by
+ * its report descriptor instead of assuming the factory 'b' key.
+ *
+ * fp_parser_compile() walks the descriptor once, when the pedal attaches,
+ * and keeps a plan per report ID: where each on/off bit (modifiers, mouse
+ * buttons) and each array slot (keyboard and consumer keys) sits in the
+ * report. fp_parser_decode() then only follows that plan, a mask and a
+ * shift per field.
+ *
+ * A button's number is the low 5 bits of its usage ID, so it only
+ * depends on what the pedal sends, not on the order the pedals are
+ * pressed in, and stays the same across re-attaching and restarts: the
+ * factory 'b' (keyboard usage 0x05) is button 5, a three pedal unit's a, b
+ * and c are buttons 4-6, left Ctrl (0xe0) is button 0 and mouse button 1
+ * is button 1. Two usages a multiple of 32 apart share a button. Usages
+ * that only ever come in relative or multi-bit fields (mouse movement and
+ * the like) aren't buttons.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// the mask is 32 bits, same as fp_pedal.state
+#define FP_MAX_BUTTONS 32
+#define FP_BUTTON(usage) ((usage) & (FP_MAX_BUTTONS - 1))
+#define FP_MAX_REPORTS 8
+#define FP_MAX_FIELDS 64
+// longest report, same as REPORT_MAX in reader.c. a descriptor with a
+// longer one doesn't compile, the reader never sees all of it anyway
+#define FP_MAX_REPORT 64
+
+struct fp_field {
+    uint32_t bit;       // offset in the report, report ID byte included
+    uint8_t size;       // bits per value, 1 for an on/off field
+    bool array;         // array slot: the value picks a usage, 0 or out of range is none
+    uint8_t button;     // on/off fields: its button
+    uint8_t same_byte;  // on/off fields: how many after this one are in the same byte
+    int32_t min, max;   // logical range of an array slot
+    uint32_t usage;     // usage page << 16 | usage, for an array the one `min` picks
+};
+
+struct fp_report {
+    uint8_t id;
+    uint16_t len;       // bytes the plan reads, shorter reports are ignored
+    uint16_t first, count;  // its fields in fp_parser.fields
+    uint32_t held;      // buttons this report held last time
+};
+
+struct fp_parser {
+    int num_reports;
+    int num_fields;
+    bool ids;           // reports start with a report ID
+    bool fallback;      // no usable descriptor: any nonzero byte is button 0
+    uint32_t state;     // buttons held, across all reports
+
+    struct fp_report reports[FP_MAX_REPORTS];
+    struct fp_field fields[FP_MAX_FIELDS];
+    int8_t by_id[256];  // report ID -> index in reports, -1 if we don't know it
+};
+
+// 0, or -1 if the descriptor is malformed or has no buttons, in which
+// case the parser still works, in fallback mode
+int fp_parser_compile(struct fp_parser *p, const uint8_t *rdesc, size_t len);
+void fp_parser_fallback(struct fp_parser *p);
+// the buttons held after this report, bit n for button n
+uint32_t fp_parser_decode(struct fp_parser *p, const uint8_t *report, size_t len);
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ * Checks that hidparse.c decodes what pedals send, then measures what
+ * decoding a report costs: the old fixed report[3] == 5 check, the
+ * compiled plan the reader uses, and walking the descriptor for every
+ * report, which is what compiling it once saves.
+ *
+ * usage: ./parse_bench [reports]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "hidparse.h"
+#include "footswitch_rdesc.h"
+
+#define BENCH_REPORTS 10000000
+
+int failed = 0;
+
+uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void check(const char *what, uint32_t got, uint32_t want){
+    printf("%s %s", got == want ? "ok  " : "FAIL", what);
+    if(got != want){
+        printf(": got %#x, want %#x", got, want);
+        failed++;
+    }
+    printf("\n");
+}
+
+// a report ID 1 keyboard report from the pedal
+uint32_t keys(struct fp_parser *p, uint8_t modifiers, uint8_t a, uint8_t b, uint8_t c){
+    uint8_t report[9] = { 1, modifiers, 0, a, b, c, 0, 0, 0 };
+    return fp_parser_decode(p, report, sizeof(report));
+}
+
+void checks(){
+    struct fp_parser p;
+
+    check("footswitch descriptor compiles", fp_parser_compile(&p, footswitch_rdesc, sizeof(footswitch_rdesc)), 0);
+    check("factory 'b' pressed", keys(&p, 0, 0x05, 0, 0), 1 << 5);
+    check("released", keys(&p, 0, 0, 0, 0), 0);
+    check("short report ignored", fp_parser_decode(&p, (const uint8_t *)"\x01\x00\x00\x05", 4), 0);
+    check("unknown report ID ignored", fp_parser_decode(&p, (const uint8_t *)"\x09\x00\x00\x05\x00\x00\x00\x00\x00", 9), 0);
+    check("reprogrammed to F1", keys(&p, 0, 0x3a, 0, 0), 1 << 26);
+    check("reprogrammed to F1, released", keys(&p, 0, 0, 0, 0), 0);
+    check("reprogrammed to Ctrl", keys(&p, 0x01, 0, 0, 0), 1 << 0);
+
+    // a three pedal unit sends a, b and c
+    check("3 pedals: left", keys(&p, 0, 0x04, 0, 0), 1 << 4);
+    check("3 pedals: left and middle", keys(&p, 0, 0x04, 0x05, 0), 1 << 4 | 1 << 5);
+    check("3 pedals: middle", keys(&p, 0, 0x05, 0, 0), 1 << 5);
+    check("3 pedals: all three", keys(&p, 0, 0x05, 0x06, 0x04), 1 << 4 | 1 << 5 | 1 << 6);
+    check("3 pedals: right", keys(&p, 0, 0, 0, 0x06), 1 << 6);
+    check("3 pedals: rollover error ignored", keys(&p, 0, 0x01, 0x01, 0x01), 0);
+
+    // numbers don't depend on which pedal was pressed first, or on
+    // whether the descriptor was compiled again since
+    fp_parser_compile(&p, footswitch_rdesc, sizeof(footswitch_rdesc));
+    check("right pressed first after re-attach", keys(&p, 0, 0x06, 0, 0), 1 << 6);
+    check("then left", keys(&p, 0, 0x06, 0x04, 0), 1 << 4 | 1 << 6);
+    keys(&p, 0, 0, 0, 0);
+
+    // a mouse button on report 2 doesn't touch what report 1 holds
+    check("key, then", keys(&p, 0, 0x05, 0, 0), 1 << 5);
+    check("mouse button too", fp_parser_decode(&p, (const uint8_t *)"\x02\x01\x00\x00\x00", 5), 1 << 5 | 1 << 1);
+    check("mouse moves, button up", fp_parser_decode(&p, (const uint8_t *)"\x02\x00\x05\x00\x00", 5), 1 << 5);
+    check("key up", keys(&p, 0, 0, 0, 0), 0);
+
+    // left Shift (0xe1) and mouse button 1 share button 1: it's
+    // held as long as either report holds it
+    check("shift", keys(&p, 0x02, 0, 0, 0), 1 << 1);
+    check("and mouse button 1", fp_parser_decode(&p, (const uint8_t *)"\x02\x01\x00\x00\x00", 5), 1 << 1);
+    check("shift up, mouse button still down", keys(&p, 0, 0, 0, 0), 1 << 1);
+    check("mouse button up", fp_parser_decode(&p, (const uint8_t *)"\x02\x00\x00\x00\x00", 5), 0);
+
+    // no report IDs, one byte of 8 buttons
+    static const uint8_t buttons_rdesc[] = {
+        0x05, 0x09, 0x19, 0x01, 0x29, 0x08, 0x15, 0x00, 0x25, 0x01,
+        0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    };
+    check("buttons descriptor compiles", fp_parser_compile(&p, buttons_rdesc, sizeof(buttons_rdesc)), 0);
+    check("button 3", fp_parser_decode(&p, (const uint8_t *)"\x04", 1), 1 << 3);
+    check("buttons 3 and 8", fp_parser_decode(&p, (const uint8_t *)"\x84", 1), 1 << 3 | 1 << 8);
+
+    // the pedal's second interface has no buttons at all, and junk is junk
+    static const uint8_t second_rdesc[23] = {
+        0x05, 0x01, 0x09, 0x00, 0xa1, 0x01, 0x09, 0x01, 0x15, 0x00, 0x25, 0xff,
+        0x95, 0x08, 0x75, 0x08, 0x81, 0x02, 0x09, 0x01, 0x91, 0x02, 0xc0,
+    };
+    // 64 KiB of padding, then a button: its report can't fit in what the
+    // reader reads, and its length doesn't fit in fp_report.len either
+    uint8_t huge_rdesc[147], *d = huge_rdesc;
+    *d++ = 0x75; *d++ = 0x20;               // Report Size 32
+    *d++ = 0x96; *d++ = 0x00; *d++ = 0x01;  // Report Count 256
+    for(int i = 0; i < 64; i++){
+        *d++ = 0x81; *d++ = 0x01;           // Input (Constant)
+    }
+    static const uint8_t button[] = {
+        0x05, 0x09, 0x09, 0x01, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x01,
+        0x81, 0x02,
+    };
+    memcpy(d, button, sizeof(button));
+    check("report longer than 64 bytes falls back", fp_parser_compile(&p, huge_rdesc, sizeof(huge_rdesc)), -1);
+    check("and decodes without reading past it", fp_parser_decode(&p, (const uint8_t *)"\x00\x00", 2), 0);
+
+    check("second interface falls back", fp_parser_compile(&p, second_rdesc, sizeof(second_rdesc)), -1);
+    check("truncated descriptor falls back", fp_parser_compile(&p, footswitch_rdesc, 5), -1);
+    check("fallback: anything pressed", keys(&p, 0, 0x05, 0, 0), 1);
+    check("fallback: released", keys(&p, 0, 0, 0, 0), 0);
+}
+
+int main(int argc, char **argv){
+    long n = argc > 1 ? atol(argv[1]) : BENCH_REPORTS;
+    if(n <= 0){
+        fprintf(stderr, "usage: %s [reports]\n", argv[0]);
+        return 1;
+    }
+
+    checks();
+
+    uint8_t reports[2][9] = {
+        { 1, 0, 0, 0x05, 0, 0, 0, 0, 0 },
+        { 1, 0, 0, 0, 0, 0, 0, 0, 0 },
+    };
+    struct fp_parser p;
+    volatile uint32_t sink = 0;
+    uint64_t t;
+
+    t = now_ns();
+    for(long i = 0; i < n; i++){
+        const uint8_t *r = reports[i & 1];
+        sink += r[3] == 5;
+    }
+    double fixed = (double)(now_ns() - t) / n;
+
+    fp_parser_compile(&p, footswitch_rdesc, sizeof(footswitch_rdesc));
+    t = now_ns();
+    for(long i = 0; i < n; i++)
+        sink += fp_parser_decode(&p, reports[i & 1], 9);
+    double compiled = (double)(now_ns() - t) / n;
+
+    uint8_t three[9] = { 1, 0, 0, 0x04, 0x05, 0x06, 0, 0, 0 };
+    t = now_ns();
+    for(long i = 0; i < n; i++)
+        sink += fp_parser_decode(&p, i & 1 ? reports[1] : three, 9);
+    double compiled3 = (double)(now_ns() - t) / n;
+
+    // compiling is much slower, fewer rounds are plenty
+    long walks = n / 100 > 0 ? n / 100 : 1;
+    t = now_ns();
+    for(long i = 0; i < walks; i++){
+        fp_parser_compile(&p, footswitch_rdesc, sizeof(footswitch_rdesc));
+        sink += fp_parser_decode(&p, reports[i & 1], 9);
+    }
+    double walked = (double)(now_ns() - t) / walks;
+
+    printf("\n%ld reports\n", n);
+    printf("%-32s %8.1f ns/report\n", "fixed report[3] == 5", fixed);
+    printf("%-32s %8.1f ns/report\n", "compiled plan", compiled);
+    printf("%-32s %8.1f ns/report\n", "compiled plan, 3 keys held", compiled3);
+    printf("%-32s %8.1f ns/report\n", "walking the descriptor", walked);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,29 @@
+#!/bin/bash
+# Runs the reader with an artificially slow publisher (-s) against virtual
+# pedals, once reading and publishing in one thread and once with -p, at a
+# rate the publisher keeps up with and at one it can't. Shows how long
+# reports wait to be read and in the queue, and what the queue went
+# through. Needs root and the uhid module.
+
+READER_LOG=/tmp/footpedal-pipeline-reader.log
+. "$(dirname "$0")/bench_lib.sh"
+
+SLOW_US=${SLOW_US:-500}
+
+run() {
+  MODE=$1
+  shift
+  echo "== reader -s $SLOW_US $MODE, vpedal $*"
+  start_reader -s $SLOW_US $MODE
+  ./vpedal "$@" | grep '^latency'
+  ./fpstat | grep -E '^(reports|acquisition|queue|read|total)'
+  stop_reader
+  echo
+}
+
+# every report is an edge, so at 1000/s the publisher is busy half the
+# time and at 4000/s it falls behind
+for args in "-n 1 -c 2000 -r 1000" "-n 1 -c 4000 -r 4000"; do
+  run "" $args
+  run -p $args
+done
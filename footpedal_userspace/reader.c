@@ -1,128 +1,2618 @@
+/*
+ * usage: ./reader [-l] [-c cpu] [-b] [-p] [-a cpu] [-s usec] [-e [-g]]
+ *                 [-d press_ms[,release_ms] [-T]] [-w capture] [-r capture [-f]]
+ *
+ * -l is the low latency mode for busy machines: SCHED_FIFO, all memory
+ * locked and faulted in up front, so neither other processes nor page
+ * faults get between a report and its edge. -c pins the reader to a CPU,
+ * and -b spins on epoll instead of sleeping in it, which burns that CPU
+ * but saves the wakeup; only use it with -c on a core of its own.
+ *
+ * -d debounces every pedal (see debounce.h): after an edge, changes
+ * within press_ms (release_ms after a release, same as press_ms if not
+ * given) are chatter. By default the first edge goes out right away,
+ * -T only publishes a state once it held for the whole window.
+ * -w appends every raw report to a capture file (see capture.h) while
+ * serving pedals as usual. -r replays a capture through the same
+ * parse/publish path instead of reading pedals, at the pace it was
+ * recorded, or with -f as fast as possible, which makes it a benchmark
+ * of everything after read().
+ *
+ * Built with make IO_URING=1, pedals are read through io_uring instead of
+ * epoll (see ring_loop()), falling back to epoll if the kernel can't.
+ *
+ * -p splits the reader in two: an acquisition thread that only reads and
+ * timestamps reports and hands them over through a lock-free queue (see
+ * reportq.h), and the main thread that parses and publishes them, so slow
+ * outputs never hold up the next read(). -a pins the acquisition thread
+ * to a CPU and implies -p. -s usec makes every edge take that much longer
+ * to publish, to see what a slow publisher does to either mode.
+ *
+ * Where the two threads run, with -p:
+ *   neither -c nor -a    both go wherever the scheduler puts them
+ *   -c N                 main thread on N, acquisition thread on every
+ *                        other CPU (on N too if there's no other)
+ *   -a M                 acquisition thread on M, main thread anywhere
+ *   -c N -a M            main thread on N, acquisition thread on M
+ * -l makes both SCHED_FIFO. -b needs the acquisition thread on a CPU the
+ * main thread never uses, so -c N and either -a M with M != N or a second
+ * CPU; anything else is refused, as the spinning main thread would starve it.
+ *
+ * -e reads pedals through their evdev node (/dev/input/eventN) instead of
+ * hidraw: the kernel's HID driver (and hid_descriptor_remap.c or
+ * FootSwitch_BPF.c, if loaded) has already turned reports into key
+ * events, which come with the kernel's own timestamp. -g also grabs the
+ * pedal, so its keys stop reaching the desktop. Both work without root
+ * for anyone allowed to open the node. Raw reports aren't there to
+ * capture or queue, so -e doesn't go with -w, -r or -p.
+ *
+ * While it runs, the reader takes commands on FP_CTL_PATH (see
+ * footpedal_ctl.h and fpctl): stats, debounce and output changes,
+ * rescans, attaching and detaching nodes, and starting and stopping a
+ * capture, all without dropping the pedals it has. A thread of its own
+ * answers them, and hands the main thread only what changes its state.
+ */
+
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <sched.h>
+#include <malloc.h>
+#include <dirent.h>
+#include <linux/netlink.h>
+#include <linux/hidraw.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "footpedal_shm.h"
+#include "footpedal_stats.h"
+#include "footpedal_sub.h"
+#include "footpedal_ctl.h"
+#include "capture.h"
+#include "hidparse.h"
+#include "debounce.h"
+#include "reportq.h"
+#include "evdev.h"
+#ifdef FP_IO_URING
+#include "uring.h"
+#endif
+
+// hidraw hands us one whole report per read(); 64 bytes is the
+// largest report a full-speed interrupt endpoint can send
+#define REPORT_MAX 64
+#define MAX_EVENTS 8
+// clients holding an eventfd from FP_NOTIFY_PATH
+#define MAX_WAITERS 256
+// clients on FP_SUB_PATH, records each can have queued (a power of two)
+// and how many go out per sendmmsg()
+#define MAX_SUBSCRIBERS 1024
+#define SUB_QUEUE 128
+#define SUB_BATCH 32
+// clients on FP_CTL_PATH
+#define MAX_CONTROLLERS 16
+
+// SCHED_FIFO priority for -l: above ordinary threaded IRQs' 50, so the
+// report's interrupt thread can't be starved by us but everything else is
+#define RT_PRIORITY 49
+// stack -l faults in before it locks memory
+#define RT_STACK (256 * 1024)
+
+// io_uring backend: SQEs, and buffers every pedal's reads share
+#define RING_ENTRIES 128
+#define RING_BUFFERS 1024
+
+// input_events per read() with -e
+#define EVDEV_BATCH 64
+
+#ifndef SYSFS_HIDRAW
+#define SYSFS_HIDRAW "/sys/class/hidraw"
+#endif
+#ifndef SYSFS_INPUT
+#define SYSFS_INPUT "/sys/class/input"
+#endif
+
+// vendor and product IDs we serve, same as pedal_devices in hid_descriptor_remap.c
+struct usb_id {
+    unsigned vendor, product;
+};
+
+const struct usb_id pedal_ids[] = {
+    { 0x3553, 0xb001 }, // PCsensor FootSwitch
+    { 0x1a86, 0xe026 }, // QinHeng FootSwitch
+};
+
+struct fp_shm *shm = NULL;
+
+// everything we put in epoll starts with one of these, so the loop can
+// dispatch straight from epoll_event.data.ptr no matter how many pedals
+// and clients there are
+enum source_type {
+    SRC_SIGNAL,
+    SRC_NOTIFY,
+    SRC_WAITER,
+    SRC_PEDAL,
+    SRC_UEVENT,
+    SRC_TIMER,
+    SRC_SETTLE,
+    SRC_SUB_LISTEN,
+    SRC_SUBSCRIBER,
+    SRC_QUEUE,
+    SRC_CTL_LISTEN,
+    SRC_CTL,
+    SRC_CTL_JOB,
+};
+
+struct source {
+    enum source_type type;
+    int fd;
+};
+
+struct pedal {
+    struct source src;
+    int slot;
+    uint32_t state;     // buttons held, see hidparse.h
+    struct fp_parser parser;
+    struct fp_evdev keys;   // with -e instead of the parser
+    struct fp_debounce db;
+    struct source settle;   // timerfd for the end of its debounce window, -1 without debouncing
+    uint64_t armed;         // deadline settle is set to
+    uint32_t gen;           // bumped on every attach, so io_uring completions or queued reports for an old fd are ignored
+    struct acq_dev *acq;    // with -p, the acquisition thread's side of it
+    char node[32];  // e.g. hidraw0, or input/event3 with -e
+    char parent[32];    // with -e, the HID device behind node, see first_input()
+    uint64_t attached_ns;
+    uint64_t detached_ns;
+};
+
+// indexed by shm slot
+struct pedal pedals[FP_MAX_PEDALS];
+int num_pedals = 0;
+
+// hot path accounting, so we can see how many syscalls each report costs.
+// lives in FP_STATS_PATH so fpstat can look at it while we run
+struct fp_stats local_stats;
+struct fp_stats *stats = &local_stats;
+uint64_t start_ns;
+
+// raw reports go here when run with -w
+struct fp_cap_writer capture;
+
+// -d and -T
+struct fp_debounce_config debounce = { .mode = FP_DEBOUNCE_OFF };
+
+// outputs paused from the control socket
+bool notify_paused = false;
+bool sub_paused = false;
+
+// pedals are read through the io_uring backend, not epoll
+bool use_ring = false;
+
+// -e: pedals are read through their evdev node, not hidraw. -g grabs them
+bool use_evdev = false;
+bool grab = false;
+
+#ifdef FP_IO_URING
+struct fp_ring ring;
+
+// what a completion is for, in the top byte of its user_data. reads also
+// carry the pedal's gen and slot
+enum ring_op {
+    RING_READ = 1,
+    RING_SIGNAL,
+    RING_EPOLL,
+    RING_CANCEL,
+};
+
+#define RING_DATA(op, gen, slot) ((uint64_t)(op) << 56 | (uint64_t)((gen) & 0xffffff) << 32 | (uint32_t)(slot))
+#endif
+
+// -p: reports are read by the acquisition thread and reach us through
+// this queue
+bool pipeline = false;
+struct fp_rq queue;
+struct source queue_src = { .type = SRC_QUEUE, .fd = -1 };
+pthread_t acq_thread;
+int acq_cpu = -1;
+cpu_set_t acq_cpus;     // where it runs, see acq_placement()
+bool acq_pinned = false;
+int acq_epfd = -1;
+int acq_kick = -1;      // eventfd in acq_epfd, to get it to look at acq_stop and acq_retired
+atomic_bool acq_stop;
+// -s
+uint64_t slow_ns = 0;
+
+// a pedal as the acquisition thread sees it. it reads from a dup of the
+// pedal's fd, which only it closes, once we've retired the pedal, so the
+// number can't be reused under it
+struct acq_dev {
+    int fd;
+    int slot;
+    uint32_t gen;
+    bool gone;              // read() failed, already out of acq_epfd
+    struct acq_dev *next;   // on acq_retired
+};
+
+// pedals we detached, for the acquisition thread to free
+_Atomic(struct acq_dev *) acq_retired;
+
+// per-stage latency histograms cost two or three vDSO clock reads per
+// report; build with -DFP_NO_LATENCY_STATS (make LATENCY_STATS=0) to
+// compile them out completely
+#ifndef FP_NO_LATENCY_STATS
+#define LAT_NOW() now_ns()
+#define LAT_RECORD(stage, from, to) fp_hist_record(&stats->stages[stage], (to) - (from))
+#else
+#define LAT_NOW() 0
+#define LAT_RECORD(stage, from, to) do { (void)(from); (void)(to); } while(0)
+#endif
+
+uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// map the state segment, keeping the edge sequence of a previous run
+// if the segment is still there so consumers don't see it go backwards
+struct fp_shm* open_shm(){
+    int fd = open(FP_SHM_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd < 0)
+        return NULL;
+    // consumers only ever read it. an older reader made it world-writable
+    fchmod(fd, 0644);
+
+    // never shrink the file under a consumer that already has it mapped
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (st.st_size < (off_t)sizeof(struct fp_shm) && ftruncate(fd, sizeof(struct fp_shm)) < 0)){
+        close(fd);
+        return NULL;
+    }
+
+    struct fp_shm *s = mmap(NULL, sizeof(struct fp_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(s == MAP_FAILED)
+        return NULL;
+
+    fp_shm_init(s, now_ns());
+    return s;
+}
+
+// map the stats page, starting from zero every run
+struct fp_stats* open_stats(){
+    int fd = open(FP_STATS_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd < 0)
+        return NULL;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (st.st_size < (off_t)sizeof(struct fp_stats) && ftruncate(fd, sizeof(struct fp_stats)) < 0)){
+        close(fd);
+        return NULL;
+    }
+
+    struct fp_stats *s = mmap(NULL, sizeof(struct fp_stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(s == MAP_FAILED)
+        return NULL;
+
+    memset(s, 0, sizeof(*s));
+    s->version = FP_STATS_VERSION;
+    s->size = sizeof(struct fp_stats);
+#ifndef FP_NO_LATENCY_STATS
+    s->latency = 1;
+#endif
+    s->magic = FP_STATS_MAGIC;
+    return s;
+}
+
+// every client that connects to FP_NOTIFY_PATH gets its own eventfd,
+// which we bump on each edge so it can poll()/epoll on it
+struct waiter {
+    struct source src;  // the connection, only kept to notice the client leaving
+    int efd;
+    int index;
+};
+
+struct waiter *waiters[MAX_WAITERS];
+int num_waiters = 0;
+
+int notify_listen(){
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, FP_NOTIFY_PATH, sizeof(addr.sun_path) - 1);
+    unlink(FP_NOTIFY_PATH);
+
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0){
+        close(fd);
+        return -1;
+    }
+
+    // consumers don't need root, same as the shm segment
+    chmod(FP_NOTIFY_PATH, 0666);
+    return fd;
+}
+
+void notify_accept(int epfd, int listen_fd){
+    int conn;
+    while((conn = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0){
+        int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct waiter *w = malloc(sizeof(*w));
+        if(num_waiters == MAX_WAITERS || efd < 0 || w == NULL){
+            if(efd >= 0)
+                close(efd);
+            free(w);
+            close(conn);
+            continue;
+        }
+
+        char ok = 1;
+        struct iovec iov = { .iov_base = &ok, .iov_len = 1 };
+        union {
+            struct cmsghdr hdr;
+            char buf[CMSG_SPACE(sizeof(int))];
+        } ctrl;
+        struct msghdr msg = {
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = ctrl.buf,
+            .msg_controllen = sizeof(ctrl.buf),
+        };
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &efd, sizeof(int));
+
+        w->src.type = SRC_WAITER;
+        w->src.fd = conn;
+        w->efd = efd;
+
+        struct epoll_event ev = { .events = EPOLLRDHUP, .data.ptr = w };
+        if(sendmsg(conn, &msg, MSG_NOSIGNAL) != 1 || epoll_ctl(epfd, EPOLL_CTL_ADD, conn, &ev) < 0){
+            close(efd);
+            close(conn);
+            free(w);
+            continue;
+        }
 
-int min(int a, int b){
-    return a < b ? a : b;
+        w->index = num_waiters;
+        waiters[num_waiters++] = w;
+    }
+}
+
+void notify_drop(struct waiter *w){
+    close(w->src.fd);
+    close(w->efd);
+    waiters[w->index] = waiters[--num_waiters];
+    waiters[w->index]->index = w->index;
+    free(w);
 }
 
-char buf[100], buf2[200];
+void notify_waiters(){
+    if(notify_paused)
+        return;
 
-FILE* output;
+    uint64_t one = 1;
+    for(int i = 0; i < num_waiters; i++){
+        write(waiters[i]->efd, &one, sizeof(one));
+        stats->syscalls++;
+    }
+}
 
-char* strs[] = {
-    "0",
-    "1"
+// pub/sub clients on FP_SUB_PATH, see footpedal_sub.h. a record goes out
+// with one send per client if its socket has room, otherwise it waits in
+// that client's queue for EPOLLOUT, and once the queue is full the client
+// loses records. nothing a client does can hold up the others or us
+struct subscriber {
+    struct source src;
+    int index;
+    bool dead;          // a send failed, dropped once its hangup comes in
+    uint64_t pedals;
+    uint32_t events;
+    uint64_t seq;       // number of the last record it was due
+    uint64_t gap;       // records lost since the last one that was queued
+    uint64_t gap_seq;   // first of those
+    uint64_t gap_ns;
+    uint64_t dropped;
+    unsigned head, tail;
+    struct fp_sub_record queue[SUB_QUEUE];
 };
 
-bool current_state = false;
+struct subscriber *subscribers[MAX_SUBSCRIBERS];
+int num_subscribers = 0;
+
+int sub_listen(){
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, FP_SUB_PATH, sizeof(addr.sun_path) - 1);
+    unlink(FP_SUB_PATH);
+
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0){
+        close(fd);
+        return -1;
+    }
+    chmod(FP_SUB_PATH, 0666);
+
+    // every subscriber is an fd, and the default soft limit of 1024 would
+    // run out before MAX_SUBSCRIBERS does
+    struct rlimit rl;
+    if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max){
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    return fd;
+}
+
+void sub_accept(int epfd, int listen_fd){
+    int conn;
+    while((conn = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0){
+        struct subscriber *s = calloc(1, sizeof(*s));
+        if(num_subscribers == MAX_SUBSCRIBERS || s == NULL){
+            free(s);
+            close(conn);
+            continue;
+        }
+        s->src.type = SRC_SUBSCRIBER;
+        s->src.fd = conn;
+
+        // edge triggered, so a full socket costs no epoll_ctl() to wait
+        // for room, only the EPOLLOUT when it drains
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = s };
+        if(epoll_ctl(epfd, EPOLL_CTL_ADD, conn, &ev) < 0){
+            close(conn);
+            free(s);
+            continue;
+        }
+        s->index = num_subscribers;
+        subscribers[num_subscribers++] = s;
+        stats->subscribers = num_subscribers;
+    }
+}
+
+void sub_drop(struct subscriber *s){
+    close(s->src.fd);
+    subscribers[s->index] = subscribers[--num_subscribers];
+    subscribers[s->index]->index = s->index;
+    stats->subscribers = num_subscribers;
+    free(s);
+}
 
-void set_state(bool b){
-    //output = fopen("/dev/shm/footpedal", "w+");
-    //fprintf(output, b ? "1" : "0");
-    if(current_state != b){
-        rewind(output);
-        fwrite(strs[b], strlen(strs[b]), 1, output);
-        fflush(output);
+// new subscriptions. false if the client hung up
+bool sub_requests(struct subscriber *s){
+    struct fp_sub_request req;
+    while(true){
+        ssize_t len = recv(s->src.fd, &req, sizeof(req), 0);
+        stats->syscalls++;
+        if(len == 0)
+            return false;
+        if(len < 0)
+            return errno == EAGAIN;
+        if(len == sizeof(req)){
+            s->pedals = req.pedals;
+            s->events = req.events;
+        }
     }
-    //fclose(output);
-    current_state = b;
 }
 
-int main(){
-    FILE *fp;
-    char path[1035];
+// send what's queued, as far as the socket takes it
+void sub_flush(struct subscriber *s){
+    while(s->head != s->tail && !s->dead){
+        struct mmsghdr msgs[SUB_BATCH];
+        struct iovec iov[SUB_BATCH];
+        int n = 0;
+        for(unsigned i = s->head; i != s->tail && n < SUB_BATCH; i++, n++){
+            iov[n].iov_base = &s->queue[i & (SUB_QUEUE - 1)];
+            iov[n].iov_len = sizeof(struct fp_sub_record);
+            memset(&msgs[n], 0, sizeof(msgs[n]));
+            msgs[n].msg_hdr.msg_iov = &iov[n];
+            msgs[n].msg_hdr.msg_iovlen = 1;
+        }
 
-    /* Open the command for reading. */
-    fp = popen("./get_hiddevices.sh", "r");
-    if (fp == NULL) {
-        printf("Failed to run command\n" );
-        exit(1);
+        int sent = sendmmsg(s->src.fd, msgs, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+        stats->syscalls++;
+        if(sent < 0){
+            if(errno != EAGAIN && errno != EINTR)
+                s->dead = true;
+            return;
+        }
+        s->head += sent;
+        stats->sub_records += sent;
+        if(sent < n)
+            return;
     }
+}
 
-    int num_chars = 0;
+void sub_queue(struct subscriber *s, const struct fp_sub_record *rec){
+    s->queue[s->tail++ & (SUB_QUEUE - 1)] = *rec;
+}
 
-    char min_name[100];
-    bool set = false;
+// hand rec to every client that wants it
+void sub_publish(int type, int pedal, uint32_t state, uint64_t edge, uint64_t time_ns){
+    for(int i = 0; i < num_subscribers; i++){
+        struct subscriber *s = subscribers[i];
+        if(s->dead || !(s->events & type) || !((s->pedals >> pedal) & 1))
+            continue;
 
-    /* Read the output a line at a time - output it. */
-    while (fgets(path, sizeof(path), fp) != NULL) {
-        sscanf(path, "%100s %n", buf, &num_chars);
-        strncpy(buf2, path + num_chars, min(200, strlen(path) - num_chars));
-        
-        //printf("hidraw: %s\n", buf);
-        //printf("name: %s\n", buf2);
+        struct fp_sub_record rec = {
+            .seq = ++s->seq,
+            .time_ns = time_ns,
+            .edge = edge,
+            .state = state,
+            .pedal = pedal,
+            .type = type,
+        };
 
-        // possible names are:
-        // PCsensor FootSwitch
-        // QinHeng Electronics FootSwitch
-        if(strstr(buf2, "FootSwitch") != NULL){
-            if(!set || strcmp(buf, min_name) < 0){
-                strcpy(min_name, buf);
-                set = true;
+        // room for it, and for the gap record in front of it. while
+        // paused, everything is lost the same way
+        bool queued = s->head != s->tail;
+        if(sub_paused || s->tail - s->head + (s->gap ? 2 : 1) > SUB_QUEUE){
+            if(s->gap++ == 0){
+                s->gap_seq = rec.seq;
+                s->gap_ns = time_ns;
             }
+            s->dropped++;
+            stats->sub_dropped++;
+            continue;
+        }
+        if(s->gap){
+            struct fp_sub_record gap = {
+                .seq = s->gap_seq,
+                .time_ns = s->gap_ns,
+                .state = s->gap,
+                .pedal = pedal,
+                .type = FP_SUB_GAP,
+            };
+            sub_queue(s, &gap);
+            s->gap = 0;
+        }
+        sub_queue(s, &rec);
+
+        // with records already waiting the socket is full, EPOLLOUT will
+        // tell us when it isn't
+        if(!queued)
+            sub_flush(s);
+    }
+}
+
+void set_state(struct pedal *p, uint32_t b){
+    if(p->state != b){
+        uint64_t t = now_ns();
+        uint64_t seq = fp_shm_publish(shm, p->slot, b, t);
+        stats->syscalls++;
+        stats->edges++;
+        notify_waiters();
+
+        int type = (b & ~p->state ? FP_SUB_PRESS : 0) | (p->state & ~b ? FP_SUB_RELEASE : 0);
+        sub_publish(type, p->slot, b, seq, t);
+
+        // -s: stand-in for outputs that take their time
+        if(slow_ns > 0){
+            struct timespec ts = { slow_ns / 1000000000ull, slow_ns % 1000000000ull };
+            nanosleep(&ts, NULL);
         }
     }
+    p->state = b;
+}
 
-    /* close */
-    pclose(fp);
+// end p's debounce window if it's over at t, publishing what the pedal
+// settled on
+void settle(struct pedal *p, uint64_t t){
+    uint64_t filtered = p->db.filtered;
+    uint32_t buttons;
 
-    printf("best: %s\n", min_name);
+    if(fp_debounce_expire(&p->db, &debounce, t, &buttons)){
+        LAT_RECORD(FP_STAGE_DEBOUNCE, p->db.raw_ns, t);
+        set_state(p, buttons);
+    }
+    stats->filtered += p->db.filtered - filtered;
+}
 
-    char target[106];
+// point p's timerfd at the end of its window, if that moved
+void arm_settle(struct pedal *p){
+    if(p->settle.fd < 0 || p->db.deadline == p->armed)
+        return;
 
-    sprintf(target, "/dev/%s", min_name);
+    struct itimerspec its = { .it_value = { p->db.deadline / 1000000000ull, p->db.deadline % 1000000000ull } };
+    timerfd_settime(p->settle.fd, TFD_TIMER_ABSTIME, &its, NULL);
+    stats->syscalls++;
+    p->armed = p->db.deadline;
+}
 
-    printf("target file: %s\n", target);
-    FILE* device = fopen(target, "r");
+// t_start is when we started working towards this report: the epoll
+// wakeup for the first report of a burst, otherwise the end of the last
+// one. t is when the report came in, for debouncing
+void handle_buttons(struct pedal *p, uint32_t buttons, uint64_t t_start, uint64_t t_parsed, uint64_t t){
+    if(stats->reports++ == 0)
+        stats->first_report_ns = now_ns() - start_ns;
 
-    printf("writing to: /dev/shm/footpedal\n");
+    if(debounce.mode != FP_DEBOUNCE_OFF){
+        // a window that ran out before this report, in case its timer didn't fire yet
+        settle(p, t);
 
-    if(device == NULL){
-        printf("Error: device is null! Make sure the pedal is plugged in and you are running this program in root mode (sudo).\n");
-        return 0;
+        uint64_t filtered = p->db.filtered;
+        bool publish = fp_debounce_report(&p->db, &debounce, buttons, t, &buttons);
+        stats->filtered += p->db.filtered - filtered;
+        if(!publish)
+            return;
+        LAT_RECORD(FP_STAGE_DEBOUNCE, t, t);
     }
 
-    char stdin_buf[20];
-    fcntl(0, F_SETFL, fcntl(0, F_GETFL) | O_NONBLOCK);
+    if(buttons != p->state){
+        set_state(p, buttons);
+        uint64_t t_done = LAT_NOW();
+        LAT_RECORD(FP_STAGE_PUBLISH, t_parsed, t_done);
+        LAT_RECORD(FP_STAGE_TOTAL, t_start, t_done);
+    }
+}
 
-    int curr_buf[9];
+void handle_report(struct pedal *p, const unsigned char *report, ssize_t len, uint64_t t_start, uint64_t t_read, uint64_t t){
+    uint32_t buttons = fp_parser_decode(&p->parser, report, len);
+    uint64_t t_parsed = LAT_NOW();
+    LAT_RECORD(FP_STAGE_PARSE, t_read, t_parsed);
+    handle_buttons(p, buttons, t_start, t_parsed, t);
+}
 
-    output = fopen("/dev/shm/footpedal", "w+");
+// a report just came in from either backend
+void got_report(struct pedal *p, const unsigned char *report, ssize_t len, uint64_t t_start){
+    uint64_t t_read = LAT_NOW();
+    LAT_RECORD(FP_STAGE_READ, t_start, t_read);
+    if(capture.f != NULL)
+        fp_cap_write(&capture, now_ns(), FP_CAP_REPORT, p->slot, report, len);
+    handle_report(p, report, len, t_start, t_read, debounce.mode != FP_DEBOUNCE_OFF ? now_ns() : 0);
+}
 
-    // assume that the pedal is not being pressed when this
-    // program is started
-    set_state(0);
+// read every report that is queued on the device, so one epoll wakeup
+// can service a whole burst. returns -1 if the device went away
+int drain_device(struct pedal *p, uint64_t t_wake){
+    unsigned char report[REPORT_MAX];
+    uint64_t t_start = t_wake;
 
     while(true){
-        for(int i = 0; i < 9; i++)
-            curr_buf[i] = fgetc(device);
-
-        //rewind(output);
-        //fseek(output, 0L, SEEK_SET); // move the offset back to start of file
-        
-        if(curr_buf[3] == 5){
-            set_state(1);
-            //fprintf(output, "1");
-            //printf("press\n");
-        }else{
-            set_state(0);
-            //fprintf(output, "0");
-            //printf("release\n");
+        ssize_t len = read(p->src.fd, report, sizeof(report));
+        stats->syscalls++;
+
+        if(len > 0){
+            got_report(p, report, len, t_start);
+            t_start = LAT_NOW();
+            continue;
         }
-        //fclose(output);
 
-        int numRead = read(0, stdin_buf, 4);
-        if (numRead > 0) {
-            break;
+        if(len < 0 && errno == EINTR)
+            continue;
+        if(len < 0 && errno == EAGAIN){
+            arm_settle(p);
+            return 0;
+        }
+
+        return -1;
+    }
+}
+
+// -e: read the pedal's input events a batch at a time. every packet (up
+// to its SYN_REPORT) is a report, debounced and timed from the kernel's
+// timestamp on it
+int drain_evdev(struct pedal *p, uint64_t t_wake){
+    struct input_event evs[EVDEV_BATCH];
+    uint64_t t_start = t_wake;
+
+    while(true){
+        ssize_t len = read(p->src.fd, evs, sizeof(evs));
+        stats->syscalls++;
+
+        if(len > 0){
+            uint64_t t_read = LAT_NOW();
+            LAT_RECORD(FP_STAGE_READ, t_start, t_read);
+
+            for(size_t i = 0; i < len / sizeof(evs[0]); i++){
+                uint32_t buttons;
+                uint64_t t = fp_evdev_time(&evs[i]);
+
+                switch(fp_evdev_event(&p->keys, &evs[i], &buttons)){
+                case FP_EVDEV_NONE:
+                    continue;
+                case FP_EVDEV_PACKET:
+                    LAT_RECORD(FP_STAGE_KERNEL, t, t_read);
+                    break;
+                case FP_EVDEV_RESYNC: {
+                    // the events in between are gone, ask what's held now
+                    unsigned char keys[KEY_MAX / 8 + 1] = { 0 };
+                    ioctl(p->src.fd, EVIOCGKEY(sizeof(keys)), keys);
+                    stats->syscalls++;
+                    stats->evdev_resyncs++;
+                    buttons = fp_evdev_resync(&p->keys, keys, sizeof(keys));
+                    break;
+                }
+                }
+                handle_buttons(p, buttons, t_start, t_read, t);
+            }
+            t_start = LAT_NOW();
+            continue;
+        }
+
+        if(len < 0 && errno == EINTR)
+            continue;
+        if(len < 0 && errno == EAGAIN){
+            arm_settle(p);
+            return 0;
+        }
+
+        return -1;
+    }
+}
+
+// -p: the acquisition thread's next entry in the queue. if the main thread
+// is that far behind, wait for it instead of losing reports. NULL if we're
+// shutting down meanwhile
+struct fp_rq_entry *acq_slot(){
+    struct fp_rq_entry *e = fp_rq_slot(&queue);
+    if(e != NULL)
+        return e;
+
+    uint64_t t = now_ns();
+    stats->queue_full++;
+    // it may not know about what we queued since the last wakeup yet
+    if(fp_rq_kick(&queue)){
+        stats->queue_kicks++;
+        stats->acq_syscalls++;
+    }
+    while((e = fp_rq_slot(&queue)) == NULL){
+        if(atomic_load(&acq_stop))
+            return NULL;
+        fp_rq_wait_space(&queue);
+        stats->acq_syscalls++;
+    }
+    stats->queue_full_ns += now_ns() - t;
+    return e;
+}
+
+// read every report queued on d straight into the queue
+void acq_drain(struct acq_dev *d, uint32_t events, uint64_t t_wake){
+    uint64_t t_start = t_wake;
+    struct fp_rq_entry *e;
+
+    while(true){
+        e = acq_slot();
+        if(e == NULL)
+            return;
+        ssize_t len = read(d->fd, e->data, sizeof(e->data));
+        stats->acq_syscalls++;
+
+        if(len > 0){
+            e->wake_ns = t_wake;
+            e->time_ns = now_ns();
+            e->gen = d->gen;
+            e->pedal = d->slot;
+            e->len = len;
+            LAT_RECORD(FP_STAGE_READ, t_start, e->time_ns);
+
+            uint32_t depth = fp_rq_depth(&queue);
+            stats->queue_depth_sum += depth;
+            if(depth > stats->queue_depth_max)
+                stats->queue_depth_max = depth;
+            stats->queue_pushes++;
+            fp_rq_push(&queue);
+            t_start = e->time_ns;
+            continue;
+        }
+
+        if(len < 0 && errno == EINTR)
+            continue;
+        if(len < 0 && errno == EAGAIN && !(events & (EPOLLHUP | EPOLLERR)))
+            return;
+        break;
+    }
+
+    // gone. an empty report tells the main thread to detach it, and we
+    // stop reading it until that retires it
+    e->wake_ns = t_wake;
+    e->time_ns = now_ns();
+    e->gen = d->gen;
+    e->pedal = d->slot;
+    e->len = 0;
+    fp_rq_push(&queue);
+    epoll_ctl(acq_epfd, EPOLL_CTL_DEL, d->fd, NULL);
+    stats->acq_syscalls++;
+    d->gone = true;
+}
+
+// free what the main thread detached. nothing we queued before can
+// refer to them by pointer, only by slot and gen
+void acq_free_retired(){
+    struct acq_dev *d = atomic_exchange(&acq_retired, NULL);
+    while(d != NULL){
+        struct acq_dev *next = d->next;
+        close(d->fd);
+        free(d);
+        d = next;
+    }
+}
+
+void *acquire(void *arg){
+    (void)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    if(acq_pinned){
+        if(pthread_setaffinity_np(pthread_self(), sizeof(acq_cpus), &acq_cpus) != 0)
+            printf("Warning: could not move the acquisition thread to its CPUs\n");
+        else if(CPU_COUNT(&acq_cpus) > 1)
+            printf("acquisition thread on %d CPUs\n", CPU_COUNT(&acq_cpus));
+        else
+            for(int i = 0; i < CPU_SETSIZE; i++)
+                if(CPU_ISSET(i, &acq_cpus))
+                    printf("acquisition thread pinned to CPU %d\n", i);
+    }
+
+    while(!atomic_load(&acq_stop)){
+        acq_free_retired();
+
+        int n = epoll_wait(acq_epfd, events, MAX_EVENTS, -1);
+        uint64_t t_wake = now_ns();
+        stats->acq_syscalls++;
+        if(n <= 0)
+            continue;
+        stats->acq_wakeups++;
+
+        for(int i = 0; i < n; i++){
+            struct acq_dev *d = events[i].data.ptr;
+            if(d == NULL){
+                uint64_t v;
+                read(acq_kick, &v, sizeof(v));
+                stats->acq_syscalls++;
+            }else if(!d->gone){
+                acq_drain(d, events[i].events, t_wake);
+            }
+        }
+
+        // one kick per wakeup at most, and none while the main thread is
+        // busy anyway
+        if(fp_rq_kick(&queue)){
+            stats->queue_kicks++;
+            stats->acq_syscalls++;
         }
     }
+    acq_free_retired();
+    return NULL;
+}
 
-    fclose(device);
-    fclose(output);
+// -p: the queue in our epoll, and the acquisition thread with its own
+int start_acquisition(int epfd){
+    acq_epfd = epoll_create1(EPOLL_CLOEXEC);
+    acq_kick = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(acq_epfd < 0 || acq_kick < 0 || fp_rq_init(&queue) < 0)
+        return -1;
 
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(acq_epfd, EPOLL_CTL_ADD, acq_kick, &ev);
+    queue_src.fd = queue.efd;
+    ev.data.ptr = &queue_src;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, queue.efd, &ev);
+
+    // inherits -l's SCHED_FIFO, and acquire() moves it off -c's CPU
+    int ret = pthread_create(&acq_thread, NULL, acquire, NULL);
+    if(ret != 0){
+        errno = ret;
+        return -1;
+    }
+    printf("pipeline mode: acquisition thread, %d report queue\n", FP_RQ_SIZE);
     return 0;
-}
\ No newline at end of file
+}
+
+void stop_acquisition(){
+    atomic_store(&acq_stop, true);
+    uint64_t one = 1;
+    write(acq_kick, &one, sizeof(one));
+    // what's left is dropped. that also wakes it if it's waiting for room
+    while(fp_rq_peek(&queue) != NULL)
+        fp_rq_pop(&queue);
+    pthread_join(acq_thread, NULL);
+    close(acq_kick);
+    close(acq_epfd);
+    close(queue.efd);
+}
+
+#ifdef FP_IO_URING
+// keep a read posted on p until it's cancelled or the pedal goes away.
+// the fd is fixed file p->slot, and every report lands in whichever of
+// the shared buffers the kernel picks
+void ring_read(struct pedal *p){
+    struct io_uring_sqe *sqe = fp_ring_sqe(&ring);
+    sqe->opcode = FP_OP_READ_MULTISHOT;
+    sqe->fd = p->slot;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = RING_DATA(RING_READ, p->gen, p->slot);
+}
+#endif
+
+// start reading p with whichever backend we use
+void watch_pedal(int epfd, struct pedal *p){
+#ifdef FP_IO_URING
+    if(use_ring){
+        fp_ring_set_file(&ring, p->slot, p->src.fd);
+        stats->syscalls++;
+        ring_read(p);
+        return;
+    }
+#endif
+    if(pipeline){
+        struct acq_dev *d = calloc(1, sizeof(*d));
+        if(d == NULL)
+            return;
+        d->fd = fcntl(p->src.fd, F_DUPFD_CLOEXEC, 0);
+        d->slot = p->slot;
+        d->gen = p->gen;
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = d };
+        if(d->fd < 0 || epoll_ctl(acq_epfd, EPOLL_CTL_ADD, d->fd, &ev) < 0){
+            perror("Warning: could not hand the pedal to the acquisition thread");
+            if(d->fd >= 0)
+                close(d->fd);
+            free(d);
+            return;
+        }
+        p->acq = d;
+        return;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = p };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, p->src.fd, &ev);
+}
+
+void unwatch_pedal(int epfd, struct pedal *p){
+#ifdef FP_IO_URING
+    if(use_ring){
+        // the fixed file holds its own reference, so closing the fd alone
+        // wouldn't stop the read
+        struct io_uring_sqe *sqe = fp_ring_sqe(&ring);
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = RING_DATA(RING_READ, p->gen, p->slot);
+        sqe->user_data = RING_DATA(RING_CANCEL, 0, 0);
+        fp_ring_set_file(&ring, p->slot, -1);
+        stats->syscalls++;
+        return;
+    }
+#endif
+    if(pipeline){
+        // out of its epoll right away, but the acquisition thread may be
+        // reading it this very moment, so it frees it on its next wakeup
+        struct acq_dev *d = p->acq;
+        p->acq = NULL;
+        if(d == NULL)
+            return;
+        epoll_ctl(acq_epfd, EPOLL_CTL_DEL, d->fd, NULL);
+        d->next = atomic_load(&acq_retired);
+        while(!atomic_compare_exchange_weak(&acq_retired, &d->next, d))
+            ;
+        uint64_t one = 1;
+        write(acq_kick, &one, sizeof(one));
+        stats->syscalls += 2;
+        return;
+    }
+    epoll_ctl(epfd, EPOLL_CTL_DEL, p->src.fd, NULL);
+}
+
+struct hid_info {
+    unsigned vendor, product;
+    char id[FP_ID_LEN];
+    char parent[32];    // with -e, e.g. 0003:1A86:E026.0005, empty for uinput devices
+};
+
+// read the HID device's uevent behind a hidraw node. the stable name for
+// a pedal is its USB serial if it has one, otherwise the USB path it's
+// plugged into
+bool read_hid_info(const char *node, struct hid_info *info){
+    char path[128], line[256];
+    char phys[FP_ID_LEN] = "", uniq[FP_ID_LEN] = "";
+    unsigned bus;
+    bool found = false;
+
+    snprintf(path, sizeof(path), SYSFS_HIDRAW "/%s/device/uevent", node);
+    FILE *f = fopen(path, "r");
+    if(f == NULL)
+        return false;
+
+    while(fgets(line, sizeof(line), f) != NULL){
+        line[strcspn(line, "\n")] = '\0';
+        // HID_ID=0003:00001A86:0000E026
+        if(strncmp(line, "HID_ID=", 7) == 0)
+            found = sscanf(line + 7, "%x:%x:%x", &bus, &info->vendor, &info->product) == 3;
+        else if(strncmp(line, "HID_PHYS=", 9) == 0)
+            snprintf(phys, sizeof(phys), "%.*s", (int)sizeof(phys) - 1, line + 9);
+        else if(strncmp(line, "HID_UNIQ=", 9) == 0)
+            snprintf(uniq, sizeof(uniq), "%.*s", (int)sizeof(uniq) - 1, line + 9);
+    }
+    fclose(f);
+
+    snprintf(info->id, sizeof(info->id), "%s", uniq[0] ? uniq : phys[0] ? phys : node);
+    info->parent[0] = '\0';
+    return found;
+}
+
+// the same for the input device behind an evdev node (-e), e.g.
+// input/event3. it has the HID device's serial and path, so a pedal gets
+// the same slot whichever backend reads it
+bool read_input_info(const char *node, struct hid_info *info){
+    char path[128], line[256];
+    char phys[FP_ID_LEN] = "", uniq[FP_ID_LEN] = "";
+    unsigned bus;
+    bool found = false;
+
+    snprintf(path, sizeof(path), SYSFS_INPUT "/%s/device/uevent", node + strlen("input/"));
+    FILE *f = fopen(path, "r");
+    if(f == NULL)
+        return false;
+
+    while(fgets(line, sizeof(line), f) != NULL){
+        line[strcspn(line, "\n")] = '\0';
+        // PRODUCT=3/1a86/e026/110, PHYS="usb-0000:00:14.0-2/input0"
+        char *value = strchr(line, '=');
+        if(value == NULL)
+            continue;
+        value++;
+        if(*value == '"'){
+            value++;
+            value[strcspn(value, "\"")] = '\0';
+        }
+
+        if(strncmp(line, "PRODUCT=", 8) == 0)
+            found = sscanf(value, "%x/%x/%x", &bus, &info->vendor, &info->product) == 3;
+        else if(strncmp(line, "PHYS=", 5) == 0)
+            snprintf(phys, sizeof(phys), "%.*s", (int)sizeof(phys) - 1, value);
+        else if(strncmp(line, "UNIQ=", 5) == 0)
+            snprintf(uniq, sizeof(uniq), "%.*s", (int)sizeof(uniq) - 1, value);
+    }
+    fclose(f);
+
+    snprintf(info->id, sizeof(info->id), "%s", uniq[0] ? uniq : phys[0] ? phys : node);
+
+    // eventN/device is the input device, and its device the HID one
+    char link[256];
+    snprintf(path, sizeof(path), SYSFS_INPUT "/%s/device/device", node + strlen("input/"));
+    ssize_t n = readlink(path, link, sizeof(link) - 1);
+    link[n > 0 ? n : 0] = '\0';
+    const char *base = strrchr(link, '/');
+    snprintf(info->parent, sizeof(info->parent), "%.*s", (int)sizeof(info->parent) - 1, base ? base + 1 : link);
+    if(strchr(info->parent, ':') == NULL)
+        info->parent[0] = '\0';
+    return found;
+}
+
+// whether an input device (a directory like .../input/input12) has the
+// keyboard's keys. capabilities/key is a bitmap in hex words, highest
+// first, so KEY_A is in the last one
+bool keyboard_input(const char *dir){
+    char path[256], line[1024];
+    snprintf(path, sizeof(path), "%s/capabilities/key", dir);
+    FILE *f = fopen(path, "r");
+    if(f == NULL)
+        return false;
+    bool found = fgets(line, sizeof(line), f) != NULL;
+    fclose(f);
+    if(!found)
+        return false;
+
+    line[strcspn(line, "\n")] = '\0';
+    const char *last = strrchr(line, ' ');
+    unsigned long long bits = strtoull(last ? last + 1 : line, NULL, 16);
+    return bits & (1ull << KEY_A);
+}
+
+// -e: hid-generic gives a pedal an input device per application in its
+// descriptor (Keyboard, Mouse, Consumer Control, System Control), each
+// with an evdev node and all with the same PHYS and UNIQ, so each would
+// take a slot of its own. only one node per HID device is the pedal: the
+// keyboard one if it has one, otherwise whichever comes first
+bool first_input(const char *node, const struct hid_info *info){
+    if(info->parent[0] == '\0')
+        return true;
+    for(int i = 0; i < FP_MAX_PEDALS; i++){
+        if(pedals[i].src.type == SRC_PEDAL && pedals[i].src.fd >= 0 && strcmp(pedals[i].parent, info->parent) == 0)
+            return false;
+    }
+
+    char dir[256];
+    snprintf(dir, sizeof(dir), SYSFS_INPUT "/%s/device", node + strlen("input/"));
+    if(keyboard_input(dir))
+        return true;
+
+    // a sibling with the keyboard's keys gets the slot instead
+    snprintf(dir, sizeof(dir), SYSFS_INPUT "/%s/device/device/input", node + strlen("input/"));
+    DIR *d = opendir(dir);
+    if(d == NULL)
+        return true;
+    bool sibling = false;
+    struct dirent *e;
+    while(!sibling && (e = readdir(d)) != NULL){
+        char sib[sizeof(dir) + 72];
+        snprintf(sib, sizeof(sib), "%s/%.64s", dir, e->d_name);
+        sibling = strncmp(e->d_name, "input", 5) == 0 && keyboard_input(sib);
+    }
+    closedir(d);
+    return !sibling;
+}
+
+bool is_pedal(const struct hid_info *info){
+    for(size_t i = 0; i < sizeof(pedal_ids) / sizeof(pedal_ids[0]); i++){
+        if(info->vendor == pedal_ids[i].vendor && info->product == pedal_ids[i].product)
+            return true;
+    }
+    return false;
+}
+
+struct pedal *find_pedal(const char *node){
+    for(int i = 0; i < FP_MAX_PEDALS; i++){
+        if(pedals[i].src.type == SRC_PEDAL && pedals[i].src.fd >= 0 && strcmp(pedals[i].node, node) == 0)
+            return &pedals[i];
+    }
+    return NULL;
+}
+
+// give p a timerfd for the end of its debounce windows, if it needs one
+// and doesn't have it yet. the io_uring backend ends windows with its
+// wait timeout instead
+void settle_timer(int epfd, struct pedal *p){
+    if(debounce.mode == FP_DEBOUNCE_OFF || use_ring || p->settle.fd >= 0)
+        return;
+
+    p->settle.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &p->settle };
+    if(p->settle.fd >= 0)
+        epoll_ctl(epfd, EPOLL_CTL_ADD, p->settle.fd, &ev);
+}
+
+// -e: get an evdev node ready to be read. false if it isn't one of a
+// pedal's keyboards after all
+bool evdev_setup(int fd, const char *target){
+    // like the hidraw side, each pedal has a second interface that never
+    // sends anything; it has no keys
+    unsigned char bits[KEY_MAX / 8 + 1] = { 0 };
+    if(ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(bits)), bits) < 0)
+        return false;
+    bool keys = false;
+    for(size_t i = 0; i < sizeof(bits); i++)
+        keys |= bits[i] != 0;
+    if(!keys)
+        return false;
+
+    // timestamps on the clock everything else here uses, instead of wall
+    // clock time
+    int clock = CLOCK_MONOTONIC;
+    if(ioctl(fd, EVIOCSCLOCKID, &clock) < 0){
+        printf("Error: could not switch %s to monotonic timestamps\n", target);
+        return false;
+    }
+
+    if(grab && ioctl(fd, EVIOCGRAB, 1) < 0)
+        printf("Warning: could not grab %s, something else already has it; its keys still reach everyone\n", target);
+    return true;
+}
+
+// whether sysfs says a hidraw node (an evdev node with -e) belongs to a
+// pedal we serve. the control thread uses it too
+bool pedal_node(const char *node, struct hid_info *info){
+    bool known = use_evdev ? read_input_info(node, info) : read_hid_info(node, info);
+    return known && is_pedal(info);
+}
+
+// open a node pedal_node() said is a pedal's, unless it's attached
+// already. returns its slot
+int open_pedal(int epfd, const char *node, const struct hid_info *info){
+    if(find_pedal(node) != NULL || (use_evdev && !first_input(node, info)))
+        return -1;
+
+    char target[64];
+    snprintf(target, sizeof(target), "/dev/%s", node);
+
+    int fd = open(target, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0){
+        printf("Error: could not open %s! Make sure you are running this program in root mode (sudo).\n", target);
+        return -1;
+    }
+
+    // each pedal also exposes a second interface with a 23 byte report
+    // descriptor that never sends anything (see hid_descriptor_remap.c)
+    struct hidraw_report_descriptor rdesc = { 0 };
+    if(use_evdev){
+        if(!evdev_setup(fd, target)){
+            close(fd);
+            return -1;
+        }
+    }else{
+        if(ioctl(fd, HIDIOCGRDESCSIZE, &rdesc.size) == 0 && rdesc.size == 23){
+            close(fd);
+            return -1;
+        }
+        if(ioctl(fd, HIDIOCGRDESC, &rdesc) < 0)
+            rdesc.size = 0;
+    }
+
+    int slot = fp_shm_attach(shm, info->id);
+    if(slot < 0){
+        printf("Error: no free slot for %s, only %d pedals are supported\n", target, FP_MAX_PEDALS);
+        close(fd);
+        return -1;
+    }
+
+    struct pedal *p = &pedals[slot];
+    p->src.type = SRC_PEDAL;
+    p->src.fd = fd;
+    p->slot = slot;
+    p->state = 0;
+    p->gen++;
+    p->attached_ns = now_ns();
+    snprintf(p->node, sizeof(p->node), "%s", node);
+    snprintf(p->parent, sizeof(p->parent), "%s", info->parent);
+
+    fp_debounce_init(&p->db, 0);
+    p->armed = 0;
+    p->settle.type = SRC_SETTLE;
+    p->settle.fd = -1;
+    settle_timer(epfd, p);
+
+    // work out where its buttons are once, instead of for every report.
+    // evdev has done that for us
+    bool parsed = use_evdev || fp_parser_compile(&p->parser, rdesc.value, rdesc.size) == 0;
+    fp_evdev_init(&p->keys);
+
+    watch_pedal(epfd, p);
+    num_pedals++;
+    sub_publish(FP_SUB_ATTACH, slot, 0, 0, p->attached_ns);
+
+    if(capture.f != NULL){
+        fp_cap_write(&capture, p->attached_ns, FP_CAP_PEDAL, slot, info->id, strlen(info->id));
+        fp_cap_write(&capture, p->attached_ns, FP_CAP_RDESC, slot, rdesc.value, rdesc.size);
+    }
+
+    printf("pedal %d: %s (%04x:%04x %s)", slot, target, info->vendor, info->product, info->id);
+    if(p->detached_ns)
+        printf(", back %.1f ms after it went away", (p->attached_ns - p->detached_ns) / 1e6);
+    if(!parsed)
+        printf(", no usable report descriptor, any key is a press");
+    if(use_evdev && grab)
+        printf(", grabbed");
+    printf("\n");
+    return slot;
+}
+
+int attach_pedal(int epfd, const char *node){
+    struct hid_info info;
+    if(!pedal_node(node, &info))
+        return -1;
+    return open_pedal(epfd, node, &info);
+}
+
+void detach_pedal(int epfd, struct pedal *p){
+    printf("pedal %d: /dev/%s went away\n", p->slot, p->node);
+
+    set_state(p, 0);
+    fp_debounce_init(&p->db, 0);
+    p->detached_ns = now_ns();
+    fp_shm_detach(shm, p->slot, p->detached_ns);
+    sub_publish(FP_SUB_DETACH, p->slot, 0, 0, p->detached_ns);
+
+    unwatch_pedal(epfd, p);
+    close(p->src.fd);
+    p->src.fd = -1;
+    if(p->settle.fd >= 0){
+        epoll_ctl(epfd, EPOLL_CTL_DEL, p->settle.fd, NULL);
+        close(p->settle.fd);
+        p->settle.fd = -1;
+    }
+    num_pedals--;
+}
+
+// every hidraw (or with -e, evdev) node that already exists
+void walk_nodes(void (*fn)(const char *node, void *arg), void *arg){
+    DIR *dir = opendir(use_evdev ? SYSFS_INPUT : SYSFS_HIDRAW);
+    if(dir == NULL)
+        return;
+
+    struct dirent *d;
+    while((d = readdir(dir)) != NULL){
+        if(!use_evdev && strncmp(d->d_name, "hidraw", 6) == 0){
+            fn(d->d_name, arg);
+        }else if(use_evdev && strncmp(d->d_name, "event", 5) == 0){
+            char node[32];
+            snprintf(node, sizeof(node), "input/%.24s", d->d_name);
+            fn(node, arg);
+        }
+    }
+    closedir(dir);
+}
+
+void discover_one(const char *node, void *arg){
+    attach_pedal(*(int *)arg, node);
+}
+
+void discover_pedals(int epfd){
+    walk_nodes(discover_one, &epfd);
+}
+
+// kernel uevents, so pedals can come and go while we run. these come
+// straight from the kernel, after devtmpfs has already created the node
+int uevent_listen(){
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if(fd < 0)
+        return -1;
+
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK, .nl_groups = 1 };
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void handle_uevents(int epfd, int fd){
+    char msg[4096];
+    ssize_t len;
+    struct sockaddr_nl from;
+    socklen_t from_len = sizeof(from);
+
+    while(true){
+        len = recvfrom(fd, msg, sizeof(msg) - 1, 0, (struct sockaddr *)&from, &from_len);
+        // the socket overflowed and uevents were lost. pedals that were
+        // added meanwhile are only in sysfs now; ones that went away hang
+        // up on their own
+        if(len < 0 && errno == ENOBUFS){
+            printf("Warning: missed uevents, rescanning for pedals\n");
+            discover_pedals(epfd);
+            continue;
+        }
+        if(len <= 0)
+            break;
+        msg[len] = '\0';
+
+        // only trust the kernel itself
+        if(from.nl_pid != 0)
+            continue;
+
+        // "add@/devices/...\0ACTION=add\0SUBSYSTEM=hidraw\0DEVNAME=hidraw3\0..."
+        const char *action = NULL, *subsystem = NULL, *devname = NULL;
+        for(char *kv = msg + strlen(msg) + 1; kv < msg + len; kv += strlen(kv) + 1){
+            if(strncmp(kv, "ACTION=", 7) == 0)
+                action = kv + 7;
+            else if(strncmp(kv, "SUBSYSTEM=", 10) == 0)
+                subsystem = kv + 10;
+            else if(strncmp(kv, "DEVNAME=", 8) == 0)
+                devname = kv + 8;
+        }
+
+        if(action == NULL || subsystem == NULL || devname == NULL)
+            continue;
+        // the input subsystem also has mouseN, jsN and the like
+        if(use_evdev ? strcmp(subsystem, "input") != 0 || strncmp(devname, "input/event", 11) != 0
+                     : strcmp(subsystem, "hidraw") != 0)
+            continue;
+
+        if(strcmp(action, "add") == 0){
+            uint64_t t = now_ns();
+            int slot = attach_pedal(epfd, devname);
+            if(slot >= 0)
+                printf("pedal %d: ready %.1f us after its uevent\n", slot, (now_ns() - t) / 1e3);
+        }else if(strcmp(action, "remove") == 0){
+            struct pedal *p = find_pedal(devname);
+            if(p != NULL)
+                detach_pedal(epfd, p);
+        }
+    }
+}
+
+// feed a capture through handle_report() as if its reports had just been
+// read, at the pace they were recorded or flat out. only the signalfd is
+// in epfd, and we look at it every so often to be able to stop early
+int replay(int epfd, const char *path, bool fast){
+    struct fp_cap_reader r;
+    if(fp_cap_open(&r, path) < 0){
+        perror("Error: could not open capture");
+        return -1;
+    }
+
+    // waiting for the next report's time is one more event in the loop
+    struct source timer = { .type = SRC_TIMER, .fd = -1 };
+    if(!fast){
+        timer.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &timer };
+        if(timer.fd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, timer.fd, &ev) < 0){
+            perror("Error: could not set up replay timer");
+            fp_cap_close_reader(&r);
+            return -1;
+        }
+    }
+
+    // slot a pedal had in the capture -> the slot it got from us
+    int slots[256];
+    memset(slots, -1, sizeof(slots));
+
+    struct epoll_event events[MAX_EVENTS];
+    struct fp_cap_record rec;
+    const unsigned char *payload;
+    uint64_t offset = 0, last_ns = 0, n = 0;
+    bool running = true;
+    uint64_t t_begin = now_ns();
+
+    while(running && fp_cap_peek(&r, &rec)){
+        uint64_t t_start = LAT_NOW();
+
+        if(!fast){
+            // the first record, and captures continued after a reboot,
+            // start a new timeline
+            if(n++ == 0 || rec.time_ns < last_ns)
+                offset = now_ns() - rec.time_ns;
+            last_ns = rec.time_ns;
+
+            uint64_t due = rec.time_ns + offset;
+            if(due > now_ns()){
+                struct itimerspec its = { .it_value = { due / 1000000000ull, due % 1000000000ull } };
+                timerfd_settime(timer.fd, TFD_TIMER_ABSTIME, &its, NULL);
+
+                int k = epoll_wait(epfd, events, MAX_EVENTS, -1);
+                t_start = LAT_NOW();
+                stats->syscalls += 2;
+                stats->wakeups++;
+                for(int i = 0; i < k; i++){
+                    struct source *src = events[i].data.ptr;
+                    if(src->type == SRC_SIGNAL)
+                        running = false;
+                }
+                uint64_t expirations;
+                read(timer.fd, &expirations, sizeof(expirations));
+                stats->syscalls++;
+                if(!running || now_ns() < due)
+                    continue;
+            }
+        }else if((++n & 4095) == 0){
+            stats->syscalls++;
+            if(epoll_wait(epfd, events, MAX_EVENTS, 0) > 0)
+                break;
+        }
+
+        fp_cap_next(&r, &rec, &payload);
+
+        // debounce windows end on the capture's clock, not ours, so a
+        // replay filters exactly what the live run did
+        if(debounce.mode != FP_DEBOUNCE_OFF){
+            for(int i = 0; i < FP_MAX_PEDALS; i++){
+                while(pedals[i].src.type == SRC_PEDAL && pedals[i].db.deadline != 0 && pedals[i].db.deadline <= rec.time_ns)
+                    settle(&pedals[i], pedals[i].db.deadline);
+            }
+        }
+
+        if(rec.type == FP_CAP_PEDAL){
+            char id[FP_ID_LEN];
+            snprintf(id, sizeof(id), "%.*s", (int)rec.len, (const char *)payload);
+
+            int slot = fp_shm_attach(shm, id);
+            if(slot < 0){
+                printf("Error: no free slot for %s, only %d pedals are supported\n", id, FP_MAX_PEDALS);
+                continue;
+            }
+            slots[rec.pedal] = slot;
+
+            struct pedal *p = &pedals[slot];
+            if(p->src.type != SRC_PEDAL){
+                p->src.type = SRC_PEDAL;
+                p->src.fd = -1;
+                p->slot = slot;
+                p->state = 0;
+                fp_parser_fallback(&p->parser);
+                fp_debounce_init(&p->db, 0);
+                p->settle.fd = -1;
+                snprintf(p->node, sizeof(p->node), "replay");
+                num_pedals++;
+                printf("pedal %d: %s (from capture)\n", slot, id);
+            }
+        }else if(rec.type == FP_CAP_RDESC && slots[rec.pedal] >= 0){
+            // captures from before descriptors were recorded stay in fallback mode
+            fp_parser_compile(&pedals[slots[rec.pedal]].parser, payload, rec.len);
+        }else if(rec.type == FP_CAP_REPORT && slots[rec.pedal] >= 0){
+            uint64_t t_read = LAT_NOW();
+            LAT_RECORD(FP_STAGE_READ, t_start, t_read);
+            handle_report(&pedals[slots[rec.pedal]], payload, rec.len, t_start, t_read, rec.time_ns);
+        }
+    }
+
+    uint64_t elapsed = now_ns() - t_begin;
+    printf("replayed %lu reports in %.1f ms", stats->reports, elapsed / 1e6);
+    if(elapsed > 0)
+        printf(" (%.0f reports/s)", stats->reports / (elapsed / 1e9));
+    printf("\n");
+
+    // leave every pedal released, like a reader that went away
+    for(int i = 0; i < FP_MAX_PEDALS; i++){
+        if(pedals[i].src.type == SRC_PEDAL){
+            while(pedals[i].db.deadline != 0)
+                settle(&pedals[i], pedals[i].db.deadline);
+            set_state(&pedals[i], 0);
+            fp_shm_detach(shm, i, now_ns());
+        }
+    }
+
+    if(timer.fd >= 0)
+        close(timer.fd);
+    fp_cap_close_reader(&r);
+    return 0;
+}
+
+void prefault_stack(){
+    volatile unsigned char stack[RT_STACK];
+    for(size_t i = 0; i < sizeof(stack); i += 4096)
+        stack[i] = 0;
+}
+
+// -l and -c. everything is best effort, a warning for what didn't work
+/*
+ * Where the acquisition thread runs: -a's CPU, or without -a every CPU
+ * we may use except -c's, so a main thread spinning (-b) or SCHED_FIFO
+ * (-l) there can't keep it from reading. Before realtime() pins us.
+ * True if it has a CPU the main thread never runs on.
+ */
+bool acq_placement(int cpu){
+    CPU_ZERO(&acq_cpus);
+    if(acq_cpu >= 0){
+        CPU_SET(acq_cpu, &acq_cpus);
+        acq_pinned = true;
+        return cpu >= 0 && acq_cpu != cpu;
+    }
+    if(cpu < 0 || sched_getaffinity(0, sizeof(acq_cpus), &acq_cpus) < 0)
+        return false;
+
+    acq_pinned = true;
+    CPU_CLR(cpu, &acq_cpus);
+    // one CPU to go round, they share it
+    if(CPU_COUNT(&acq_cpus) == 0){
+        CPU_SET(cpu, &acq_cpus);
+        return false;
+    }
+    return true;
+}
+
+void realtime(bool lowlat, int cpu){
+    if(cpu >= 0){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if(sched_setaffinity(0, sizeof(set), &set) < 0)
+            perror("Warning: could not pin to that CPU");
+        else
+            printf("pinned to CPU %d\n", cpu);
+    }
+    if(!lowlat)
+        return;
+
+    // freed memory stays ours and locked, instead of going back to the
+    // kernel and faulting in again next time
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    prefault_stack();
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        perror("Warning: could not lock memory (needs root or a big enough RLIMIT_MEMLOCK)");
+
+    struct sched_param sp = { .sched_priority = RT_PRIORITY };
+    if(sched_setscheduler(0, SCHED_FIFO, &sp) < 0)
+        perror("Warning: could not switch to SCHED_FIFO (needs root or CAP_SYS_NICE)");
+    else
+        printf("low latency mode: SCHED_FIFO %d, memory locked\n", RT_PRIORITY);
+}
+
+void print_stats(FILE *f){
+    fprintf(f, "reports: %lu, edges: %lu, filtered: %lu, wakeups: %lu, syscalls: %lu", stats->reports, stats->edges, stats->filtered, stats->wakeups, stats->syscalls);
+    if(stats->reports > 0)
+        fprintf(f, " (%.2f per report)", (double)stats->syscalls / stats->reports);
+    fprintf(f, "\n");
+    if(stats->sub_records > 0 || stats->sub_dropped > 0)
+        fprintf(f, "subscriber records: %lu sent, %lu dropped\n", stats->sub_records, stats->sub_dropped);
+    if(stats->ctl_commands > 0)
+        fprintf(f, "control commands: %lu\n", stats->ctl_commands);
+    if(stats->evdev_resyncs > 0)
+        fprintf(f, "evdev resyncs after SYN_DROPPED: %lu\n", stats->evdev_resyncs);
+    if(pipeline){
+        fprintf(f, "acquisition thread: wakeups: %lu, syscalls: %lu\n", stats->acq_wakeups, stats->acq_syscalls);
+        fprintf(f, "queue: %lu reports, depth avg %.1f max %lu, full %lu times for %.1f ms, %lu kicks\n",
+                stats->queue_pushes, stats->queue_pushes ? (double)stats->queue_depth_sum / stats->queue_pushes : 0.0,
+                stats->queue_depth_max, stats->queue_full, stats->queue_full_ns / 1e6, stats->queue_kicks);
+    }
+    fprintf(f, "discovery: %.1f us", stats->discovery_ns / 1e3);
+    if(stats->reports > 0)
+        fprintf(f, ", first report %.1f ms after start", stats->first_report_ns / 1e6);
+    fprintf(f, "\n");
+
+#ifndef FP_NO_LATENCY_STATS
+    for(int i = 0; i < FP_NUM_STAGES; i++){
+        const struct fp_hist *h = &stats->stages[i];
+        if(h->count == 0)
+            continue;
+        fp_hist_print(f, fp_stage_names[i], h);
+    }
+#endif
+}
+
+// -p: what the acquisition thread queued, through the same path as a
+// report we read ourselves. at most a queue's worth, so a pedal that never
+// stops can't keep us from everything else
+void drain_queue(int epfd){
+    struct fp_rq_entry *e;
+
+    for(int i = 0; i < FP_RQ_SIZE && (e = fp_rq_peek(&queue)) != NULL; i++){
+        struct pedal *p = &pedals[e->pedal];
+        // not from a pedal that went away since, or came back as a new attach
+        if(p->src.type == SRC_PEDAL && p->src.fd >= 0 && p->gen == e->gen){
+            if(e->len == 0){
+                detach_pedal(epfd, p);
+            }else{
+                uint64_t t_read = LAT_NOW();
+                LAT_RECORD(FP_STAGE_QUEUE, e->time_ns, t_read);
+                if(capture.f != NULL)
+                    fp_cap_write(&capture, e->time_ns, FP_CAP_REPORT, p->slot, e->data, e->len);
+                handle_report(p, e->data, e->len, e->wake_ns, t_read, e->time_ns);
+                arm_settle(p);
+            }
+        }
+        if(fp_rq_pop(&queue))
+            stats->syscalls++;
+    }
+}
+
+// the control socket, see footpedal_ctl.h. a thread of its own answers
+// commands, so formatting stats or walking sysfs never holds up a report.
+// what only the main thread may do (anything that changes the pedals,
+// debouncing, the outputs or the capture) it hands over as a job, one
+// command at a time, through an eventfd in our epoll; we run it between
+// batches of reports and say so through another
+struct controller {
+    struct source src;
+    int index;
+};
+
+struct controller *controllers[MAX_CONTROLLERS];
+int num_controllers = 0;
+
+struct ctl_job {
+    const char *verb, *arg, *arg2;
+    FILE *out;
+    const char *err;
+    bool ran;
+    // rescan and attach: the nodes the control thread found to be pedals
+    char nodes[FP_MAX_PEDALS][32];
+    struct hid_info info[FP_MAX_PEDALS];
+    int num_nodes;
+    // capture: the file the control thread opened, or the one we hand
+    // back for it to close
+    struct fp_cap_writer cap;
+} ctl_job;
+
+pthread_t ctl_thread;
+bool ctl_running = false;
+cpu_set_t ctl_cpus;     // where it runs, see ctl_placement()
+int ctl_epfd = -1;
+int ctl_kick = -1;      // wakes it to stop
+int ctl_done = -1;      // we ran its job
+atomic_bool ctl_stop;
+struct source ctl_listen_src = { .type = SRC_CTL_LISTEN, .fd = -1 };
+struct source ctl_job_src = { .type = SRC_CTL_JOB, .fd = -1 };
+
+int ctl_listen(){
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, FP_CTL_PATH, sizeof(addr.sun_path) - 1);
+    unlink(FP_CTL_PATH);
+
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0){
+        close(fd);
+        return -1;
+    }
+
+    // it can attach devices and write files, so unlike the others it's
+    // root only
+    chmod(FP_CTL_PATH, 0600);
+    return fd;
+}
+
+void ctl_accept(int listen_fd){
+    int conn;
+    while((conn = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0){
+        struct controller *c = malloc(sizeof(*c));
+        if(num_controllers == MAX_CONTROLLERS || c == NULL){
+            free(c);
+            close(conn);
+            continue;
+        }
+        c->src.type = SRC_CTL;
+        c->src.fd = conn;
+
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = c };
+        if(epoll_ctl(ctl_epfd, EPOLL_CTL_ADD, conn, &ev) < 0){
+            close(conn);
+            free(c);
+            continue;
+        }
+        c->index = num_controllers;
+        controllers[num_controllers++] = c;
+    }
+}
+
+void ctl_drop(struct controller *c){
+    close(c->src.fd);
+    controllers[c->index] = controllers[--num_controllers];
+    controllers[c->index]->index = c->index;
+    free(c);
+}
+
+// new -d/-T settings. windows in progress end right away with what the
+// pedal holds, so no pedal is left half debounced under the old ones
+void set_debounce(int epfd, const struct fp_debounce_config *c){
+    for(int i = 0; i < FP_MAX_PEDALS; i++){
+        struct pedal *p = &pedals[i];
+        if(p->src.type != SRC_PEDAL || p->src.fd < 0)
+            continue;
+        // without debouncing, db doesn't follow the pedal
+        uint32_t held = debounce.mode != FP_DEBOUNCE_OFF ? p->db.raw : p->state;
+        fp_debounce_init(&p->db, held);
+        set_state(p, held);
+    }
+
+    debounce = *c;
+    for(int i = 0; i < FP_MAX_PEDALS; i++){
+        if(pedals[i].src.type == SRC_PEDAL && pedals[i].src.fd >= 0)
+            settle_timer(epfd, &pedals[i]);
+    }
+}
+
+// like -w, into the file the control thread opened. the pedals are
+// already attached, so name them and their descriptors first, the way
+// attach_pedal() does
+void capture_start(){
+    capture = ctl_job.cap;
+    ctl_job.cap.f = NULL;
+
+    uint64_t t = now_ns();
+    for(int i = 0; i < FP_MAX_PEDALS; i++){
+        struct pedal *p = &pedals[i];
+        if(p->src.type != SRC_PEDAL || p->src.fd < 0)
+            continue;
+
+        struct hidraw_report_descriptor rdesc = { 0 };
+        if(ioctl(p->src.fd, HIDIOCGRDESCSIZE, &rdesc.size) < 0 || ioctl(p->src.fd, HIDIOCGRDESC, &rdesc) < 0)
+            rdesc.size = 0;
+        stats->syscalls += 2;
+
+        const char *id = shm->pedals[p->slot].id;
+        fp_cap_write(&capture, t, FP_CAP_PEDAL, p->slot, id, strnlen(id, FP_ID_LEN));
+        fp_cap_write(&capture, t, FP_CAP_RDESC, p->slot, rdesc.value, rdesc.size);
+    }
+}
+
+// hidraw3 and /dev/hidraw3 are the same node
+const char *ctl_node(const char *arg){
+    return strncmp(arg, "/dev/", 5) == 0 ? arg + 5 : arg;
+}
+
+// our part of a command, see struct ctl_job. NULL, or why it failed
+const char *ctl_run(int epfd){
+    const char *verb = ctl_job.verb, *arg = ctl_job.arg, *arg2 = ctl_job.arg2;
+    FILE *out = ctl_job.out;
+
+    if(strcmp(verb, "pedals") == 0){
+        uint64_t t = now_ns();
+        for(int i = 0; i < FP_MAX_PEDALS; i++){
+            struct pedal *p = &pedals[i];
+            if(p->src.type == SRC_PEDAL && p->src.fd >= 0)
+                fprintf(out, "pedal %d: /dev/%s (%.*s), buttons %#x, attached %.1f s ago\n", p->slot, p->node,
+                        FP_ID_LEN, shm->pedals[p->slot].id, p->state, (t - p->attached_ns) / 1e9);
+        }
+    }else if(strcmp(verb, "debounce") == 0){
+        struct fp_debounce_config c = debounce;
+        if(arg != NULL && strcmp(arg, "off") == 0 && arg2 == NULL){
+            c.mode = FP_DEBOUNCE_OFF;
+        }else if(arg != NULL && fp_debounce_parse(&c, arg) == 0 && (arg2 == NULL || strcmp(arg2, "trailing") == 0)){
+            c.mode = arg2 != NULL ? FP_DEBOUNCE_TRAILING : FP_DEBOUNCE_LEADING;
+        }else{
+            return "usage: debounce off|<press_ms>[,<release_ms>] [trailing]";
+        }
+        set_debounce(epfd, &c);
+    }else if(strcmp(verb, "output") == 0){
+        bool *paused = NULL;
+        if(arg != NULL && strcmp(arg, "notify") == 0)
+            paused = &notify_paused;
+        else if(arg != NULL && strcmp(arg, "sub") == 0)
+            paused = &sub_paused;
+        if(paused == NULL || arg2 == NULL || (strcmp(arg2, "on") != 0 && strcmp(arg2, "off") != 0))
+            return "usage: output notify|sub on|off";
+        *paused = strcmp(arg2, "off") == 0;
+    }else if(strcmp(verb, "rescan") == 0){
+        // already attached ones cost a strcmp() each
+        int before = num_pedals;
+        for(int i = 0; i < ctl_job.num_nodes; i++)
+            open_pedal(epfd, ctl_job.nodes[i], &ctl_job.info[i]);
+        fprintf(out, "%d new pedals\n", num_pedals - before);
+    }else if(strcmp(verb, "attach") == 0){
+        int slot = open_pedal(epfd, ctl_job.nodes[0], &ctl_job.info[0]);
+        if(slot < 0)
+            return "already attached, or it can't be opened";
+        fprintf(out, "pedal %d\n", slot);
+    }else if(strcmp(verb, "detach") == 0){
+        if(arg == NULL)
+            return "usage: detach <node>";
+        struct pedal *p = find_pedal(ctl_node(arg));
+        if(p == NULL)
+            return "no pedal attached there";
+        detach_pedal(epfd, p);
+    }else if(strcmp(verb, "capture") == 0){
+        if(strcmp(arg, "off") == 0){
+            ctl_job.cap = capture;
+            capture.f = NULL;
+        }else{
+            capture_start();
+        }
+    }else{
+        return "unknown command, see footpedal_ctl.h";
+    }
+    return NULL;
+}
+
+// a job from the control thread
+void ctl_job_run(int epfd){
+    uint64_t jobs;
+    bool queued = read(ctl_job_src.fd, &jobs, sizeof(jobs)) == sizeof(jobs);
+    stats->syscalls++;
+    if(!queued)
+        return;
+
+    ctl_job.err = ctl_run(epfd);
+    ctl_job.ran = true;
+    uint64_t one = 1;
+    write(ctl_done, &one, sizeof(one));
+    stats->syscalls++;
+}
+
+// a pedal's interface that never sends anything, which attach_pedal()
+// turns down too. checking here saves us an open() for it every rescan
+bool idle_interface(const char *node){
+    char target[64];
+    snprintf(target, sizeof(target), "/dev/%s", node);
+    int fd = open(target, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+
+    bool idle;
+    if(use_evdev){
+        unsigned char bits[KEY_MAX / 8 + 1] = { 0 };
+        idle = ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(bits)), bits) >= 0;
+        for(size_t i = 0; i < sizeof(bits); i++)
+            idle &= bits[i] == 0;
+    }else{
+        int size;
+        idle = ioctl(fd, HIDIOCGRDESCSIZE, &size) == 0 && size == 23;
+    }
+    close(fd);
+    return idle;
+}
+
+// the control thread's part of rescan and attach: which nodes are pedals
+void ctl_find(const char *node, void *arg){
+    (void)arg;
+    if(ctl_job.num_nodes == FP_MAX_PEDALS)
+        return;
+    int i = ctl_job.num_nodes;
+    if(pedal_node(node, &ctl_job.info[i]) && !idle_interface(node)){
+        snprintf(ctl_job.nodes[i], sizeof(ctl_job.nodes[i]), "%s", node);
+        ctl_job.num_nodes++;
+    }
+}
+
+// hand the rest of a command to the main thread and wait for it. NULL, or
+// why it failed
+const char *ctl_handoff(const char *verb, const char *arg, const char *arg2, FILE *out){
+    ctl_job.verb = verb;
+    ctl_job.arg = arg;
+    ctl_job.arg2 = arg2;
+    ctl_job.out = out;
+    ctl_job.ran = false;
+
+    uint64_t one = 1, done;
+    write(ctl_job_src.fd, &one, sizeof(one));
+    read(ctl_done, &done, sizeof(done));
+    // stop_control() woke us, the main loop is over
+    if(!ctl_job.ran)
+        return "the reader is stopping";
+    return ctl_job.err;
+}
+
+// run one command, with its output going to out. NULL, or why it failed
+const char *ctl_command(char *cmd, FILE *out){
+    char *save;
+    const char *verb = strtok_r(cmd, " \t\n", &save);
+    const char *arg = strtok_r(NULL, " \t\n", &save);
+    const char *arg2 = strtok_r(NULL, " \t\n", &save);
+
+    if(verb == NULL)
+        return "empty command";
+
+    // the stats page is there for other processes to read while we write
+    // it, and so it is for this thread
+    if(strcmp(verb, "stats") == 0){
+        print_stats(out);
+        return NULL;
+    }
+
+    ctl_job.num_nodes = 0;
+    if(strcmp(verb, "rescan") == 0){
+        walk_nodes(ctl_find, NULL);
+    }else if(strcmp(verb, "attach") == 0){
+        if(arg == NULL)
+            return "usage: attach <node>";
+        ctl_find(ctl_node(arg), NULL);
+        if(ctl_job.num_nodes == 0)
+            return "not a pedal we serve";
+    }else if(strcmp(verb, "capture") == 0){
+        // after startup only our jobs change the capture, so it's safe to
+        // look at while the main thread runs
+        if(arg == NULL)
+            return "usage: capture <path>|off";
+        if(use_evdev)
+            return "-e doesn't read raw reports to capture";
+        if(strcmp(arg, "off") == 0 && capture.f == NULL)
+            return "not capturing";
+        if(strcmp(arg, "off") != 0){
+            if(capture.f != NULL)
+                return "already capturing, capture off first";
+            if(fp_cap_create(&ctl_job.cap, arg) < 0)
+                return strerror(errno);
+        }
+    }
+
+    const char *err = ctl_handoff(verb, arg, arg2, out);
+
+    // a capture we stopped, or one we opened and never got to start.
+    // writing out what's buffered is our job, not the main thread's
+    if(ctl_job.cap.f != NULL){
+        bool stopped = strcmp(arg, "off") == 0;
+        fp_cap_close(&ctl_job.cap);
+        if(stopped)
+            printf("capture stopped\n");
+    }else if(err == NULL && strcmp(verb, "capture") == 0){
+        printf("capturing to: %s\n", arg);
+    }
+    return err;
+}
+
+// answer every command the client sent. false once it hung up
+bool ctl_commands(struct controller *c){
+    static char reply[FP_CTL_REPLY];
+    char cmd[FP_CTL_CMD + 1];
+
+    while(true){
+        ssize_t len = recv(c->src.fd, cmd, FP_CTL_CMD, 0);
+        if(len == 0)
+            return false;
+        if(len < 0)
+            return errno == EAGAIN;
+        cmd[len] = '\0';
+        stats->ctl_commands++;
+
+        FILE *out = fmemopen(reply, sizeof(reply), "w");
+        if(out == NULL)
+            return false;
+        fputs("ok\n", out);
+        const char *err = ctl_command(cmd, out);
+        if(err != NULL){
+            rewind(out);
+            fprintf(out, "error: %s\n", err);
+        }
+        long n = ftell(out);
+        fclose(out);
+        if(n < 0 || n > (long)sizeof(reply))
+            n = sizeof(reply);
+
+        if(send(c->src.fd, reply, n, MSG_DONTWAIT | MSG_NOSIGNAL) != n)
+            return false;
+    }
+}
+
+void *control(void *arg){
+    (void)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while(!atomic_load(&ctl_stop)){
+        int n = epoll_wait(ctl_epfd, events, MAX_EVENTS, -1);
+        for(int i = 0; i < n && !atomic_load(&ctl_stop); i++){
+            struct source *src = events[i].data.ptr;
+            if(src == NULL){
+                uint64_t v;
+                read(ctl_kick, &v, sizeof(v));
+            }else if(src->type == SRC_CTL_LISTEN){
+                ctl_accept(src->fd);
+            }else{
+                struct controller *c = (struct controller *)src;
+                if(!ctl_commands(c) || (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+                    ctl_drop(c);
+            }
+        }
+    }
+
+    while(num_controllers > 0)
+        ctl_drop(controllers[0]);
+    return NULL;
+}
+
+// off -c's CPU if there's another, like the acquisition thread without
+// -a. before realtime() pins us
+void ctl_placement(int cpu){
+    if(sched_getaffinity(0, sizeof(ctl_cpus), &ctl_cpus) < 0){
+        CPU_ZERO(&ctl_cpus);
+        return;
+    }
+    if(cpu >= 0 && CPU_COUNT(&ctl_cpus) > 1)
+        CPU_CLR(cpu, &ctl_cpus);
+}
+
+void close_control(){
+    int *fds[] = { &ctl_epfd, &ctl_kick, &ctl_done, &ctl_job_src.fd, &ctl_listen_src.fd };
+    for(size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++){
+        if(*fds[i] >= 0)
+            close(*fds[i]);
+        *fds[i] = -1;
+    }
+}
+
+// the control socket and its thread, with the eventfd it hands us jobs
+// through in our epoll
+int start_control(int epfd){
+    ctl_listen_src.fd = ctl_listen();
+    ctl_epfd = epoll_create1(EPOLL_CLOEXEC);
+    ctl_kick = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ctl_done = eventfd(0, EFD_CLOEXEC);
+    ctl_job_src.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(ctl_listen_src.fd < 0 || ctl_epfd < 0 || ctl_kick < 0 || ctl_done < 0 || ctl_job_src.fd < 0){
+        close_control();
+        return -1;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(ctl_epfd, EPOLL_CTL_ADD, ctl_kick, &ev);
+    ev.data.ptr = &ctl_listen_src;
+    epoll_ctl(ctl_epfd, EPOLL_CTL_ADD, ctl_listen_src.fd, &ev);
+    ev.data.ptr = &ctl_job_src;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, ctl_job_src.fd, &ev);
+
+    // not -l's SCHED_FIFO: it's there to take work off the main thread,
+    // not to get ahead of it
+    pthread_attr_t attr;
+    struct sched_param sp = { .sched_priority = 0 };
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &sp);
+    if(CPU_COUNT(&ctl_cpus) > 0)
+        pthread_attr_setaffinity_np(&attr, sizeof(ctl_cpus), &ctl_cpus);
+
+    int ret = pthread_create(&ctl_thread, &attr, control, NULL);
+    pthread_attr_destroy(&attr);
+    if(ret != 0){
+        close_control();
+        unlink(FP_CTL_PATH);
+        errno = ret;
+        return -1;
+    }
+    ctl_running = true;
+    return 0;
+}
+
+// before anything the main loop set up goes away. a job it handed us
+// that we never ran is answered with an error
+void stop_control(){
+    if(!ctl_running)
+        return;
+    atomic_store(&ctl_stop, true);
+    uint64_t one = 1;
+    write(ctl_kick, &one, sizeof(one));
+    write(ctl_done, &one, sizeof(one));
+    pthread_join(ctl_thread, NULL);
+    close_control();
+    unlink(FP_CTL_PATH);
+}
+
+// handle what epoll_wait() returned. false once we're told to stop
+bool dispatch(int epfd, struct epoll_event *events, int n, uint64_t t_wake){
+    bool running = true;
+    // a control job waits until every report that came in with it is
+    // handled
+    bool ctl_job_ready = false;
+
+    for(int i = 0; i < n; i++){
+        struct source *src = events[i].data.ptr;
+
+        switch(src->type){
+        case SRC_SIGNAL:
+            running = false;
+            break;
+        case SRC_NOTIFY:
+            notify_accept(epfd, src->fd);
+            break;
+        case SRC_WAITER:
+            notify_drop((struct waiter *)src);
+            break;
+        case SRC_UEVENT:
+            handle_uevents(epfd, src->fd);
+            break;
+        case SRC_PEDAL: {
+            struct pedal *p = (struct pedal *)src;
+            // a pedal detached earlier in this batch
+            if(p->src.fd < 0)
+                break;
+            int ret = use_evdev ? drain_evdev(p, t_wake) : drain_device(p, t_wake);
+            if(ret < 0 || (events[i].events & (EPOLLHUP | EPOLLERR)))
+                detach_pedal(epfd, p);
+            break;
+        }
+        case SRC_SETTLE: {
+            struct pedal *p = (struct pedal *)((char *)src - offsetof(struct pedal, settle));
+            uint64_t expirations;
+            read(src->fd, &expirations, sizeof(expirations));
+            stats->syscalls++;
+            p->armed = 0;
+            // a pedal detached earlier in this batch
+            if(p->src.fd < 0)
+                break;
+            settle(p, now_ns());
+            arm_settle(p);
+            break;
+        }
+        case SRC_SUB_LISTEN:
+            sub_accept(epfd, src->fd);
+            break;
+        case SRC_SUBSCRIBER: {
+            struct subscriber *sub = (struct subscriber *)src;
+            if((events[i].events & EPOLLIN) && !sub_requests(sub))
+                sub->dead = true;
+            if(sub->dead || (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))){
+                sub_drop(sub);
+                break;
+            }
+            if(events[i].events & EPOLLOUT)
+                sub_flush(sub);
+            break;
+        }
+        case SRC_QUEUE: {
+            // drain_queue() after the batch takes what it's about
+            uint64_t kicks;
+            read(src->fd, &kicks, sizeof(kicks));
+            stats->syscalls++;
+            break;
+        }
+        case SRC_CTL_JOB:
+            ctl_job_ready = true;
+            break;
+        case SRC_TIMER:
+        // the control thread's
+        case SRC_CTL_LISTEN:
+        case SRC_CTL:
+            break;
+        }
+    }
+
+    if(ctl_job_ready)
+        ctl_job_run(epfd);
+    return running;
+}
+
+void epoll_loop(int epfd, bool hotplug, bool busy_poll){
+    struct epoll_event events[MAX_EVENTS];
+    bool running = true;
+
+    while(running && (num_pedals > 0 || hotplug)){
+        int timeout = busy_poll ? 0 : -1;
+        // -p: only sleep once the acquisition thread knows to wake us
+        if(pipeline && timeout != 0 && !fp_rq_sleep(&queue))
+            timeout = 0;
+        int n = epoll_wait(epfd, events, MAX_EVENTS, timeout);
+        uint64_t t_wake = LAT_NOW();
+        stats->syscalls++;
+
+        if(n < 0){
+            if(errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+        if(n > 0){
+            stats->wakeups++;
+            running = dispatch(epfd, events, n, t_wake);
+        }
+        if(pipeline)
+            drain_queue(epfd);
+        else if(n == 0)
+            continue;
+
+        // one write() per wakeup, so a capture is never far behind
+        if(capture.dirty){
+            fp_cap_flush(&capture);
+            stats->syscalls++;
+        }
+    }
+}
+
+#ifdef FP_IO_URING
+// set up the ring, if the kernel has everything we need (multishot reads
+// are 6.7). pedals aren't attached yet
+int ring_setup(){
+    if(fp_ring_init(&ring, RING_ENTRIES, FP_MAX_PEDALS, RING_BUFFERS, REPORT_MAX) < 0){
+        perror("Warning: no io_uring, using epoll");
+        return -1;
+    }
+    if(!fp_ring_supports(&ring, FP_OP_READ_MULTISHOT)){
+        printf("Warning: this kernel has no multishot reads (6.7+), using epoll\n");
+        fp_ring_close(&ring);
+        return -1;
+    }
+    printf("io_uring: %d fixed files, %d registered %d byte buffers\n", FP_MAX_PEDALS, RING_BUFFERS, REPORT_MAX);
+    return 0;
+}
+
+// a multishot read completed: a report, or the read ended
+void ring_report(int epfd, uint64_t data, int res, unsigned flags, uint64_t t_start){
+    struct pedal *p = &pedals[(uint32_t)data];
+    bool live = p->src.type == SRC_PEDAL && p->src.fd >= 0 && (p->gen & 0xffffff) == ((data >> 32) & 0xffffff);
+
+    if(flags & IORING_CQE_F_BUFFER){
+        unsigned bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if(live && res > 0)
+            got_report(p, fp_ring_buf(&ring, bid), res, t_start);
+        fp_ring_recycle(&ring, bid);
+    }
+    if(!live || (flags & IORING_CQE_F_MORE))
+        return;
+
+    // out of buffers only means we fell behind, anything else is the
+    // pedal going away
+    if(res > 0 || res == -ENOBUFS)
+        ring_read(p);
+    else
+        detach_pedal(epfd, p);
+}
+
+// watch epfd, which still has the notify socket, clients and uevents
+void ring_poll_epoll(int epfd){
+    struct io_uring_sqe *sqe = fp_ring_sqe(&ring);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = epfd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = RING_DATA(RING_EPOLL, 0, 0);
+}
+
+// the io_uring backend. every pedal has a read posted all the time, so a
+// report costs no syscall of its own: one io_uring_enter() submits
+// whatever is queued and waits, and then every completion that came in
+// meanwhile is handled in one go. with -b we only enter the kernel when
+// there's something to submit or completions to collect. the signalfd is
+// polled in the ring too, and debounce windows end with the wait's
+// timeout instead of a timerfd each
+void ring_loop(int epfd, int sig_fd, bool hotplug, bool busy_poll){
+    struct epoll_event events[MAX_EVENTS];
+    bool running = true;
+
+    struct io_uring_sqe *sqe = fp_ring_sqe(&ring);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = sig_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = RING_DATA(RING_SIGNAL, 0, 0);
+    ring_poll_epoll(epfd);
+
+    while(running && (num_pedals > 0 || hotplug)){
+        uint64_t timeout = 0;
+        if(debounce.mode != FP_DEBOUNCE_OFF && !busy_poll){
+            uint64_t next = UINT64_MAX, t = now_ns();
+            for(int i = 0; i < FP_MAX_PEDALS; i++){
+                if(pedals[i].src.type == SRC_PEDAL && pedals[i].src.fd >= 0 && pedals[i].db.deadline != 0 && pedals[i].db.deadline < next)
+                    next = pedals[i].db.deadline;
+            }
+            if(next != UINT64_MAX)
+                timeout = next > t ? next - t : 1;
+        }
+
+        if(!busy_poll || fp_ring_pending(&ring) > 0 || fp_ring_taskrun(&ring)){
+            int ret = fp_ring_enter(&ring, busy_poll ? 0 : 1, timeout);
+            stats->syscalls++;
+            if(ret < 0 && errno != EINTR && errno != ETIME && errno != EBUSY){
+                perror("io_uring_enter");
+                break;
+            }
+        }
+        uint64_t t_wake = LAT_NOW();
+        uint64_t t_start = t_wake;
+        bool woke = false;
+
+        struct io_uring_cqe *cqe;
+        while((cqe = fp_ring_peek(&ring)) != NULL){
+            uint64_t data = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            fp_ring_seen(&ring);
+            woke = true;
+
+            switch(data >> 56){
+            case RING_READ:
+                ring_report(epfd, data, res, flags, t_start);
+                t_start = LAT_NOW();
+                break;
+            case RING_SIGNAL:
+                running = false;
+                break;
+            case RING_EPOLL: {
+                // the poll only fires when epfd gets new events, so take
+                // everything it has now
+                int n;
+                do {
+                    n = epoll_wait(epfd, events, MAX_EVENTS, 0);
+                    stats->syscalls++;
+                    if(n > 0 && !dispatch(epfd, events, n, t_wake))
+                        running = false;
+                } while(n == MAX_EVENTS && running);
+                if(!(flags & IORING_CQE_F_MORE))
+                    ring_poll_epoll(epfd);
+                break;
+            }
+            case RING_CANCEL:
+                break;
+            }
+        }
+        if(!woke && timeout == 0)
+            continue;
+        if(woke)
+            stats->wakeups++;
+
+        if(debounce.mode != FP_DEBOUNCE_OFF){
+            uint64_t t = now_ns();
+            for(int i = 0; i < FP_MAX_PEDALS; i++){
+                if(pedals[i].src.type == SRC_PEDAL && pedals[i].src.fd >= 0 && pedals[i].db.deadline != 0 && pedals[i].db.deadline <= t)
+                    settle(&pedals[i], t);
+            }
+        }
+
+        // one write() per wakeup, so a capture is never far behind
+        if(capture.dirty){
+            fp_cap_flush(&capture);
+            stats->syscalls++;
+        }
+    }
+}
+#endif
+
+int main(int argc, char **argv){
+    start_ns = now_ns();
+
+    const char *capture_path = NULL, *replay_path = NULL;
+    bool fast = false, lowlat = false, busy_poll = false;
+    int cpu = -1;
+    int opt;
+    bool trailing = false;
+    while((opt = getopt(argc, argv, "lc:bpa:s:egd:Tw:r:f")) != -1){
+        switch(opt){
+        case 'l': lowlat = true; break;
+        case 'c': cpu = atoi(optarg); break;
+        case 'b': busy_poll = true; break;
+        case 'p': pipeline = true; break;
+        case 'a': pipeline = true; acq_cpu = atoi(optarg); break;
+        case 's': slow_ns = strtoull(optarg, NULL, 10) * 1000; break;
+        case 'e': use_evdev = true; break;
+        case 'g': use_evdev = grab = true; break;
+        case 'd':
+            if(fp_debounce_parse(&debounce, optarg) < 0){
+                fprintf(stderr, "Error: -d takes press_ms[,release_ms], not %s\n", optarg);
+                return 1;
+            }
+            debounce.mode = FP_DEBOUNCE_LEADING;
+            break;
+        case 'T': trailing = true; break;
+        case 'w': capture_path = optarg; break;
+        case 'r': replay_path = optarg; break;
+        case 'f': fast = true; break;
+        default:
+            fprintf(stderr, "usage: %s [-l] [-c cpu] [-b] [-p] [-a cpu] [-s usec] [-e [-g]] [-d press_ms[,release_ms] [-T]] [-w capture] [-r capture [-f]]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(use_evdev && (pipeline || capture_path != NULL || replay_path != NULL)){
+        fprintf(stderr, "Error: -p, -w and -r work on raw reports, which -e doesn't read\n");
+        return 1;
+    }
+    if(trailing && debounce.mode != FP_DEBOUNCE_OFF)
+        debounce.mode = FP_DEBOUNCE_TRAILING;
+
+    // replay doesn't read pedals
+    if(replay_path != NULL)
+        pipeline = false;
+    // a spinning main thread never gives up its CPU, so the acquisition
+    // thread must have another one
+    if(pipeline && !acq_placement(cpu) && busy_poll){
+        fprintf(stderr, "Error: -b with -p needs -c, and the acquisition thread on another CPU: a different -a, or a second CPU without -a\n");
+        return 1;
+    }
+#ifdef FP_IO_URING
+    // the acquisition thread and the evdev backend read with epoll
+    if(replay_path == NULL && !pipeline && !use_evdev)
+        use_ring = ring_setup() == 0;
+#endif
+
+    // Ctrl+C / SIGTERM arrive on a signalfd, so shutdown is just another
+    // epoll event instead of a read() on stdin after every report
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    struct source sig = { .type = SRC_SIGNAL };
+    sig.fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if(sig.fd < 0 || epfd < 0){
+        perror("Error: could not set up event loop");
+        return 1;
+    }
+
+    // the io_uring backend polls it in the ring
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &sig };
+    if(!use_ring)
+        epoll_ctl(epfd, EPOLL_CTL_ADD, sig.fd, &ev);
+
+    shm = open_shm();
+    if(shm == NULL){
+        perror("Error: could not map " FP_SHM_PATH);
+        return 1;
+    }
+
+    struct fp_stats *s = open_stats();
+    if(s == NULL)
+        perror("Warning: no live stats in " FP_STATS_PATH);
+    else
+        stats = s;
+
+    ctl_placement(cpu);
+    // after the segments are mapped, so they're locked too
+    realtime(lowlat, cpu);
+    if(busy_poll && cpu < 0)
+        printf("Warning: busy polling without -c, it will hog whatever CPU it's on\n");
+
+    if(replay_path != NULL){
+        int ret = replay(epfd, replay_path, fast);
+        print_stats(stdout);
+        close(epfd);
+        close(sig.fd);
+        munmap(shm, sizeof(struct fp_shm));
+        if(stats != &local_stats)
+            munmap(stats, sizeof(struct fp_stats));
+        return ret < 0;
+    }
+
+    // open before discovery, so the capture names every pedal
+    if(capture_path != NULL){
+        if(fp_cap_create(&capture, capture_path) < 0){
+            perror("Error: could not open capture");
+            return 1;
+        }
+        printf("capturing to: %s\n", capture_path);
+    }
+
+    // before the first pedal is handed to it
+    if(pipeline && start_acquisition(epfd) < 0){
+        perror("Error: could not start the acquisition thread");
+        return 1;
+    }
+
+    // listen before walking sysfs, so a pedal plugged in meanwhile isn't lost
+    struct source uevent = { .type = SRC_UEVENT };
+    uevent.fd = uevent_listen();
+    if(uevent.fd < 0){
+        perror("Warning: no hotplug, pedals plugged in later won't be picked up");
+    }else{
+        ev.data.ptr = &uevent;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, uevent.fd, &ev);
+    }
+
+    discover_pedals(epfd);
+    stats->discovery_ns = now_ns() - start_ns;
+
+    printf("writing to: %s\n", FP_SHM_PATH);
+
+    if(num_pedals == 0){
+        if(uevent.fd < 0){
+            printf("Error: no pedal found! Make sure the pedal is plugged in and you are running this program in root mode (sudo).\n");
+            return 0;
+        }
+        printf("no pedal found yet, waiting for one to be plugged in\n");
+    }
+
+    struct source notify = { .type = SRC_NOTIFY };
+    notify.fd = notify_listen();
+    if(notify.fd < 0){
+        perror("Warning: no change notifications on " FP_NOTIFY_PATH);
+    }else{
+        ev.data.ptr = &notify;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, notify.fd, &ev);
+    }
+
+    struct source sub = { .type = SRC_SUB_LISTEN };
+    sub.fd = sub_listen();
+    if(sub.fd < 0){
+        perror("Warning: no subscriptions on " FP_SUB_PATH);
+    }else{
+        ev.data.ptr = &sub;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, sub.fd, &ev);
+    }
+
+    if(start_control(epfd) < 0)
+        perror("Warning: no control socket on " FP_CTL_PATH);
+
+#ifdef FP_IO_URING
+    if(use_ring)
+        ring_loop(epfd, sig.fd, uevent.fd >= 0, busy_poll);
+    else
+#endif
+        epoll_loop(epfd, uevent.fd >= 0, busy_poll);
+
+    stop_control();
+    print_stats(stdout);
+
+    for(int i = 0; i < FP_MAX_PEDALS; i++){
+        if(pedals[i].src.type == SRC_PEDAL && pedals[i].src.fd >= 0)
+            detach_pedal(epfd, &pedals[i]);
+    }
+    if(pipeline)
+        stop_acquisition();
+
+    while(num_waiters > 0)
+        notify_drop(waiters[0]);
+    if(notify.fd >= 0){
+        close(notify.fd);
+        unlink(FP_NOTIFY_PATH);
+    }
+
+    while(num_subscribers > 0)
+        sub_drop(subscribers[0]);
+    if(sub.fd >= 0){
+        close(sub.fd);
+        unlink(FP_SUB_PATH);
+    }
+
+    if(uevent.fd >= 0)
+        close(uevent.fd);
+    fp_cap_close(&capture);
+#ifdef FP_IO_URING
+    if(use_ring)
+        fp_ring_close(&ring);
+#endif
+    close(epfd);
+    close(sig.fd);
+    munmap(shm, sizeof(struct fp_shm));
+    if(stats != &local_stats)
+        munmap(stats, sizeof(struct fp_stats));
+
+    return 0;
+}
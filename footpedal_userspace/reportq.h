@@ -0,0 +1,152 @@
+#ifndef REPORTQ_H
+#define REPORTQ_H
+
+/*
+ * Lock-free single producer, single consumer ring of raw reports, from the
+ * reader's acquisition thread to its main thread (reader -p).
+ *
+ * The producer fills fp_rq_slot() and publishes it with fp_rq_push(), the
+ * consumer takes entries with fp_rq_peek() and fp_rq_pop(). head and tail
+ * live on cache lines of their own, and each side keeps a copy of the
+ * other's index that it only refreshes when the ring looks full or empty,
+ * so in the steady state neither side touches the other's line.
+ *
+ * Neither side makes a syscall unless the other one is asleep: the
+ * consumer waits in epoll on `efd`, which the producer only writes after
+ * the consumer said it's going to sleep (fp_rq_sleep()), and a producer
+ * facing a full ring waits on a futex on head until the consumer has
+ * made room.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// must be a power of two
+#define FP_RQ_SIZE 1024
+// same as REPORT_MAX in reader.c
+#define FP_RQ_REPORT 64
+
+struct fp_rq_entry {
+    uint64_t wake_ns;   // the acquisition thread's wakeup
+    uint64_t time_ns;   // read() returning, CLOCK_MONOTONIC
+    uint32_t gen;       // of the pedal, see struct pedal
+    uint16_t pedal;     // slot
+    int16_t len;        // 0: the device went away
+    unsigned char data[FP_RQ_REPORT];
+};
+
+struct fp_rq {
+    // consumer's line
+    _Alignas(64) _Atomic uint32_t head;
+    uint32_t tail_cache;
+
+    // producer's line
+    _Alignas(64) _Atomic uint32_t tail;
+    uint32_t head_cache;
+
+    // the rare path: who is asleep
+    _Alignas(64) _Atomic uint32_t consumer_sleeping;
+    _Atomic uint32_t producer_waiting;
+    int efd;
+
+    _Alignas(64) struct fp_rq_entry entries[FP_RQ_SIZE];
+};
+
+static inline int fp_rq_init(struct fp_rq *q){
+    atomic_store(&q->head, 0);
+    atomic_store(&q->tail, 0);
+    q->tail_cache = 0;
+    q->head_cache = 0;
+    atomic_store(&q->consumer_sleeping, 0);
+    atomic_store(&q->producer_waiting, 0);
+    q->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return q->efd < 0 ? -1 : 0;
+}
+
+static inline uint32_t fp_rq_depth(struct fp_rq *q){
+    return atomic_load_explicit(&q->tail, memory_order_relaxed) - atomic_load_explicit(&q->head, memory_order_relaxed);
+}
+
+// producer side
+
+// the next free entry, NULL if the ring is full
+static inline struct fp_rq_entry *fp_rq_slot(struct fp_rq *q){
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if(tail - q->head_cache == FP_RQ_SIZE){
+        q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+        if(tail - q->head_cache == FP_RQ_SIZE)
+            return NULL;
+    }
+    return &q->entries[tail & (FP_RQ_SIZE - 1)];
+}
+
+static inline void fp_rq_push(struct fp_rq *q){
+    atomic_store_explicit(&q->tail, atomic_load_explicit(&q->tail, memory_order_relaxed) + 1, memory_order_release);
+}
+
+// sleep until the consumer has made room
+static inline void fp_rq_wait_space(struct fp_rq *q){
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    while(true){
+        atomic_store(&q->producer_waiting, 1);
+        uint32_t head = atomic_load(&q->head);
+        if(tail - head < FP_RQ_SIZE)
+            break;
+        syscall(SYS_futex, &q->head, FUTEX_WAIT_PRIVATE, head, NULL, NULL, 0);
+    }
+    atomic_store(&q->producer_waiting, 0);
+}
+
+// after pushing: wake the consumer if it's asleep. true if that took a syscall
+static inline bool fp_rq_kick(struct fp_rq *q){
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&q->consumer_sleeping, memory_order_relaxed) == 0 || atomic_exchange(&q->consumer_sleeping, 0) == 0)
+        return false;
+    uint64_t one = 1;
+    write(q->efd, &one, sizeof(one));
+    return true;
+}
+
+// consumer side
+
+// the oldest entry, NULL if there is none
+static inline struct fp_rq_entry *fp_rq_peek(struct fp_rq *q){
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if(head == q->tail_cache){
+        q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if(head == q->tail_cache)
+            return NULL;
+    }
+    return &q->entries[head & (FP_RQ_SIZE - 1)];
+}
+
+// done with what fp_rq_peek() returned. true if the producer had to be woken
+static inline bool fp_rq_pop(struct fp_rq *q){
+    atomic_store_explicit(&q->head, atomic_load_explicit(&q->head, memory_order_relaxed) + 1, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&q->producer_waiting, memory_order_relaxed) == 0)
+        return false;
+    atomic_store(&q->producer_waiting, 0);
+    syscall(SYS_futex, &q->head, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    return true;
+}
+
+// about to wait on efd. false if there's something in the ring after all,
+// so don't
+static inline bool fp_rq_sleep(struct fp_rq *q){
+    atomic_store(&q->consumer_sleeping, 1);
+    // pairs with the fence in fp_rq_kick(): either we see its entry or it
+    // sees us asleep
+    atomic_thread_fence(memory_order_seq_cst);
+    if(fp_rq_peek(q) == NULL)
+        return true;
+    atomic_store(&q->consumer_sleeping, 0);
+    return false;
+}
+
+#endif
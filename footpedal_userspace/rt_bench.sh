@@ -0,0 +1,31 @@
+#!/bin/bash
+# Runs the reader against a virtual pedal while every CPU is kept busy,
+# first as a normal process, then with -l pinned to the last CPU, then
+# also busy polling. Needs root and the uhid module.
+
+READER_LOG=/tmp/footpedal-rt-reader.log
+. "$(dirname "$0")/bench_lib.sh"
+
+CPUS=$(nproc)
+LAST=$((CPUS - 1))
+
+# two busy loops per CPU, so the reader always has to compete for one
+STRESS=()
+for i in $(seq $((CPUS * 2))); do
+  (while :; do :; done) &
+  STRESS+=($!)
+done
+trap 'kill ${STRESS[*]} 2>/dev/null' EXIT
+
+run() {
+  echo "== reader $*, $((CPUS * 2)) busy loops on $CPUS CPUs"
+  start_reader "$@"
+  ./vpedal -n 1 -c 2000 -r 500
+  ./fpstat
+  stop_reader
+  echo
+}
+
+run
+run -l -c $LAST
+run -l -c $LAST -b
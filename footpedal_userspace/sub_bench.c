@@ -0,0 +1,196 @@
+/*
+ * Connects N subscribers to the reader's pub/sub socket and measures how
+ * long its records take to arrive: from the edge being published to us
+ * having read the record, over every subscriber, and separately for the
+ * first and the last one to connect, which the reader sends to first and
+ * last. Also checks every subscriber's record numbers for holes the
+ * reader didn't announce with a gap record.
+ *
+ * With -s, that many more subscribers connect but never read, to show a
+ * stuck client only loses its own records.
+ *
+ * Something has to press pedals meanwhile, see sub_bench.sh.
+ *
+ * usage: ./sub_bench [-n subscribers] [-s stuck subscribers] [-c records per subscriber]
+ *                    [-t seconds] [-j threads]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "footpedal.h"
+#include "footpedal_stats.h"
+
+struct sub {
+    int fd;
+    uint64_t expect;    // next record number
+    uint64_t records;   // records and lost ones, towards -c
+    uint64_t lost;
+    uint64_t holes;     // numbers skipped without a gap record
+};
+
+struct worker {
+    pthread_t thread;
+    int first, end;     // its subscribers
+    struct fp_hist all, first_sub, last_sub;
+};
+
+int num_subs = 100;
+int stuck = 0;
+int count = 2000;
+int timeout_s = 30;
+int num_threads = 0;
+
+struct sub *subs;
+volatile bool stop;
+
+uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void *worker_main(void *arg){
+    struct worker *w = arg;
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    for(int i = w->first; i < w->end; i++){
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &subs[i] };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, subs[i].fd, &ev);
+    }
+
+    int done = 0;
+    struct epoll_event events[64];
+    while(!stop && done < w->end - w->first){
+        int n = epoll_wait(epfd, events, 64, 100);
+        for(int k = 0; k < n; k++){
+            struct sub *s = events[k].data.ptr;
+            struct fp_sub_record rec;
+            int ret;
+            while((ret = fp_sub_next(s->fd, &rec)) > 0){
+                uint64_t t = now_ns();
+                if(rec.seq != s->expect)
+                    s->holes++;
+                if(rec.type == FP_SUB_GAP){
+                    s->lost += rec.state;
+                    s->records += rec.state;
+                    s->expect = rec.seq + rec.state;
+                    continue;
+                }
+                s->expect = rec.seq + 1;
+
+                int i = s - subs;
+                fp_hist_record(&w->all, t - rec.time_ns);
+                if(i == 0)
+                    fp_hist_record(&w->first_sub, t - rec.time_ns);
+                if(i == num_subs - 1)
+                    fp_hist_record(&w->last_sub, t - rec.time_ns);
+
+                if(++s->records == (uint64_t)count)
+                    done++;
+            }
+            if(ret == 0){
+                printf("Error: the reader went away\n");
+                stop = true;
+            }
+        }
+    }
+    close(epfd);
+    return NULL;
+}
+
+void hist_add(struct fp_hist *to, const struct fp_hist *from){
+    to->count += from->count;
+    to->sum += from->sum;
+    if(from->max > to->max)
+        to->max = from->max;
+    for(int i = 0; i < FP_HIST_BUCKETS; i++)
+        to->buckets[i] += from->buckets[i];
+}
+
+int main(int argc, char **argv){
+    int opt;
+    while((opt = getopt(argc, argv, "n:s:c:t:j:")) != -1){
+        switch(opt){
+        case 'n': num_subs = atoi(optarg); break;
+        case 's': stuck = atoi(optarg); break;
+        case 'c': count = atoi(optarg); break;
+        case 't': timeout_s = atoi(optarg); break;
+        case 'j': num_threads = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n subscribers] [-s stuck subscribers] [-c records per subscriber] [-t seconds] [-j threads]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(num_subs < 1 || stuck < 0 || count < 1)
+        return 1;
+    if(num_threads <= 0)
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(num_threads > num_subs)
+        num_threads = num_subs;
+
+    // the stuck ones connect last, so the reader gets to them after
+    // everyone else
+    subs = calloc(num_subs + stuck, sizeof(*subs));
+    for(int i = 0; i < num_subs + stuck; i++){
+        subs[i].fd = fp_subscribe(~0ull, FP_SUB_EDGES);
+        subs[i].expect = 1;
+        if(subs[i].fd < 0){
+            perror("Error: could not subscribe, is the reader running?");
+            return 1;
+        }
+        fcntl(subs[i].fd, F_SETFL, O_NONBLOCK);
+    }
+    printf("subscribers: %d (+%d stuck), waiting for %d records each\n", num_subs, stuck, count);
+
+    struct worker *workers = calloc(num_threads, sizeof(*workers));
+    for(int t = 0; t < num_threads; t++){
+        workers[t].first = num_subs * t / num_threads;
+        workers[t].end = num_subs * (t + 1) / num_threads;
+        pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]);
+    }
+
+    uint64_t deadline = now_ns() + timeout_s * 1000000000ull;
+    bool all_done = false;
+    while(!all_done && !stop && now_ns() < deadline){
+        usleep(10000);
+        all_done = true;
+        for(int i = 0; i < num_subs; i++)
+            all_done &= subs[i].records >= (uint64_t)count;
+    }
+    stop = true;
+
+    struct fp_hist all = { 0 }, first = { 0 }, last = { 0 };
+    for(int t = 0; t < num_threads; t++){
+        pthread_join(workers[t].thread, NULL);
+        hist_add(&all, &workers[t].all);
+        hist_add(&first, &workers[t].first_sub);
+        hist_add(&last, &workers[t].last_sub);
+    }
+
+    uint64_t lost = 0, holes = 0, short_subs = 0;
+    for(int i = 0; i < num_subs; i++){
+        lost += subs[i].lost;
+        holes += subs[i].holes;
+        short_subs += subs[i].records < (uint64_t)count;
+    }
+    printf("records: %lu, lost: %lu, unannounced holes: %lu, subscribers that timed out: %lu\n",
+           (unsigned long)all.count, (unsigned long)lost, (unsigned long)holes, (unsigned long)short_subs);
+    fp_hist_print(stdout, "all", &all);
+    fp_hist_print(stdout, "first", &first);
+    fp_hist_print(stdout, "last", &last);
+
+    for(int i = 0; i < num_subs + stuck; i++)
+        close(subs[i].fd);
+    return holes > 0;
+}
@@ -0,0 +1,31 @@
+#!/bin/bash
+# Fans a virtual pedal's edges out to more and more subscribers (see
+# sub_bench.c) and prints how long records take to reach them, then does
+# it once more with a few subscribers that never read. Needs root and the
+# uhid module.
+
+READER_LOG=/tmp/footpedal-sub-reader.log
+. "$(dirname "$0")/bench_lib.sh"
+
+start_reader
+
+run() {
+  echo "== sub_bench $*"
+  ./sub_bench "$@" -c 2000 &
+  SUBS=$!
+  sleep 0.5
+  ./vpedal -n 1 -c 2000 -r 1000 > /dev/null
+  wait $SUBS
+  echo
+}
+
+run -n 1
+run -n 10
+run -n 100
+run -n 250
+run -n 500
+run -n 100 -s 10
+
+echo "== reader"
+./fpstat
+stop_reader
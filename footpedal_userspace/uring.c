@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+static int sys_setup(unsigned entries, struct io_uring_params *p){
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned submit, unsigned wait, unsigned flags, void *arg, size_t argsz){
+    return syscall(__NR_io_uring_enter, fd, submit, wait, flags, arg, argsz);
+}
+
+static int sys_register(int fd, unsigned op, void *arg, unsigned nr){
+    return syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+int fp_ring_init(struct fp_ring *r, unsigned entries, unsigned nfiles, unsigned nbufs, unsigned buf_size){
+    int ret;
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+
+    // one thread submits and reaps, so the kernel can skip the locking and
+    // run completions when we next enter instead of interrupting us, and
+    // flag when there are some waiting for that. room for a completion per
+    // buffer, so a burst can't overflow the CQ
+    struct io_uring_params p = {
+        .flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG | IORING_SETUP_CQSIZE,
+        .cq_entries = nbufs * 2,
+    };
+    r->fd = sys_setup(entries, &p);
+    if(r->fd < 0 && errno == EINVAL){
+        // before 6.0
+        p.flags = IORING_SETUP_CQSIZE;
+        r->fd = sys_setup(entries, &p);
+    }
+    if(r->fd < 0)
+        return -1;
+
+    if(!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)){
+        close(r->fd);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->rings_size = sq_size > cq_size ? sq_size : cq_size;
+    r->rings = mmap(NULL, r->rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if(r->rings == MAP_FAILED || r->sqes == MAP_FAILED)
+        goto fail;
+
+    char *base = r->rings;
+    r->sq_head = (unsigned *)(base + p.sq_off.head);
+    r->sq_tail = (unsigned *)(base + p.sq_off.tail);
+    r->sq_flags = (unsigned *)(base + p.sq_off.flags);
+    r->sq_mask = *(unsigned *)(base + p.sq_off.ring_mask);
+    r->sq_local = *r->sq_tail;
+    unsigned *array = (unsigned *)(base + p.sq_off.array);
+    for(unsigned i = 0; i < p.sq_entries; i++)
+        array[i] = i;
+
+    r->cq_head = (unsigned *)(base + p.cq_off.head);
+    r->cq_tail = (unsigned *)(base + p.cq_off.tail);
+    r->cq_mask = *(unsigned *)(base + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(base + p.cq_off.cqes);
+
+    // all slots start empty
+    int *fds = malloc(nfiles * sizeof(int));
+    if(fds == NULL)
+        goto fail;
+    memset(fds, -1, nfiles * sizeof(int));
+    ret = sys_register(r->fd, IORING_REGISTER_FILES, fds, nfiles);
+    free(fds);
+    if(ret < 0)
+        goto fail;
+
+    // the buffers and the ring the kernel picks them from
+    r->nbufs = nbufs;
+    r->buf_size = buf_size;
+    r->br = mmap(NULL, nbufs * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    r->bufs = mmap(NULL, (size_t)nbufs * buf_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if(r->br == MAP_FAILED || r->bufs == MAP_FAILED)
+        goto fail;
+
+    struct io_uring_buf_reg reg = {
+        .ring_addr = (uint64_t)(uintptr_t)r->br,
+        .ring_entries = nbufs,
+        .bgid = 0,
+    };
+    if(sys_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        goto fail;
+    for(unsigned i = 0; i < nbufs; i++)
+        fp_ring_recycle(r, i);
+    return 0;
+
+fail:
+    ret = errno;
+    fp_ring_close(r);
+    errno = ret;
+    return -1;
+}
+
+void fp_ring_close(struct fp_ring *r){
+    if(r->br != NULL && r->br != MAP_FAILED)
+        munmap(r->br, r->nbufs * sizeof(struct io_uring_buf));
+    if(r->bufs != NULL && r->bufs != MAP_FAILED)
+        munmap(r->bufs, (size_t)r->nbufs * r->buf_size);
+    if(r->sqes != NULL && r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqes_size);
+    if(r->rings != NULL && r->rings != MAP_FAILED)
+        munmap(r->rings, r->rings_size);
+    if(r->fd >= 0)
+        close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+bool fp_ring_supports(struct fp_ring *r, int op){
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, len);
+    if(probe == NULL)
+        return false;
+
+    bool ok = sys_register(r->fd, IORING_REGISTER_PROBE, probe, 256) == 0
+        && op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+int fp_ring_set_file(struct fp_ring *r, unsigned index, int fd){
+    struct io_uring_files_update up = { .offset = index, .fds = (uint64_t)(uintptr_t)&fd };
+    return sys_register(r->fd, IORING_REGISTER_FILES_UPDATE, &up, 1) < 0 ? -1 : 0;
+}
+
+unsigned fp_ring_pending(struct fp_ring *r){
+    return r->sq_local - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+}
+
+bool fp_ring_taskrun(struct fp_ring *r){
+    return __atomic_load_n(r->sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_TASKRUN;
+}
+
+struct io_uring_sqe *fp_ring_sqe(struct fp_ring *r){
+    if(fp_ring_pending(r) > r->sq_mask)
+        fp_ring_enter(r, 0, 0);
+
+    struct io_uring_sqe *sqe = &r->sqes[r->sq_local & r->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_local++;
+    return sqe;
+}
+
+int fp_ring_enter(struct fp_ring *r, unsigned wait, uint64_t timeout_ns){
+    __atomic_store_n(r->sq_tail, r->sq_local, __ATOMIC_RELEASE);
+
+    struct __kernel_timespec ts = { timeout_ns / 1000000000ull, timeout_ns % 1000000000ull };
+    struct io_uring_getevents_arg arg = { .ts = timeout_ns ? (uint64_t)(uintptr_t)&ts : 0 };
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0;
+    return sys_enter(r->fd, fp_ring_pending(r), wait, flags, &arg, sizeof(arg));
+}
+
+struct io_uring_cqe *fp_ring_peek(struct fp_ring *r){
+    unsigned head = *r->cq_head;
+    if(head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &r->cqes[head & r->cq_mask];
+}
+
+void fp_ring_seen(struct fp_ring *r){
+    __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+unsigned char *fp_ring_buf(struct fp_ring *r, unsigned bid){
+    return r->bufs + (size_t)bid * r->buf_size;
+}
+
+void fp_ring_recycle(struct fp_ring *r, unsigned bid){
+    struct io_uring_buf *b = &r->br->bufs[r->br_tail & (r->nbufs - 1)];
+    b->addr = (uint64_t)(uintptr_t)fp_ring_buf(r, bid);
+    b->len = r->buf_size;
+    b->bid = bid;
+    r->br_tail++;
+    __atomic_store_n(&r->br->tail, r->br_tail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,77 @@
+#ifndef URING_H
+#define URING_H
+
+/*
+ * Just enough io_uring for the reader's io_uring backend (make
+ * IO_URING=1), straight on the syscalls so it doesn't need liburing.
+ *
+ * One ring, with a table of fixed files the caller fills in by index and
+ * one group of provided buffers (group 0) that multishot reads pick from.
+ * A completion that used a buffer carries its ID; hand it back with
+ * fp_ring_recycle() once you're done with the data.
+ *
+ * Everything here is for a single thread: the caller gets SQEs, fills
+ * them in and submits them with the next fp_ring_enter(), then walks the
+ * completions with fp_ring_peek()/fp_ring_seen().
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <linux/io_uring.h>
+
+// 6.7, newer than some distros' headers
+#define FP_OP_READ_MULTISHOT 49
+
+struct fp_ring {
+    int fd;
+
+    // submission queue
+    unsigned *sq_head, *sq_tail, *sq_flags, sq_mask;
+    unsigned sq_local;      // tail including SQEs we haven't published yet
+    struct io_uring_sqe *sqes;
+
+    // completion queue
+    unsigned *cq_head, *cq_tail, cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *rings;
+    size_t rings_size, sqes_size;
+
+    // provided buffers
+    struct io_uring_buf_ring *br;
+    unsigned char *bufs;
+    unsigned nbufs, buf_size;
+    uint16_t br_tail;
+};
+
+// entries SQEs, nfiles empty fixed file slots and nbufs (a power of two)
+// buffers of buf_size bytes. -1 with errno set if the kernel can't
+int fp_ring_init(struct fp_ring *r, unsigned entries, unsigned nfiles, unsigned nbufs, unsigned buf_size);
+void fp_ring_close(struct fp_ring *r);
+// whether the kernel knows this opcode
+bool fp_ring_supports(struct fp_ring *r, int op);
+// point fixed file `index` at fd, or empty it with -1
+int fp_ring_set_file(struct fp_ring *r, unsigned index, int fd);
+
+// a zeroed SQE, submitted with the next fp_ring_enter(). if the queue is
+// full the ones already in it are submitted first
+struct io_uring_sqe *fp_ring_sqe(struct fp_ring *r);
+// SQEs waiting for fp_ring_enter()
+unsigned fp_ring_pending(struct fp_ring *r);
+// completions are waiting for us to enter the kernel before they show
+// up in the CQ. only ever true on 5.19+, older kernels post them directly
+bool fp_ring_taskrun(struct fp_ring *r);
+// submit what's pending and wait for `wait` completions, at most
+// timeout_ns if that isn't 0. returns what was submitted, or -1 with
+// errno set (ETIME when the timeout ran out)
+int fp_ring_enter(struct fp_ring *r, unsigned wait, uint64_t timeout_ns);
+
+// the oldest completion, NULL if there is none
+struct io_uring_cqe *fp_ring_peek(struct fp_ring *r);
+// done with what fp_ring_peek() returned
+void fp_ring_seen(struct fp_ring *r);
+
+unsigned char *fp_ring_buf(struct fp_ring *r, unsigned bid);
+void fp_ring_recycle(struct fp_ring *r, unsigned bid);
+
+#endif
@@ -0,0 +1,329 @@
+/*
+ * Virtual FootSwitch: creates one or more uhid devices that look exactly
+ * like the QinHeng pedal (same IDs, same 212 byte report descriptor as
+ * documented in drivers/FootSwitch_BPF.c) and makes them press and
+ * release at a given rate. Needs root and the uhid module.
+ *
+ * If the reader is running, it also watches /dev/shm/footpedal and
+ * reports how many edges the reader published, how many it dropped and
+ * how long each one took from our write() to being published.
+ *
+ * usage: ./vpedal [-n devices] [-c reports per device] [-r reports/sec per device]
+ *                 [-b burst] [-w seconds to wait for the reader] [-u]
+ *
+ * -r 0 sends as fast as possible. With -b N, every tick sends N reports
+ * back to back on each device, and ticks come at rate / N per second.
+ *
+ * -u creates uinput devices instead, with the same IDs and a single key,
+ * 'b'. They only have an evdev node, no hidraw one, so they're for the
+ * reader's evdev backend (reader -e), and need the uinput module instead.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/uhid.h>
+#include <linux/uinput.h>
+
+#include "footpedal.h"
+#include "footpedal_stats.h"
+#include "footswitch_rdesc.h"
+
+// report ID 1, 'b' pressed / everything released
+static const unsigned char press_report[9] = { 0x01, 0, 0, 0x05, 0, 0, 0, 0, 0 };
+static const unsigned char release_report[9] = { 0x01, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+struct vdev {
+    int fd;
+    char uniq[64];      // what the reader names it by: uniq, or phys for uinput
+    int slot;           // slot the reader gave it, -1 if we aren't watching
+    uint64_t edges;     // the slot's edge count before we started
+    int sent;
+    uint64_t *sent_ns;  // when each report went out
+    int seen;           // edges the monitor has matched so far
+    bool lost;          // an edge went missing, so seen no longer lines up with sent
+};
+
+int num_devs = 1;
+int count = 1000;
+int rate = 100;
+int burst = 1;
+int wait_secs = 5;
+bool use_uinput = false;
+
+struct vdev *devs;
+struct fp_client *client;
+struct fp_hist latency;
+uint64_t monitor_missed;
+uint64_t discarded;
+volatile bool monitoring;
+
+uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// uinput has no uniq, so the reader goes by our phys
+int vdev_create_uinput(struct vdev *d, int index){
+    d->fd = open("/dev/uinput", O_WRONLY | O_CLOEXEC);
+    if(d->fd < 0)
+        return -1;
+
+    snprintf(d->uniq, sizeof(d->uniq), "vpedal/input%d", index);
+
+    struct uinput_setup setup = { .id = { .bustype = BUS_USB, .vendor = 0x1a86, .product = 0xe026 } };
+    snprintf(setup.name, sizeof(setup.name), "QinHeng FootSwitch");
+
+    if(ioctl(d->fd, UI_SET_EVBIT, EV_KEY) < 0 || ioctl(d->fd, UI_SET_KEYBIT, KEY_B) < 0
+       || ioctl(d->fd, UI_SET_EVBIT, EV_MSC) < 0 || ioctl(d->fd, UI_SET_MSCBIT, MSC_SCAN) < 0
+       || ioctl(d->fd, UI_SET_PHYS, d->uniq) < 0 || ioctl(d->fd, UI_DEV_SETUP, &setup) < 0
+       || ioctl(d->fd, UI_DEV_CREATE) < 0){
+        close(d->fd);
+        return -1;
+    }
+    return 0;
+}
+
+int vdev_create(struct vdev *d, int index){
+    if(use_uinput)
+        return vdev_create_uinput(d, index);
+
+    d->fd = open("/dev/uhid", O_RDWR | O_CLOEXEC);
+    if(d->fd < 0)
+        return -1;
+
+    snprintf(d->uniq, sizeof(d->uniq), "vpedal-%d", index);
+
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    snprintf((char *)ev.u.create2.name, sizeof(ev.u.create2.name), "QinHeng FootSwitch");
+    snprintf((char *)ev.u.create2.phys, sizeof(ev.u.create2.phys), "vpedal/input%d", index);
+    snprintf((char *)ev.u.create2.uniq, sizeof(ev.u.create2.uniq), "%s", d->uniq);
+    ev.u.create2.rd_size = sizeof(footswitch_rdesc);
+    ev.u.create2.bus = BUS_USB;
+    ev.u.create2.vendor = 0x1a86;
+    ev.u.create2.product = 0xe026;
+    memcpy(ev.u.create2.rd_data, footswitch_rdesc, sizeof(footswitch_rdesc));
+
+    if(write(d->fd, &ev, sizeof(ev)) != sizeof(ev)){
+        close(d->fd);
+        return -1;
+    }
+    return 0;
+}
+
+void vdev_destroy(struct vdev *d){
+    if(use_uinput){
+        ioctl(d->fd, UI_DEV_DESTROY);
+        close(d->fd);
+        return;
+    }
+
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_DESTROY;
+    write(d->fd, &ev, sizeof(ev));
+    close(d->fd);
+}
+
+// the key and its SYN_REPORT in one write(), so they're one packet. the
+// scan code is what usbhid sends for the factory 'b', so the reader
+// numbers the button the way it would on the real pedal
+void vdev_send_uinput(struct vdev *d){
+    struct input_event ev[3] = {
+        { .type = EV_MSC, .code = MSC_SCAN, .value = 0x70005 },
+        { .type = EV_KEY, .code = KEY_B, .value = d->sent % 2 == 0 },
+        { .type = EV_SYN, .code = SYN_REPORT },
+    };
+
+    d->sent_ns[d->sent] = now_ns();
+    write(d->fd, ev, sizeof(ev));
+    d->sent++;
+}
+
+void vdev_send(struct vdev *d){
+    if(use_uinput){
+        vdev_send_uinput(d);
+        return;
+    }
+
+    struct uhid_event ev;
+    const unsigned char *report = d->sent % 2 == 0 ? press_report : release_report;
+
+    ev.type = UHID_INPUT2;
+    ev.u.input2.size = sizeof(press_report);
+    memcpy(ev.u.input2.data, report, sizeof(press_report));
+
+    d->sent_ns[d->sent] = now_ns();
+    // uhid takes the event header plus only as much of the report as we use
+    write(d->fd, &ev, offsetof(struct uhid_event, u.input2.data) + sizeof(press_report));
+    d->sent++;
+}
+
+// match every edge the reader publishes to the report that caused it.
+// our devices alternate press and release, so edge k on a pedal is report
+// k, until one is lost: then a press shows up where we expect a release or
+// the ring overwrote edges we never saw. From there on we can't tell which
+// report an edge belongs to, so its samples are thrown away
+void *monitor_main(void *arg){
+    struct fp_edge edges[FP_HISTORY];
+    struct fp_state st;
+
+    while(monitoring){
+        if(fp_wait_change(client, 50, &st) <= 0)
+            continue;
+
+        uint64_t missed;
+        int n = fp_edges(client, edges, FP_HISTORY, &missed);
+        monitor_missed += missed;
+        // no telling whose they were
+        if(missed > 0)
+            for(int j = 0; j < num_devs; j++)
+                devs[j].lost = true;
+
+        for(int i = 0; i < n; i++){
+            for(int j = 0; j < num_devs; j++){
+                struct vdev *d = &devs[j];
+                if(d->slot != (int)edges[i].pedal)
+                    continue;
+                // even reports press, odd ones release
+                if((edges[i].state != 0) != (d->seen % 2 == 0))
+                    d->lost = true;
+                // report k went out before its edge could be published
+                if(!d->lost && d->seen < count && edges[i].time_ns >= d->sent_ns[d->seen])
+                    fp_hist_record(&latency, edges[i].time_ns - d->sent_ns[d->seen]);
+                else
+                    discarded++;
+                d->seen++;
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+// wait for the reader to pick up all our devices
+bool find_slots(){
+    uint64_t deadline = now_ns() + (uint64_t)wait_secs * 1000000000ull;
+    int found = 0;
+
+    while(found < num_devs && now_ns() < deadline){
+        found = 0;
+        for(int i = 0; i < num_devs; i++){
+            struct fp_pedal p;
+            int slot = fp_find_pedal(client, devs[i].uniq);
+            if(slot >= 0 && fp_pedal(client, slot, &p) == 0 && p.present){
+                devs[i].slot = slot;
+                devs[i].edges = p.edges;
+                found++;
+            }
+        }
+        usleep(10000);
+    }
+    return found == num_devs;
+}
+
+int main(int argc, char **argv){
+    int opt;
+    while((opt = getopt(argc, argv, "n:c:r:b:w:u")) != -1){
+        switch(opt){
+        case 'n': num_devs = atoi(optarg); break;
+        case 'c': count = atoi(optarg); break;
+        case 'r': rate = atoi(optarg); break;
+        case 'b': burst = atoi(optarg); break;
+        case 'w': wait_secs = atoi(optarg); break;
+        case 'u': use_uinput = true; break;
+        default:
+            fprintf(stderr, "usage: %s [-n devices] [-c reports per device] [-r reports/sec per device] [-b burst] [-w wait] [-u]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(num_devs < 1 || count < 1 || burst < 1)
+        return 1;
+
+    devs = calloc(num_devs, sizeof(*devs));
+    for(int i = 0; i < num_devs; i++){
+        devs[i].slot = -1;
+        devs[i].sent_ns = calloc(count, sizeof(uint64_t));
+        if(vdev_create(&devs[i], i) < 0){
+            if(use_uinput)
+                perror("Error: could not create uinput device (are you root, is the uinput module loaded?)");
+            else
+                perror("Error: could not create uhid device (are you root, is the uhid module loaded?)");
+            return 1;
+        }
+    }
+
+    pthread_t monitor;
+    client = fp_open(NULL);
+    if(client != NULL && find_slots()){
+        monitoring = true;
+        pthread_create(&monitor, NULL, monitor_main, NULL);
+    }else{
+        printf("reader didn't pick up the devices, just generating\n");
+    }
+
+    // each tick sends `burst` reports on every device
+    uint64_t tick_ns = rate > 0 ? 1000000000ull * burst / rate : 0;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    uint64_t start = now_ns();
+    for(int sent = 0; sent < count; sent += burst){
+        for(int i = 0; i < num_devs; i++){
+            for(int b = 0; b < burst && devs[i].sent < count; b++)
+                vdev_send(&devs[i]);
+        }
+
+        if(tick_ns > 0){
+            next.tv_nsec += tick_ns;
+            while(next.tv_nsec >= 1000000000){
+                next.tv_nsec -= 1000000000;
+                next.tv_sec++;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    uint64_t sent = (uint64_t)num_devs * count;
+    printf("devices: %d, reports: %lu in %.3f s (%.0f/s)\n", num_devs, sent, elapsed / 1e9, sent / (elapsed / 1e9));
+
+    if(monitoring){
+        // let the reader catch up before counting
+        usleep(200000);
+        monitoring = false;
+        pthread_join(monitor, NULL);
+
+        uint64_t published = 0;
+        for(int i = 0; i < num_devs; i++){
+            struct fp_pedal p;
+            fp_pedal(client, devs[i].slot, &p);
+            published += p.edges - devs[i].edges;
+        }
+
+        printf("published edges: %lu (%.0f/s), dropped: %lu, not seen by us: %lu\n", published,
+               published / (elapsed / 1e9), sent > published ? sent - published : 0, monitor_missed);
+        if(discarded > 0)
+            printf("latency samples discarded after a lost or merged edge: %lu\n", discarded);
+        fp_hist_print(stdout, "latency", &latency);
+    }
+
+    fp_close(client);
+    for(int i = 0; i < num_devs; i++)
+        vdev_destroy(&devs[i]);
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * Measures press-to-wakeup time through the client library: publishes
+ * edges into a scratch segment the same way the reader does and has N
+ * threads sleeping in fp_wait_change() on it. Latency is the time from
+ * the edge's timestamp to the waiter running again.
+ *
+ * usage: ./wakeup_latency [edges per run]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "footpedal.h"
+#include "footpedal_shm.h"
+
+#define TEST_PATH "/dev/shm/footpedal-wakeup-test"
+
+int num_edges = 200;
+int pedal;
+
+struct waiter {
+    pthread_t thread;
+    uint64_t *latency;
+    int count;
+};
+
+uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void *waiter_main(void *arg){
+    struct waiter *w = arg;
+    struct fp_client *c = fp_open(TEST_PATH);
+    struct fp_state st;
+
+    while(c != NULL && w->count < num_edges){
+        if(fp_wait_change(c, 1000, &st) <= 0)
+            break;
+        w->latency[w->count++] = now_ns() - st.time_ns;
+    }
+
+    fp_close(c);
+    return NULL;
+}
+
+int cmp_u64(const void *a, const void *b){
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+void run(struct fp_shm *shm, int num_waiters){
+    struct waiter *waiters = calloc(num_waiters, sizeof(*waiters));
+
+    for(int i = 0; i < num_waiters; i++){
+        waiters[i].latency = calloc(num_edges, sizeof(uint64_t));
+        pthread_create(&waiters[i].thread, NULL, waiter_main, &waiters[i]);
+    }
+
+    // give everyone time to fall asleep before each edge
+    struct timespec gap = { .tv_nsec = 2000000 };
+    nanosleep(&gap, NULL);
+    for(int e = 0; e < num_edges; e++){
+        fp_shm_publish(shm, pedal, !(shm->pressed & (1ull << pedal)), now_ns());
+        nanosleep(&gap, NULL);
+    }
+
+    uint64_t *all = calloc((size_t)num_waiters * (unsigned)num_edges, sizeof(uint64_t));
+    size_t n = 0;
+    for(int i = 0; i < num_waiters; i++){
+        pthread_join(waiters[i].thread, NULL);
+        for(int j = 0; j < waiters[i].count; j++)
+            all[n++] = waiters[i].latency[j];
+        free(waiters[i].latency);
+    }
+
+    qsort(all, n, sizeof(uint64_t), cmp_u64);
+    if(n > 0){
+        printf("%4d waiters: %6zu wakeups, p50 %7.1f us, p99 %7.1f us, max %7.1f us, missed %zu\n",
+               num_waiters, n, all[n / 2] / 1e3, all[n * 99 / 100] / 1e3, all[n - 1] / 1e3,
+               (size_t)num_waiters * num_edges - n);
+    }
+
+    free(all);
+    free(waiters);
+}
+
+int main(int argc, char **argv){
+    if(argc > 1)
+        num_edges = atoi(argv[1]);
+    if(num_edges < 1){
+        fprintf(stderr, "usage: %s [edges per run]\n", argv[0]);
+        return 1;
+    }
+
+    int fd = open(TEST_PATH, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0 || ftruncate(fd, sizeof(struct fp_shm)) < 0){
+        perror(TEST_PATH);
+        return 1;
+    }
+    struct fp_shm *shm = mmap(NULL, sizeof(struct fp_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    fp_shm_init(shm, now_ns());
+    pedal = fp_shm_attach(shm, "wakeup-test");
+
+    int counts[] = { 1, 4, 16, 64, 256 };
+    for(unsigned i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+        run(shm, counts[i]);
+
+    munmap(shm, sizeof(struct fp_shm));
+    unlink(TEST_PATH);
+    return 0;
+}